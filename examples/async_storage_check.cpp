@@ -0,0 +1,256 @@
+#include "em_storage.h"
+#include "em_storage_async.h"
+
+// The asynchronous commits check:
+//  - commits stay barriers (i.e. the writes staged after a commit are not
+//    committed with the previous ones)
+//  - a random workload (puts, removals, clears, transactions, writes bigger
+//    than the queue and reads) matches a model of the expected values
+//  - concurrent writers on 'EM_MULTITHREAD' (e.g. build with a thread
+//    sanitizer)
+
+#define OPERATIONS 200000UL
+#define KEYS_COUNT 20
+#define MAX_VALUE_LEN 60
+#define BIG_VALUE_LEN 599
+
+static uint8_t memory[65536];
+static uint8_t queueMemory[1024];
+
+// The memory backend logging its operations: 'w' for writes and removals,
+// 'C' for commits
+class LogBackend: public EmMemStorageBackend {
+public:
+    LogBackend()
+     : EmMemStorageBackend(memory, sizeof(memory)),
+       m_logLen(0) {
+        m_log[0] = 0;
+    }
+
+    virtual EmStorageError setBlob(const char* key, const void* value, size_t len) override {
+        log_('w');
+        return EmMemStorageBackend::setBlob(key, value, len);
+    }
+
+    virtual EmStorageError setString(const char* key, const char* value) override {
+        log_('w');
+        return EmMemStorageBackend::setString(key, value);
+    }
+
+    virtual EmStorageError erase(const char* key) override {
+        log_('w');
+        return EmMemStorageBackend::erase(key);
+    }
+
+    virtual EmStorageError commit() override {
+        log_('C');
+        return EmMemStorageBackend::commit();
+    }
+
+    const char* getLog() const {
+        return m_log;
+    }
+
+private:
+    void log_(char op) {
+        if (m_logLen + 1 < sizeof(m_log)) {
+            m_log[m_logLen++] = op;
+            m_log[m_logLen] = 0;
+        }
+    }
+
+    char m_log[32];
+    size_t m_logLen;
+};
+
+static bool checkBarriers() {
+    memset(memory, 0, sizeof(memory));
+    LogBackend backend;
+    EmAsyncStorageBackend async(backend, queueMemory, sizeof(queueMemory));
+    EmStorage storage(async);
+    storage.begin("check");
+    storage.putValue("a", 1, false);
+    storage.commit();
+    storage.putValue("b", 2, false);
+    storage.commit();
+    storage.flush();
+    storage.end();
+    bool ok = strcmp(backend.getLog(), "wCwC") == 0;
+    printf("barriers: backend operations %s -> %s\n", backend.getLog(), ok ? "OK" : "FAILED");
+    return ok;
+}
+
+// The expected value of a key
+struct ModelValue {
+    bool exists;
+    char value[BIG_VALUE_LEN+1];
+};
+
+static ModelValue model[KEYS_COUNT];
+
+static void putModel(uint8_t k, const char* value) {
+    model[k].exists = true;
+    strcpy(model[k].value, value);
+}
+
+static bool isModel(uint8_t k, const char* value, size_t len) {
+    return model[k].exists ? len != 0 && strcmp(model[k].value, value) == 0 : len == 0;
+}
+
+static bool checkModel() {
+    memset(memory, 0, sizeof(memory));
+    memset(model, 0, sizeof(model));
+    static uint8_t txBuffer[512];
+    static char value[BIG_VALUE_LEN+1];
+    bool ok = true;
+    uint32_t operations = 0;
+    EmMemStorageBackend backend(memory, sizeof(memory));
+    EmAsyncStorageBackend async(backend, queueMemory, sizeof(queueMemory));
+    {
+        EmStorage storage(async);
+        storage.begin("check");
+        storage.setTxBuffer(txBuffer, sizeof(txBuffer));
+        for (; operations < OPERATIONS && ok; operations++) {
+            uint8_t k = static_cast<uint8_t>(random(KEYS_COUNT));
+            char key[8];
+            snprintf(key, sizeof(key), "k%u", static_cast<unsigned int>(k));
+            long op = random(100);
+            if (op < 50) {
+                size_t len = static_cast<size_t>(random(MAX_VALUE_LEN));
+                for (size_t i=0; i < len; i++) {
+                    value[i] = static_cast<char>('a' + random(26));
+                }
+                value[len] = 0;
+                storage.putString(key, value, random(2) == 0);
+                putModel(k, value);
+            } else if (op < 60) {
+                storage.remove(key);
+                model[k].exists = false;
+            } else if (op < 61) {
+                storage.clear();
+                memset(model, 0, sizeof(model));
+            } else if (op < 63) {
+                storage.beginTx();
+                storage.putString("k1", "tx1");
+                storage.putString("k2", "tx2");
+                storage.remove("k3");
+                ok = storage.commitTx();
+                putModel(1, "tx1");
+                putModel(2, "tx2");
+                model[3].exists = false;
+            } else if (op < 64) {
+                // Bigger than the queue (i.e. written through)
+                memset(value, 'z', BIG_VALUE_LEN);
+                value[BIG_VALUE_LEN] = 0;
+                storage.putString(key, value);
+                putModel(k, value);
+            } else if (op < 70) {
+                async.update();
+            } else {
+                size_t len = storage.getString(key, value, sizeof(value));
+                ok = isModel(k, value, len);
+            }
+        }
+        storage.end();
+    }
+    // Reopened without the queue (i.e. all the values committed)
+    EmStorage storage(backend);
+    storage.begin("check");
+    for (uint8_t k=0; k < KEYS_COUNT && ok; k++) {
+        char key[8];
+        snprintf(key, sizeof(key), "k%u", static_cast<unsigned int>(k));
+        size_t len = storage.getString(key, value, sizeof(value));
+        ok = isModel(k, value, len);
+    }
+    storage.end();
+    printf("model: %u operations, %u backend commits -> %s\n",
+           static_cast<unsigned int>(operations),
+           static_cast<unsigned int>(async.getCommits()),
+           ok ? "OK" : "FAILED");
+    return ok;
+}
+
+#ifdef EM_MULTITHREAD
+
+#include <thread>
+#include <atomic>
+
+#define WRITERS_COUNT 4
+#define WRITES_COUNT 2000
+
+static std::atomic<uint32_t> failures(0);
+
+// Writes its own key, reads it back and waits for a commit now and then
+static void writer(EmStorage* pStorage, EmAsyncStorageBackend* pAsync, uint8_t index) {
+    char key[8];
+    snprintf(key, sizeof(key), "t%u", static_cast<unsigned int>(index));
+    for (int i=0; i < WRITES_COUNT; i++) {
+        int value = -1;
+        pStorage->putValue(key, i);
+        if (!pStorage->getValue(key, value) || value != i) {
+            failures++;
+        }
+        if (i % 100 == 0) {
+            uint32_t ticket = pAsync->getCommitTicket();
+            pAsync->wait(ticket);
+            if (!pAsync->isCommitted(ticket)) {
+                failures++;
+            }
+        }
+    }
+}
+
+static bool checkWriters() {
+    memset(memory, 0, sizeof(memory));
+    EmMemStorageBackend backend(memory, sizeof(memory));
+    EmAsyncStorageBackend async(backend, queueMemory, sizeof(queueMemory));
+    {
+        EmStorage storage(async);
+        storage.begin("check");
+        std::thread writers[WRITERS_COUNT];
+        for (uint8_t i=0; i < WRITERS_COUNT; i++) {
+            writers[i] = std::thread(writer, &storage, &async, i);
+        }
+        for (uint8_t i=0; i < WRITERS_COUNT; i++) {
+            writers[i].join();
+        }
+        storage.end();
+    }
+    EmStorage storage(backend);
+    storage.begin("check");
+    for (uint8_t i=0; i < WRITERS_COUNT; i++) {
+        char key[8];
+        snprintf(key, sizeof(key), "t%u", static_cast<unsigned int>(i));
+        int value = -1;
+        if (!storage.getValue(key, value) || value != WRITES_COUNT - 1) {
+            failures++;
+        }
+    }
+    storage.end();
+    printf("writers: %u x %u puts, %u backend commits, %u failures -> %s\n",
+           WRITERS_COUNT,
+           WRITES_COUNT,
+           static_cast<unsigned int>(async.getCommits()),
+           static_cast<unsigned int>(failures),
+           failures == 0 ? "OK" : "FAILED");
+    return failures == 0;
+}
+
+#else
+
+static bool checkWriters() {
+    printf("EM_MULTITHREAD is not defined: no concurrent writers\n");
+    return true;
+}
+
+#endif
+
+void setup() {
+    bool ok = checkBarriers();
+    ok = checkModel() && ok;
+    ok = checkWriters() && ok;
+    printf("%s\n", ok ? "OK" : "FAILED");
+}
+
+void loop() {
+}
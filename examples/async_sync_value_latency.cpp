@@ -0,0 +1,131 @@
+#include "em_async_value.h"
+
+// The simulated device operations latency
+#define DEVICE_LATENCY_MS 20
+// A device value changes every 'CHANGE_MS'
+#define CHANGE_MS 300
+#define RUN_MS 3000
+
+// A device whose reads and writes take 'DEVICE_LATENCY_MS' (e.g. a slow bus)
+class SlowDevice: public EmSyncItem<EmAsyncValue<int>, int> {
+public:
+    SlowDevice(EmSyncFlags flags)
+     : EmSyncItem<EmAsyncValue<int>, int>(flags),
+       m_value(0),
+       m_pendingValue(0),
+       m_startMs(0),
+       m_state(EmAsyncState::idle) {}
+
+    virtual bool startRead() override {
+        return start_();
+    }
+
+    virtual EmAsyncState pollRead() override {
+        return poll_();
+    }
+
+    virtual EmGetValueResult getReadValue(int& value) const override {
+        if (value == m_value) {
+            return EmGetValueResult::succeedEqualValue;
+        }
+        value = m_value;
+        return EmGetValueResult::succeedNotEqualValue;
+    }
+
+    virtual bool startWrite(const int& value) override {
+        m_pendingValue = value;
+        return start_();
+    }
+
+    virtual EmAsyncState pollWrite() override {
+        if (poll_() == EmAsyncState::succeeded) {
+            m_value = m_pendingValue;
+        }
+        return m_state;
+    }
+
+    // Changes the device value (i.e. outside of the synchronization)
+    void change(int value) {
+        m_value = value;
+    }
+
+    int value() const {
+        return m_value;
+    }
+
+private:
+    bool start_() {
+        m_startMs = millis();
+        m_state = EmAsyncState::pending;
+        return true;
+    }
+
+    EmAsyncState poll_() {
+        if (m_state == EmAsyncState::pending && millis() - m_startMs >= DEVICE_LATENCY_MS) {
+            m_state = EmAsyncState::succeeded;
+        }
+        return m_state;
+    }
+
+    int m_value;
+    int m_pendingValue;
+    uint32_t m_startMs;
+    EmAsyncState m_state;
+};
+
+// Runs the loop synchronizing four devices: the third one changes every
+// 'CHANGE_MS' and its value is propagated to the others.
+// The loop responsiveness (i.e. loops count and max loop time) and the
+// propagation time are printed.
+template <class SyncValue>
+void runLoop(const char* name) {
+    SlowDevice a(EmSyncFlags::canReadCanWrite);
+    SlowDevice b(EmSyncFlags::canReadCanWrite);
+    SlowDevice c(EmSyncFlags::canReadCanWrite);
+    SlowDevice d(EmSyncFlags::canWrite);
+    SlowDevice* items[] = { &a, &b, &c, &d };
+    SyncValue value(items);
+
+    uint32_t loops = 0;
+    uint32_t maxLoopUs = 0;
+    uint8_t changes = 0;
+    uint8_t propagated = 0;
+    uint32_t propagationMs = 0;
+    uint32_t changedMs = 0;
+    bool changing = false;
+    uint32_t startMs = millis();
+    while (millis() - startMs < RUN_MS) {
+        uint32_t loopUs = micros();
+        value.doSync();
+        loopUs = micros() - loopUs;
+        maxLoopUs = MAX(maxLoopUs, loopUs);
+        loops++;
+        if (!changing && millis() - startMs >= static_cast<uint32_t>(CHANGE_MS) * (changes + 1)) {
+            changes++;
+            c.change(1000 + changes);
+            changedMs = millis();
+            changing = true;
+        } else if (changing && d.value() == c.value()) {
+            propagated++;
+            propagationMs += millis() - changedMs;
+            changing = false;
+        }
+    }
+    printf("%-18s loops: %8u, max loop: %4u ms, changes propagated: %u/%u, avg propagation: %u ms\n",
+           name,
+           static_cast<unsigned int>(loops),
+           static_cast<unsigned int>(maxLoopUs / 1000),
+           propagated,
+           changes,
+           static_cast<unsigned int>(propagated != 0 ? propagationMs / propagated : 0));
+}
+
+void setup() {
+    // Blocking reads and writes: each loop waits for the devices
+    runLoop<EmSimpleSyncValue<SlowDevice, int, 4>>("EmSimpleSyncValue");
+    // Non blocking reads and writes: the loop is always responsive
+    runLoop<EmAsyncSyncValue<SlowDevice, int, 4>>("EmAsyncSyncValue");
+}
+
+void loop() {
+}
@@ -0,0 +1,122 @@
+#include "em_sync_value.h"
+
+// The readers hammering the value while it is synchronized
+#define READERS_COUNT 3
+#define RUN_MS 2000
+
+#ifdef EM_MULTITHREAD
+
+#include <thread>
+
+// A value bigger than a machine word (i.e. it can be torn)
+struct Snapshot {
+    uint32_t words[8];
+
+    bool operator==(const Snapshot& other) const {
+        return memcmp(words, other.words, sizeof(words)) == 0;
+    }
+
+    bool operator!=(const Snapshot& other) const {
+        return !(*this == other);
+    }
+
+    // Consistent snapshots have all the words equal
+    bool isConsistent() const {
+        for (uint8_t i=1; i < SIZE_OF(words); i++) {
+            if (words[i] != words[0]) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// The source item giving a new snapshot at each read
+class SnapshotSource: public EmSyncItem<EmValue<Snapshot>, Snapshot> {
+public:
+    SnapshotSource()
+     : EmSyncItem<EmValue<Snapshot>, Snapshot>(EmSyncFlags::canRead),
+       m_count(0) {}
+
+    virtual EmGetValueResult getValue(Snapshot& value) const override {
+        m_count++;
+        for (uint8_t i=0; i < SIZE_OF(value.words); i++) {
+            value.words[i] = m_count;
+        }
+        return EmGetValueResult::succeedNotEqualValue;
+    }
+
+    virtual bool setValue(const Snapshot& /*value*/) override {
+        return true;
+    }
+
+private:
+    mutable uint32_t m_count;
+};
+
+static SnapshotSource source;
+static SnapshotSource* items[] = { &source };
+static EmConcurrentSyncValue<SnapshotSource, Snapshot, 1> value(items);
+
+static std::atomic<bool> stop(false);
+static std::atomic<uint32_t> reads(0);
+static std::atomic<uint32_t> tornReads(0);
+static std::atomic<uint32_t> backwardReads(0);
+
+// Checks each snapshot is consistent and not older than the previous one
+static void reader() {
+    uint32_t count = 0;
+    uint32_t torn = 0;
+    uint32_t backward = 0;
+    uint32_t last = 0;
+    Snapshot snapshot;
+    while (!stop) {
+        value.getValue(snapshot);
+        count++;
+        if (!snapshot.isConsistent()) {
+            torn++;
+        } else if (snapshot.words[0] < last) {
+            backward++;
+        } else {
+            last = snapshot.words[0];
+        }
+    }
+    reads += count;
+    tornReads += torn;
+    backwardReads += backward;
+}
+
+void setup() {
+    std::thread readers[READERS_COUNT];
+    for (uint8_t i=0; i < READERS_COUNT; i++) {
+        readers[i] = std::thread(reader);
+    }
+    uint32_t syncs = 0;
+    uint32_t startMs = millis();
+    while (millis() - startMs < RUN_MS) {
+        value.doSync();
+        syncs++;
+    }
+    stop = true;
+    for (uint8_t i=0; i < READERS_COUNT; i++) {
+        readers[i].join();
+    }
+    printf("syncs: %u, published: %u, reads: %u, torn: %u, backward: %u -> %s\n",
+           static_cast<unsigned int>(syncs),
+           static_cast<unsigned int>(value.getPublishedCount()),
+           static_cast<unsigned int>(reads),
+           static_cast<unsigned int>(tornReads),
+           static_cast<unsigned int>(backwardReads),
+           tornReads == 0 && backwardReads == 0 ? "OK" : "FAILED");
+}
+
+#else
+
+void setup() {
+    printf("EM_MULTITHREAD is not defined: no concurrent readers\n");
+}
+
+#endif
+
+void loop() {
+}
@@ -0,0 +1,85 @@
+#include <Arduino.h>
+#include "em_flash_storage.h"
+
+// The flash storage write amplification and throughput: 'keys' keys of
+// 'valueLen' bytes randomly overwritten, compacted on demand or in the
+// background ('update' every 4 writes).
+//
+// The write amplification is the device written bytes per value byte
+// (i.e. records headers and compactions included).
+
+static uint8_t memory[4096*16];
+static uint32_t eraseCounts[16];
+static EmFlashStorageBackend::IndexEntry flashIndex[256];
+
+static void run(const char* name,
+                uint32_t sectorSize,
+                uint16_t sectorsCount,
+                uint16_t keys,
+                uint16_t valueLen,
+                uint32_t writes,
+                bool background) {
+    memset(eraseCounts, 0, sizeof(eraseCounts));
+    EmMemFlashDevice device(memory, sectorSize, sectorsCount, eraseCounts);
+    device.format();
+    EmFlashStorageBackend backend(device, flashIndex, 256);
+    backend.open("bench");
+    uint8_t value[256] = {0};
+    char key[8];
+    for (uint16_t k=0; k < keys; k++) {
+        snprintf(key, sizeof(key), "k%u", static_cast<unsigned int>(k));
+        backend.setBlob(key, value, valueLen);
+    }
+
+    uint32_t writtenBytes = device.getWrittenBytes();
+    uint32_t startUs = micros();
+    for (uint32_t i=0; i < writes; i++) {
+        snprintf(key, sizeof(key), "k%ld", random(keys));
+        value[0] = static_cast<uint8_t>(i);
+        value[1] = static_cast<uint8_t>(i >> 8);
+        if (backend.setBlob(key, value, valueLen) != EmStorageError::none) {
+            printf("%s: write failed\n", name);
+            return;
+        }
+        if (background && i % 4 == 0) {
+            backend.update();
+        }
+    }
+    uint32_t writeUs = micros() - startUs;
+    writtenBytes = device.getWrittenBytes() - writtenBytes;
+
+    startUs = micros();
+    for (uint32_t i=0; i < writes; i++) {
+        snprintf(key, sizeof(key), "k%ld", random(keys));
+        size_t len = valueLen;
+        backend.getBlob(key, value, len);
+    }
+    uint32_t readUs = micros() - startUs;
+
+    uint32_t minErases = 0xFFFFFFFF;
+    uint32_t maxErases = 0;
+    for (uint16_t s=0; s < sectorsCount; s++) {
+        minErases = eraseCounts[s] < minErases ? eraseCounts[s] : minErases;
+        maxErases = eraseCounts[s] > maxErases ? eraseCounts[s] : maxErases;
+    }
+    printf("%s: %u puts/s, %u gets/s, write amplification %.2f, %u compactions, sector erases min/max %u/%u\n",
+           name,
+           static_cast<unsigned int>(static_cast<uint64_t>(writes) * 1000000 / (writeUs != 0 ? writeUs : 1)),
+           static_cast<unsigned int>(static_cast<uint64_t>(writes) * 1000000 / (readUs != 0 ? readUs : 1)),
+           static_cast<double>(writtenBytes) / (static_cast<double>(writes) * valueLen),
+           static_cast<unsigned int>(backend.getCompactions()),
+           static_cast<unsigned int>(minErases),
+           static_cast<unsigned int>(maxErases));
+}
+
+void setup() {
+    run("4K x16, 32 keys x 16B", 4096, 16, 32, 16, 200000, false);
+    run("4K x16, 32 keys x 16B, background", 4096, 16, 32, 16, 200000, true);
+    run("4K x16, 128 keys x 64B", 4096, 16, 128, 64, 200000, false);
+    run("4K x16, 200 keys x 200B", 4096, 16, 200, 200, 200000, false);
+    run("4K x16, 200 keys x 200B, background", 4096, 16, 200, 200, 200000, true);
+    run("EEPROM 256 x4, 8 keys x 4B", 256, 4, 8, 4, 20000, false);
+}
+
+void loop() {
+}
@@ -0,0 +1,144 @@
+#include <Arduino.h>
+#include "em_flash_storage.h"
+
+// The flash storage power cut soak: random writes and removals are
+// interrupted by a power cut at a random written byte (i.e. the record or
+// the sector erase in progress is left partial), after the remount every
+// key must hold its last written value, the interrupted operation being
+// either lost or completed.
+
+#define SECTOR_SIZE 512
+#define SECTORS_COUNT 6
+#define POWER_CUTS 3000
+#define KEYS_COUNT 12
+#define MAX_VALUE_LEN 80
+
+static uint8_t memory[SECTOR_SIZE*SECTORS_COUNT];
+static uint32_t eraseCounts[SECTORS_COUNT];
+static EmFlashStorageBackend::IndexEntry flashIndex[64];
+
+// The expected values: 'len' bytes set to 'fill' ('len' 0 if removed)
+struct ModelValue {
+    uint8_t len;
+    char fill;
+};
+
+static ModelValue model[KEYS_COUNT];
+
+static void keyName(char* key, size_t size, uint8_t k) {
+    snprintf(key, size, "k%u", static_cast<unsigned int>(k));
+}
+
+static bool isValue(EmFlashStorageBackend& backend, uint8_t k, const ModelValue& value) {
+    char key[8];
+    keyName(key, sizeof(key), k);
+    char buf[MAX_VALUE_LEN];
+    size_t len = sizeof(buf);
+    EmStorageError error = backend.getBlob(key, buf, len);
+    if (value.len == 0) {
+        return error == EmStorageError::notFound;
+    }
+    if (error != EmStorageError::none || len != value.len) {
+        return false;
+    }
+    for (size_t i=0; i < len; i++) {
+        if (buf[i] != value.fill) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Checks all the keys, the 'pending' key can have either its old or its
+// new value
+static bool checkValues(EmFlashStorageBackend& backend,
+                        uint8_t pending,
+                        const ModelValue& newValue) {
+    for (uint8_t k=0; k < KEYS_COUNT; k++) {
+        if (isValue(backend, k, model[k])) {
+            continue;
+        }
+        if (k == pending && isValue(backend, k, newValue)) {
+            model[k] = newValue;
+            continue;
+        }
+        printf("key k%u: unexpected value\n", static_cast<unsigned int>(k));
+        return false;
+    }
+    return true;
+}
+
+void setup() {
+    EmMemFlashDevice device(memory, SECTOR_SIZE, SECTORS_COUNT, eraseCounts);
+    device.format();
+    uint32_t powerCuts = 0;
+    uint32_t operations = 0;
+    bool failed = false;
+    while (powerCuts < POWER_CUTS && !failed) {
+        EmFlashStorageBackend backend(device, flashIndex, 64);
+        if (backend.open("soak") != EmStorageError::none) {
+            printf("open failed after %u power cuts\n", static_cast<unsigned int>(powerCuts));
+            failed = true;
+            break;
+        }
+        device.cutPowerAfter(random(3000));
+        uint8_t k = 0;
+        ModelValue newValue = { 0, 0 };
+        while (true) {
+            k = static_cast<uint8_t>(random(KEYS_COUNT));
+            char key[8];
+            keyName(key, sizeof(key), k);
+            EmStorageError error;
+            if (random(8) == 0) {
+                newValue.len = 0;
+                error = backend.erase(key);
+            } else {
+                char value[MAX_VALUE_LEN];
+                newValue.len = static_cast<uint8_t>(1 + random(MAX_VALUE_LEN));
+                newValue.fill = static_cast<char>('a' + random(26));
+                memset(value, newValue.fill, newValue.len);
+                error = backend.setBlob(key, value, newValue.len);
+            }
+            if (random(4) == 0) {
+                backend.update();
+            }
+            if (device.isPowerOff()) {
+                break;
+            }
+            if (error != EmStorageError::none &&
+                (newValue.len != 0 || error != EmStorageError::notFound)) {
+                printf("operation failed: %s\n", storageErrorToStr(error));
+                failed = true;
+                break;
+            }
+            model[k] = newValue;
+            operations++;
+        }
+        if (failed) {
+            break;
+        }
+        powerCuts++;
+        device.powerOn();
+        EmFlashStorageBackend remounted(device, flashIndex, 64);
+        if (remounted.open("soak") != EmStorageError::none ||
+            !checkValues(remounted, k, newValue)) {
+            printf("inconsistent after %u power cuts\n", static_cast<unsigned int>(powerCuts));
+            failed = true;
+        }
+    }
+    uint32_t minErases = 0xFFFFFFFF;
+    uint32_t maxErases = 0;
+    for (uint16_t s=0; s < SECTORS_COUNT; s++) {
+        minErases = eraseCounts[s] < minErases ? eraseCounts[s] : minErases;
+        maxErases = eraseCounts[s] > maxErases ? eraseCounts[s] : maxErases;
+    }
+    printf("%u power cuts, %u operations, sector erases min/max %u/%u -> %s\n",
+           static_cast<unsigned int>(powerCuts),
+           static_cast<unsigned int>(operations),
+           static_cast<unsigned int>(minErases),
+           static_cast<unsigned int>(maxErases),
+           failed ? "FAILED" : "OK");
+}
+
+void loop() {
+}
@@ -0,0 +1,102 @@
+#include <Arduino.h>
+#include "em_serial.h"
+
+// The tagged serialization throughput: encoding and decoding a settings
+// struct of 8 fields compared to a JSON like text (snprintf/sscanf).
+
+#define ITERATIONS 200000UL
+
+struct Settings {
+    uint32_t id;
+    int32_t offset;
+    float setpoint;
+    float hysteresis;
+    uint16_t interval;
+    uint8_t mode;
+    uint8_t flags;
+    char name[12];
+};
+
+static const EmSerialField settingsFields[] = {
+    EM_SERIAL_FIELD(Settings, id, 1),
+    EM_SERIAL_FIELD(Settings, offset, 2),
+    EM_SERIAL_FIELD(Settings, setpoint, 3),
+    EM_SERIAL_FIELD(Settings, hysteresis, 4),
+    EM_SERIAL_FIELD(Settings, interval, 5),
+    EM_SERIAL_FIELD(Settings, mode, 6),
+    EM_SERIAL_FIELD(Settings, flags, 7),
+    EM_SERIAL_FIELD(Settings, name, 8)
+};
+
+static const EmSerialSchema settingsSchema = { 1, settingsFields, SIZE_OF(settingsFields), nullptr };
+
+#define SETTINGS_TEXT "{\"id\":%u,\"offset\":%d,\"setpoint\":%g,\"hyst\":%g,\"interval\":%u,\"mode\":%u,\"flags\":%u,\"name\":\"%s\"}"
+#define SETTINGS_SCAN "{\"id\":%u,\"offset\":%d,\"setpoint\":%g,\"hyst\":%g,\"interval\":%u,\"mode\":%u,\"flags\":%u,\"name\":\"%11[^\"]\"}"
+
+static uint32_t nsPerIteration(uint32_t startUs, uint32_t iterations) {
+    return static_cast<uint32_t>(static_cast<uint64_t>(micros() - startUs) * 1000 / iterations);
+}
+
+void setup() {
+    Settings settings = { 123456, -42, 21.5f, 0.5f, 300, 2, 5, "living" };
+    Settings decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    uint8_t encoded[emSerialMaxSize(sizeof(Settings))];
+    char text[256];
+    // NOTE: keeps the results (i.e. the loops are not optimized out)
+    volatile uint32_t sink = 0;
+
+    size_t encodedLen = 0;
+    uint32_t startUs = micros();
+    for (uint32_t i=0; i < ITERATIONS; i++) {
+        settings.id = i;
+        encodedLen = emSerialEncode(settingsSchema, &settings, encoded, sizeof(encoded));
+        sink += encodedLen;
+    }
+    uint32_t encodeNs = nsPerIteration(startUs, ITERATIONS);
+
+    startUs = micros();
+    for (uint32_t i=0; i < ITERATIONS; i++) {
+        sink += emSerialDecode(settingsSchema, encoded, encodedLen, &decoded);
+    }
+    uint32_t decodeNs = nsPerIteration(startUs, ITERATIONS);
+
+    int textLen = 0;
+    startUs = micros();
+    for (uint32_t i=0; i < ITERATIONS / 10; i++) {
+        settings.id = i;
+        textLen = snprintf(text, sizeof(text), SETTINGS_TEXT,
+                           static_cast<unsigned int>(settings.id),
+                           static_cast<int>(settings.offset),
+                           settings.setpoint,
+                           settings.hysteresis,
+                           settings.interval,
+                           settings.mode,
+                           settings.flags,
+                           settings.name);
+        sink += textLen;
+    }
+    uint32_t textEncodeNs = nsPerIteration(startUs, ITERATIONS / 10);
+
+    startUs = micros();
+    for (uint32_t i=0; i < ITERATIONS / 10; i++) {
+        unsigned int id, interval, mode, flags;
+        int offset;
+        sink += sscanf(text, SETTINGS_SCAN,
+                       &id, &offset, &decoded.setpoint, &decoded.hysteresis,
+                       &interval, &mode, &flags, decoded.name);
+    }
+    uint32_t textDecodeNs = nsPerIteration(startUs, ITERATIONS / 10);
+
+    printf("struct %u bytes: tagged %u bytes, encode %u ns, decode %u ns; text %d bytes, encode %u ns, decode %u ns\n",
+           static_cast<unsigned int>(sizeof(Settings)),
+           static_cast<unsigned int>(encodedLen),
+           static_cast<unsigned int>(encodeNs),
+           static_cast<unsigned int>(decodeNs),
+           textLen,
+           static_cast<unsigned int>(textEncodeNs),
+           static_cast<unsigned int>(textDecodeNs));
+}
+
+void loop() {
+}
@@ -0,0 +1,80 @@
+#include "em_storage.h"
+#include "em_storage_trace.h"
+#include "em_flash_storage.h"
+
+// The recorded trace
+static char trace[8192];
+static size_t traceLen = 0;
+
+static void writeLine(const char* line, void* /*pUserData*/) {
+    size_t len = strlen(line);
+    if (traceLen + len + 1 < sizeof(trace)) {
+        memcpy(trace + traceLen, line, len);
+        traceLen += len;
+        trace[traceLen++] = '\n';
+        trace[traceLen] = 0;
+    }
+}
+
+// Records a settings like workload: few keys written often, each write committed
+static void recordTrace() {
+    static uint8_t memory[4096];
+    EmMemStorageBackend backend(memory, sizeof(memory));
+    EmStorageTraceRecorder recorder(backend, writeLine);
+    EmStorage storage(recorder);
+    storage.begin("bench");
+    uint8_t value[32] = {0};
+    char key[8];
+    while (traceLen + 64 < sizeof(trace)) {
+        snprintf(key, sizeof(key), "k%ld", random(16));
+        if (random(4) == 0) {
+            storage.getBytes(key, value, sizeof(value));
+        } else {
+            storage.putBytes(key, value, 1 + random(sizeof(value)));
+        }
+    }
+    storage.end();
+}
+
+static void printResult(const char* name, const EmStorageTraceResult& result) {
+    const EmStorageLatency& put = result.opLatency(EmStorageOp::put);
+    const EmStorageLatency& commit = result.opLatency(EmStorageOp::commit);
+    printf("%s: %u ops/s, put p99 %u us, commit p99 %u us, write amplification %.2f\n",
+           name,
+           static_cast<unsigned int>(result.opsPerSecond()),
+           static_cast<unsigned int>(put.percentileMicros(99)),
+           static_cast<unsigned int>(commit.percentileMicros(99)),
+           result.writeAmplification());
+}
+
+void setup() {
+    recordTrace();
+    uint8_t buffer[64];
+    EmStorageTraceResult result;
+
+    // Memory backend
+    static uint8_t memory[4096];
+    EmMemStorageBackend memBackend(memory, sizeof(memory));
+    EmStorage memStorage(memBackend);
+    memStorage.begin("bench");
+    EmStorageTraceReplay memReplay(memStorage, buffer, sizeof(buffer));
+    memReplay.replay(trace, result);
+    printResult("memory", result);
+    memStorage.end();
+
+    // Log-structured backend on a memory flash device
+    static uint8_t flash[8 * 1024];
+    static EmFlashStorageBackend::IndexEntry index[32];
+    EmMemFlashDevice device(flash, 1024, 8);
+    device.format();
+    EmFlashStorageBackend flashBackend(device, index, SIZE_OF(index));
+    EmStorage flashStorage(flashBackend);
+    flashStorage.begin("bench");
+    EmStorageTraceReplay flashReplay(flashStorage, buffer, sizeof(buffer), &device);
+    flashReplay.replay(trace, result);
+    printResult("flash log", result);
+    flashStorage.end();
+}
+
+void loop() {
+}
@@ -0,0 +1,146 @@
+#include "em_storage.h"
+#include "em_storage_cache.h"
+
+// The transactions power cut check: a transaction updating several keys is
+// interrupted after 0..19 backend operations, the storage must then hold
+// either the old or the new values (i.e. never a mix of them).
+
+#define MAX_OPERATIONS 20
+
+static uint8_t memory[4096];
+
+// The memory backend losing power after 'budget' operations (i.e. writes,
+// removals and commits fail from then on)
+class PowerCutBackend: public EmMemStorageBackend {
+public:
+    PowerCutBackend(uint32_t budget = 0xFFFFFFFF)
+     : EmMemStorageBackend(memory, sizeof(memory)),
+       m_budget(budget) {}
+
+    virtual EmStorageError setBlob(const char* key, const void* value, size_t len) override {
+        return spend_() ? EmMemStorageBackend::setBlob(key, value, len) : EmStorageError::failed;
+    }
+
+    virtual EmStorageError setString(const char* key, const char* value) override {
+        return spend_() ? EmMemStorageBackend::setString(key, value) : EmStorageError::failed;
+    }
+
+    virtual EmStorageError erase(const char* key) override {
+        return spend_() ? EmMemStorageBackend::erase(key) : EmStorageError::failed;
+    }
+
+    virtual EmStorageError commit() override {
+        return spend_() ? EmMemStorageBackend::commit() : EmStorageError::failed;
+    }
+
+private:
+    bool spend_() {
+        if (m_budget == 0) {
+            return false;
+        }
+        m_budget--;
+        return true;
+    }
+
+    uint32_t m_budget;
+};
+
+// Writes the old values
+static void writeOldValues() {
+    PowerCutBackend backend;
+    EmStorage storage(backend);
+    storage.begin("net");
+    storage.clear();
+    storage.putValue("ip", 1u);
+    storage.putValue("mask", 2u);
+    storage.putValue("gw", 3u);
+    storage.putString("host", "old");
+    storage.putValue("tmp", 5u);
+    storage.end();
+}
+
+// Updates all the values within a transaction, the power is cut after
+// 'budget' backend operations (i.e. the write-back cache content is lost)
+static void writeNewValues(uint32_t budget, bool writeBack) {
+    static uint8_t cacheMemory[1024];
+    static uint8_t txBuffer[256];
+    PowerCutBackend backend(budget);
+    // NOTE: flushed at cache full only (i.e. commits do not flush)
+    EmWriteBackStorageBackend cache(backend, cacheMemory, sizeof(cacheMemory), 0);
+    EmStorage storage(writeBack ? static_cast<EmStorageBackend&>(cache) : backend);
+    storage.setTxBuffer(txBuffer, sizeof(txBuffer));
+    storage.begin("net");
+    storage.beginTx();
+    storage.putValue("ip", 11u);
+    storage.putValue("mask", 12u);
+    storage.putValue("gw", 13u);
+    storage.putString("host", "new");
+    storage.remove("tmp");
+    storage.commitTx();
+}
+
+// Returns 0 if the old values are stored, 1 if the new ones are stored
+// and -1 for a mix of them (i.e. after the interrupted transaction is
+// completed by 'begin')
+static int8_t checkValues() {
+    static uint8_t txBuffer[256];
+    PowerCutBackend backend;
+    EmStorage storage(backend);
+    storage.setTxBuffer(txBuffer, sizeof(txBuffer));
+    storage.begin("net");
+    uint32_t ip = 0;
+    uint32_t mask = 0;
+    uint32_t gw = 0;
+    uint32_t tmp = 0;
+    char host[8] = {0};
+    storage.getValue("ip", ip);
+    storage.getValue("mask", mask);
+    storage.getValue("gw", gw);
+    storage.getString("host", host, sizeof(host));
+    bool hasTmp = storage.getValue("tmp", tmp);
+    storage.end();
+    if (ip == 1 && mask == 2 && gw == 3 && strcmp(host, "old") == 0 && hasTmp) {
+        return 0;
+    }
+    if (ip == 11 && mask == 12 && gw == 13 && strcmp(host, "new") == 0 && !hasTmp) {
+        return 1;
+    }
+    return -1;
+}
+
+static void runPowerCuts(const char* name, bool writeBack) {
+    uint8_t oldValues = 0;
+    uint8_t newValues = 0;
+    uint8_t mixed = 0;
+    for (uint32_t budget=0; budget < MAX_OPERATIONS; budget++) {
+        writeOldValues();
+        writeNewValues(budget, writeBack);
+        switch (checkValues()) {
+            case 0:
+                oldValues++;
+                break;
+            case 1:
+                newValues++;
+                break;
+            default:
+                printf("%s: mixed values after %u operations\n", name, static_cast<unsigned int>(budget));
+                mixed++;
+                break;
+        }
+    }
+    printf("%s: %u power cuts, old values %u, new values %u, mixed %u -> %s\n",
+           name,
+           MAX_OPERATIONS,
+           oldValues,
+           newValues,
+           mixed,
+           mixed == 0 ? "OK" : "FAILED");
+}
+
+void setup() {
+    runPowerCuts("memory", false);
+    runPowerCuts("write-back cache", true);
+}
+
+void loop() {
+}
@@ -0,0 +1,146 @@
+#include "em_sync_group.h"
+
+// 1,000 values, 1% of them changing between two synchronization passes
+#define VALUES_COUNT 1000
+#define CHANGES_PER_PASS (VALUES_COUNT/100)
+#define PASSES 2000
+
+static uint32_t reads = 0;
+static uint32_t writes = 0;
+static uint32_t commits = 0;
+static bool inBatch = false;
+
+class CounterItem: public EmSyncItem<EmValue<int>, int> {
+public:
+    CounterItem(EmSyncFlags flags)
+     : EmSyncItem<EmValue<int>, int>(flags),
+       m_value(0) {}
+
+    virtual EmGetValueResult getValue(int& value) const override {
+        reads++;
+        if (value == m_value) {
+            return EmGetValueResult::succeedEqualValue;
+        }
+        value = m_value;
+        return EmGetValueResult::succeedNotEqualValue;
+    }
+
+    virtual bool setValue(const int& value) override {
+        writes++;
+        if (!inBatch) {
+            // Not batched: each write commits
+            commits++;
+        }
+        m_value = value;
+        return true;
+    }
+
+    void change() {
+        m_value++;
+    }
+
+private:
+    int m_value;
+};
+
+class CountingBatch: public EmSyncBatch {
+public:
+    virtual void beginBatch() override {
+        inBatch = true;
+    }
+
+    virtual void endBatch() override {
+        inBatch = false;
+        commits++;
+    }
+};
+
+// The synchronized value of a source and a target item
+class Counter {
+public:
+    Counter()
+     : source(sourceFlags),
+       target(EmSyncFlags::canWrite),
+       items{ &source, &target },
+       value(items) {}
+
+    static EmSyncFlags sourceFlags;
+
+    CounterItem source;
+    CounterItem target;
+    CounterItem* items[2];
+    EmSimpleSyncValue<CounterItem, int, 2> value;
+};
+
+EmSyncFlags Counter::sourceFlags = EmSyncFlags::canReadCanWrite;
+
+static Counter* counters = nullptr;
+static EmSyncValueBase* values[VALUES_COUNT];
+
+// Runs the passes changing 1% of the sources, values are updated by the
+// group if any (i.e. one by one otherwise). Returns the elapsed micros.
+static uint32_t runPasses(bool notify, EmUpdatable* pGroup) {
+    // First pass reads all the values
+    uint32_t startUs = 0;
+    for (uint16_t pass=0; pass <= PASSES; pass++) {
+        if (pass == 1) {
+            reads = writes = commits = 0;
+            startUs = micros();
+        }
+        for (uint16_t c=0; pass != 0 && c < CHANGES_PER_PASS; c++) {
+            CounterItem& source = counters[random(VALUES_COUNT)].source;
+            source.change();
+            if (notify) {
+                source.notifyChanged();
+            }
+        }
+        if (pGroup != nullptr) {
+            pGroup->update();
+        } else {
+            for (uint16_t i=0; i < VALUES_COUNT; i++) {
+                counters[i].value.update();
+            }
+        }
+    }
+    return micros() - startUs;
+}
+
+// Synchronizes the values each pass:
+//  mode 0: values updated one by one, polled items
+//  mode 1: values updated one by one, notifying items
+//  mode 2: values updated by a group (i.e. dirty values only) within a batch
+static void runBenchmark(uint8_t mode) {
+    static const char* names[] = { "values, polled items",
+                                   "values, notifying items",
+                                   "group and batch" };
+    Counter::sourceFlags = mode == 0 ? EmSyncFlags::canReadCanWrite :
+                                       EmSyncFlags::canReadCanWrite | EmSyncFlags::canNotify;
+    counters = new Counter[VALUES_COUNT];
+    for (uint16_t i=0; i < VALUES_COUNT; i++) {
+        values[i] = &counters[i].value;
+    }
+    uint32_t elapsedUs;
+    if (mode == 2) {
+        CountingBatch batch;
+        EmSyncGroup<VALUES_COUNT> group(values, &batch);
+        elapsedUs = runPasses(true, &group);
+    } else {
+        elapsedUs = runPasses(mode != 0, nullptr);
+    }
+    printf("%-24s %7u ns/pass, reads/pass %6.1f, writes/pass %5.1f, commits/pass %5.1f\n",
+           names[mode],
+           static_cast<unsigned int>(static_cast<uint64_t>(elapsedUs) * 1000 / PASSES),
+           static_cast<float>(reads) / PASSES,
+           static_cast<float>(writes) / PASSES,
+           static_cast<float>(commits) / PASSES);
+    delete[] counters;
+}
+
+void setup() {
+    for (uint8_t mode=0; mode < 3; mode++) {
+        runBenchmark(mode);
+    }
+}
+
+void loop() {
+}
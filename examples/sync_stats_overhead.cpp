@@ -0,0 +1,75 @@
+#include "em_sync_value.h"
+
+// The 'EM_SYNC_STATS' overhead: build and run this sketch with and without
+// 'EM_SYNC_STATS' defined and compare the synchronization pass times.
+
+#define PASSES 2000000UL
+// A value change every 'CHANGE_PASSES' passes
+#define CHANGE_PASSES 1024
+
+class IntItem: public EmSyncItem<EmValue<int>, int> {
+public:
+    IntItem()
+     : EmSyncItem<EmValue<int>, int>(EmSyncFlags::canReadCanWrite),
+       m_value(0) {}
+
+    virtual EmGetValueResult getValue(int& value) const override {
+        if (value == m_value) {
+            return EmGetValueResult::succeedEqualValue;
+        }
+        value = m_value;
+        return EmGetValueResult::succeedNotEqualValue;
+    }
+
+    virtual bool setValue(const int& value) override {
+        m_value = value;
+        return true;
+    }
+
+    void change(int value) {
+        m_value = value;
+    }
+
+private:
+    int m_value;
+};
+
+void setup() {
+    IntItem a, b, c, d;
+    IntItem* items[] = { &a, &b, &c, &d };
+    EmSimpleSyncValue<IntItem, int, 4> value(items);
+
+    uint32_t startUs = micros();
+    for (uint32_t pass=0; pass < PASSES; pass++) {
+        if (pass % CHANGE_PASSES == 0) {
+            b.change(static_cast<int>(pass));
+        }
+        value.doSync();
+    }
+    uint32_t elapsedUs = micros() - startUs;
+#ifdef EM_SYNC_STATS
+    const char* stats = "on";
+#else
+    const char* stats = "off";
+#endif
+    printf("stats %s: %u ns/pass (4 items, a change every %u passes)\n",
+           stats,
+           static_cast<unsigned int>(static_cast<uint64_t>(elapsedUs) * 1000 / PASSES),
+           CHANGE_PASSES);
+
+#ifdef EM_SYNC_STATS
+    EmSyncItemStats itemStats = b.getStats();
+    EmSyncValueStats valueStats = value.getStats();
+    printf("item: %u reads, %u writes, read avg %u ns, read max %u us\n",
+           static_cast<unsigned int>(itemStats.reads),
+           static_cast<unsigned int>(itemStats.writes),
+           static_cast<unsigned int>(itemStats.reads != 0 ? itemStats.readMicros * 1000 / itemStats.reads : 0),
+           static_cast<unsigned int>(itemStats.readMaxMicros));
+    printf("value: %u syncs, %u changes\n",
+           static_cast<unsigned int>(valueStats.syncs),
+           static_cast<unsigned int>(valueStats.changes));
+#endif
+}
+
+void loop() {
+}
@@ -154,4 +154,29 @@ public:
 };
 
 
+#ifdef EM_LOG_METRICS
+
+// This interface logs the log metrics summary each time 'period' elapses.
+class EmAppLogMetricsInterface: public EmAppTimeoutInterface {
+public:
+    EmAppLogMetricsInterface(EmDuration period, 
+                             EmLogLevel summaryLevel=EmLogLevel::info) 
+     : EmAppTimeoutInterface(period, false), 
+       m_summaryLevel(summaryLevel) {}
+
+    virtual const char* name() const override {
+        return "EmLogMetrics";
+    }
+
+    virtual EmIntOperationResult loop() override {
+        EmLog::logMetrics(m_summaryLevel);
+        return EmIntOperationResult::canContinue;    
+    }
+
+private:
+    EmLogLevel m_summaryLevel;
+};
+
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,294 @@
+#ifndef __EM_ASYNC_VALUE__H_
+#define __EM_ASYNC_VALUE__H_
+
+#include <Arduino.h>
+
+#include "em_defs.h"
+#include "em_sync_value.h"
+
+// The asynchronous operations state
+enum class EmAsyncState: uint8_t {
+    idle = 0,
+    pending,
+    succeeded,
+    failed
+};
+
+// The asynchronous value interface (e.g. a value on a slow bus device).
+//
+// Reads and writes are started and then polled until they complete, a single
+// operation at a time is expected. The blocking 'getValue' and 'setValue' are
+// implemented on top of the asynchronous methods so that the value can be
+// used by any synchronized value (but 'EmAsyncSyncValue' does not block).
+//
+// IMPLEMENTATION NOTES:
+// ---------------------
+//   'getReadValue' is called after a succeeded read and it should behave
+//   as 'EmValue::getValue' does (i.e. compare and set the provided value)
+//
+template <class T>
+class EmAsyncValue: public EmValue<T> {
+public:
+    virtual ~EmAsyncValue() = default;
+
+    // Starts reading the value (returns false if read cannot be started)
+    virtual bool startRead() = 0;
+    virtual EmAsyncState pollRead() = 0;
+    virtual EmGetValueResult getReadValue(T& value) const = 0;
+
+    // Starts writing the value (returns false if write cannot be started)
+    virtual bool startWrite(const T& value) = 0;
+    virtual EmAsyncState pollWrite() = 0;
+
+    // Blocking read
+    virtual EmGetValueResult getValue(T& value) const override {
+        // NOTE: reading changes the operation state only
+        EmAsyncValue<T>* pThis = const_cast<EmAsyncValue<T>*>(this);
+        if (!pThis->startRead() || EmAsyncState::succeeded != wait_(&EmAsyncValue<T>::pollRead)) {
+            return EmGetValueResult::failed;
+        }
+        return getReadValue(value);
+    }
+
+    // Blocking write
+    virtual bool setValue(const T& value) override {
+        return startWrite(value) && EmAsyncState::succeeded == wait_(&EmAsyncValue<T>::pollWrite);
+    }
+
+protected:
+    EmAsyncState wait_(EmAsyncState (EmAsyncValue<T>::*poll)()) const {
+        EmAsyncValue<T>* pThis = const_cast<EmAsyncValue<T>*>(this);
+        EmAsyncState state;
+        while (EmAsyncState::pending == (state = (pThis->*poll)())) {
+            yield();
+        }
+        return state;
+    }
+};
+
+// The simple priority based synchronized value of asynchronous items.
+//
+// 'doSync' never waits for the items: reads of all the items to be read are
+// started together, then next calls poll them and, once all reads completed,
+// the new value (if any) is written to all the other items the same way.
+// A synchronization is then completed within several 'doSync' calls
+// (see 'isBusy'), the value keeps asking its group for the following passes.
+//
+// NOTE: items operations latency (see 'EM_SYNC_STATS') is measured from the 
+//       operation start to the 'doSync' call that finds it completed
+template <class EmSyncItemOfT, class T, uint8_t size>
+class EmAsyncSyncValue: public EmSimpleSyncValue<EmSyncItemOfT, T, size> {
+public:
+    EmAsyncSyncValue(EmSyncItemOfT* items[])
+     : EmSimpleSyncValue<EmSyncItemOfT, T, size>(items),
+       m_phase(Phase::idle),
+       m_res(true) {
+        for(uint8_t i=0; i < size; i++) {
+            m_ops[i] = Op::none;
+        }
+    }
+
+    // Moves the synchronization forward, returns the last completed
+    // synchronization result.
+    bool doSync() override {
+        switch (m_phase) {
+            case Phase::idle:
+                // Nothing changed since last synchronization and no write to retry?
+                if (!this->takeDirty_() && !this->takeRetryDue_() && !this->m_polled) {
+                    return m_res;
+                }
+                _startReads();
+                break;
+            case Phase::reading:
+                if (_pollOps()) {
+                    _readsDone();
+                }
+                break;
+            case Phase::writing:
+                if (_pollOps()) {
+                    m_phase = Phase::idle;
+                    this->_scheduleRetries();
+                }
+                break;
+        }
+        // Still running or notified while running?
+        if (isBusy() || this->m_dirty) {
+            this->pokeGroup_();
+        }
+        return m_res;
+    }
+
+    // Returns true while a synchronization is in progress
+    bool isBusy() const {
+        return m_phase != Phase::idle;
+    }
+
+protected:
+    enum class Phase: uint8_t {
+        idle = 0,
+        reading,
+        writing
+    };
+
+    enum class Op: uint8_t {
+        none = 0,
+        reading,
+        read,
+        readFailed,
+        writing
+    };
+
+    void _startReads() {
+        m_res = true;
+        this->m_waitingRetry = false;
+        this->countSync_();
+        for(uint8_t i=0; i < size; i++) {
+            if (CheckNewValueResult::valueChanged != this->m_items[i]->_checkRead()) {
+                continue;
+            }
+            opStarted_(i);
+            if (this->m_items[i]->startRead()) {
+                m_ops[i] = Op::reading;
+                m_phase = Phase::reading;
+            } else {
+                m_ops[i] = Op::readFailed;
+            }
+        }
+        // Nothing to wait for?
+        if (Phase::idle == m_phase) {
+            _readsDone();
+        }
+    }
+
+    // Polls the running operations, returns true if all completed
+    bool _pollOps() {
+        bool completed = true;
+        for(uint8_t i=0; i < size; i++) {
+            EmAsyncState state;
+            switch (m_ops[i]) {
+                case Op::reading:
+                    state = this->m_items[i]->pollRead();
+                    if (EmAsyncState::pending == state) {
+                        completed = false;
+                    } else {
+                        m_ops[i] = EmAsyncState::succeeded == state ? Op::read : Op::readFailed;
+                    }
+                    break;
+                case Op::writing:
+                    state = this->m_items[i]->pollWrite();
+                    if (EmAsyncState::pending == state) {
+                        completed = false;
+                    } else {
+                        m_ops[i] = Op::none;
+                        if (EmAsyncState::succeeded != state) {
+                            m_res = false;
+                        }
+                        this->m_items[i]->_writeDone(
+                            this->m_items[i]->_countWrite(EmAsyncState::succeeded == state, opStartUs_(i)),
+                            this->m_currentValue);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        return completed;
+    }
+
+    // Checks the read values by priority (i.e. the first changed one wins)
+    void _readsDone() {
+        int16_t changed = -1;
+        for(uint8_t i=0; i < size; i++) {
+            Op op = m_ops[i];
+            m_ops[i] = Op::none;
+            if (changed >= 0 || (Op::read != op && Op::readFailed != op)) {
+                continue;
+            }
+            EmSyncItemOfT* pItem = this->m_items[i];
+            CheckNewValueResult res = Op::read == op ?
+                pItem->_read(this->m_currentValue, [pItem](T& value) {
+                    return pItem->getReadValue(value);
+                }, opStartUs_(i)) :
+                pItem->_readDone(pItem->_countRead(EmGetValueResult::failed, opStartUs_(i)));
+            switch (res) {
+                case CheckNewValueResult::valueChanged:
+                    changed = i;
+                    break;
+                case CheckNewValueResult::mustReadFailed:
+                    // A "must read" value failed to read, cannot proceed with synch!
+                    // (lets retry on next synchronization)
+                    m_res = false;
+                    this->mustReadFailed_();
+                    _clearOps(i + 1);
+                    m_phase = Phase::idle;
+                    return;
+                default:
+                    break;
+            }
+        }
+        if (changed >= 0) {
+            this->m_version++;
+            this->onValueChanged();
+        }
+        _startWrites(changed);
+    }
+
+    // Writes the new value to all other items (or the pending writes only
+    // if value did not change)
+    void _startWrites(int16_t changed) {
+        m_phase = Phase::idle;
+        for(uint8_t i=0; i < size; i++) {
+            EmSyncItemOfT* pItem = this->m_items[i];
+            if (i == changed || !pItem->_canWrite()) {
+                continue;
+            }
+            if (changed < 0 && !pItem->isPendingWrite()) {
+                continue;
+            }
+            opStarted_(i);
+            if (pItem->startWrite(this->m_currentValue)) {
+                m_ops[i] = Op::writing;
+                m_phase = Phase::writing;
+            } else {
+                m_res = false;
+                pItem->_writeDone(pItem->_countWrite(false, opStartUs_(i)), this->m_currentValue);
+            }
+        }
+        if (Phase::idle == m_phase) {
+            this->_scheduleRetries();
+        }
+    }
+
+    void _clearOps(uint8_t from) {
+        for(uint8_t i=from; i < size; i++) {
+            m_ops[i] = Op::none;
+        }
+    }
+
+    // Keeps the item operation start time (see 'EM_SYNC_STATS')
+    void opStarted_(uint8_t i) {
+#ifdef EM_SYNC_STATS
+        m_opStartUs[i] = micros();
+#else
+        (void)i;
+#endif
+    }
+
+    uint32_t opStartUs_(uint8_t i) const {
+#ifdef EM_SYNC_STATS
+        return m_opStartUs[i];
+#else
+        (void)i;
+        return 0;
+#endif
+    }
+
+    Phase m_phase;
+    Op m_ops[size];
+    bool m_res; // Last completed synchronization result
+#ifdef EM_SYNC_STATS
+    uint32_t m_opStartUs[size];
+#endif
+};
+
+#endif // __EM_ASYNC_VALUE__H_
@@ -53,6 +53,39 @@ inline int32_t iDiv(real_type num1, real_type num2) {
     return static_cast<int32_t>(num1 / num2);
 }
 
+// Returns the FNV-1a 32 bit hash of a null terminated string.
+// NOTE: being 'constexpr' it can be evaluated at compile time
+constexpr uint32_t emHash32(const char* str, uint32_t hash = 2166136261u) {
+    return *str == 0 ? hash :
+           emHash32(str+1, (hash ^ static_cast<uint8_t>(*str)) * 16777619u);
+}
+
+// Returns the FNV-1a 32 bit hash of the first 'len' chars of a string.
+inline uint32_t emHash32n(const char* str, size_t len, uint32_t hash = 2166136261u) {
+    for (size_t i=0; i < len && str[i] != 0; i++) {
+        hash = (hash ^ static_cast<uint8_t>(str[i])) * 16777619u;
+    }
+    return hash;
+}
+
+// Returns the CRC-32 (IEEE 802.3) of 'len' bytes.
+// Data can be split in chunks by passing the previous chunk CRC as 'crc'.
+inline uint32_t emCrc32(const void* data, size_t len, uint32_t crc = 0) {
+    // Half byte table (i.e. small footprint)
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 
+        0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C, 
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C };
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for (size_t i=0; i < len; i++) {
+        crc = table[(crc ^ p[i]) & 0x0F] ^ (crc >> 4);
+        crc = table[(crc ^ (p[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
 // The abstract 'updatable' object class
 class EmUpdatable {
 public:
@@ -0,0 +1,165 @@
+#ifndef __EM_FLASH_DEVICE__H_
+#define __EM_FLASH_DEVICE__H_
+
+#include <string.h>
+
+#include "em_defs.h"
+
+// The flash memory device interface (see 'EmFlashStorageBackend').
+//
+// The device is split in sectors: erasing a sector sets all its bytes to
+// 0xFF and writing can only clear bits (i.e. NOR flash semantics).
+class EmFlashDevice {
+public:
+    virtual ~EmFlashDevice() = default;
+
+    virtual uint32_t sectorSize() const = 0;
+    virtual uint16_t sectorsCount() const = 0;
+
+    virtual bool read(uint32_t address, void* buf, size_t len) = 0;
+    virtual bool write(uint32_t address, const void* buf, size_t len) = 0;
+    virtual bool eraseSector(uint16_t sector) = 0;
+
+    // Makes the written data persistent (e.g. a file device)
+    virtual bool sync() {
+        return true;
+    }
+};
+
+// The flash device emulated on a memory area (e.g. tests and benchmarks).
+//
+// Power cuts can be injected (see 'cutPowerAfter'): the write or erase in
+// progress is left partial and the device fails until 'powerOn' is called.
+class EmMemFlashDevice: public EmFlashDevice {
+public:
+    // NOTE: 'eraseCounts' (optional) must have 'sectorsCount' items
+    EmMemFlashDevice(void* memory,
+                     uint32_t sectorSize,
+                     uint16_t sectorsCount,
+                     uint32_t* eraseCounts = nullptr)
+     : m_pMemory(static_cast<uint8_t*>(memory)),
+       m_sectorSize(sectorSize),
+       m_sectorsCount(sectorsCount),
+       m_pEraseCounts(eraseCounts),
+       m_cutPower(false),
+       m_powerBytes(0),
+       m_powerOff(false),
+       m_writtenBytes(0) {}
+
+    virtual ~EmMemFlashDevice() = default;
+
+    virtual uint32_t sectorSize() const override {
+        return m_sectorSize;
+    }
+
+    virtual uint16_t sectorsCount() const override {
+        return m_pMemory != nullptr ? m_sectorsCount : 0;
+    }
+
+    virtual bool read(uint32_t address, void* buf, size_t len) override;
+    virtual bool write(uint32_t address, const void* buf, size_t len) override;
+    virtual bool eraseSector(uint16_t sector) override;
+
+    // Erases all the sectors
+    void format();
+
+    // Cuts the power once 'bytes' more bytes are written or erased
+    void cutPowerAfter(uint32_t bytes) {
+        m_cutPower = true;
+        m_powerBytes = bytes;
+    }
+
+    void powerOn() {
+        m_cutPower = false;
+        m_powerOff = false;
+    }
+
+    bool isPowerOff() const {
+        return m_powerOff;
+    }
+
+    // The written bytes (i.e. erases excluded)
+    uint32_t getWrittenBytes() const {
+        return m_writtenBytes;
+    }
+
+protected:
+    // Returns the bytes that can be written before the power cut
+    size_t powerBytes_(size_t len);
+
+    uint8_t* m_pMemory;
+    uint32_t m_sectorSize;
+    uint16_t m_sectorsCount;
+    uint32_t* m_pEraseCounts;
+    bool m_cutPower;
+    uint32_t m_powerBytes;
+    bool m_powerOff;
+    uint32_t m_writtenBytes;
+};
+
+#ifdef __linux__
+
+// The flash device on a memory mapped file (i.e. a flash image)
+class EmFileFlashDevice: public EmMemFlashDevice {
+public:
+    EmFileFlashDevice(const char* path,
+                      uint32_t sectorSize,
+                      uint16_t sectorsCount,
+                      uint32_t* eraseCounts = nullptr)
+     : EmMemFlashDevice(nullptr, sectorSize, sectorsCount, eraseCounts),
+       m_path(path) {}
+
+    virtual ~EmFileFlashDevice() {
+        end();
+    }
+
+    // Maps the file (a new file is an erased flash)
+    bool begin();
+
+    // Unmaps the file
+    void end();
+
+    // Flushes the mapped memory to the file
+    virtual bool sync() override;
+
+protected:
+    const char* m_path;
+};
+
+#endif // __linux__
+
+#ifdef EM_EEPROM
+
+// The flash device on the AVR EEPROM (i.e. 'sectorsCount' sectors starting
+// at 'address').
+// NOTE: EEPROM bytes are written one by one, erasing writes 0xFF bytes
+class EmEepromFlashDevice: public EmFlashDevice {
+public:
+    EmEepromFlashDevice(uint16_t address, uint16_t sectorSize, uint16_t sectorsCount)
+     : m_address(address),
+       m_sectorSize(sectorSize),
+       m_sectorsCount(sectorsCount) {}
+
+    virtual ~EmEepromFlashDevice() = default;
+
+    virtual uint32_t sectorSize() const override {
+        return m_sectorSize;
+    }
+
+    virtual uint16_t sectorsCount() const override {
+        return m_sectorsCount;
+    }
+
+    virtual bool read(uint32_t address, void* buf, size_t len) override;
+    virtual bool write(uint32_t address, const void* buf, size_t len) override;
+    virtual bool eraseSector(uint16_t sector) override;
+
+protected:
+    uint16_t m_address;
+    uint16_t m_sectorSize;
+    uint16_t m_sectorsCount;
+};
+
+#endif // EM_EEPROM
+
+#endif // __EM_FLASH_DEVICE__H_
@@ -0,0 +1,201 @@
+#ifndef __EM_FLASH_STORAGE__H_
+#define __EM_FLASH_STORAGE__H_
+
+#include "em_defs.h"
+#include "em_flash_device.h"
+#include "em_storage_backend.h"
+
+// The log-structured storage backend on a flash device (e.g. raw flash,
+// the AVR EEPROM or a flash image on the host).
+//
+// Writes append CRC'd records to the log, the latest record of a key wins
+// and erasing a key appends a tombstone. The RAM index maps keys to their
+// latest record and it is rebuilt by scanning the device at first 'open'.
+//
+// Sectors are used round robin (i.e. wear leveling): once the head sector
+// is full the log moves to the next one and the oldest sector is compacted
+// by copying its live records to the head and erasing it. One sector is
+// always kept free for compaction.
+//
+// Records are never overwritten: a power cut leaves a partial record (i.e.
+// CRC mismatch) that is skipped, a key keeps its previous value. Sector
+// headers are checked as well (i.e. interrupted erases).
+//
+// IMPLEMENTATION NOTES:
+// ---------------------
+//   The device must have at least 3 sectors, a record (i.e. 12 bytes header,
+//   namespace, key and value 4 bytes aligned) must fit a sector. Live records
+//   can take all sectors but two (see 'freeEntries').
+//
+//   The index holds all the keys of the device (i.e. all namespaces) and
+//   one namespace at a time can be open.
+//
+//   'update' compacts one sector when there are less than 'compactFreeSectors'
+//   free sectors and at least one sector of garbage (i.e. background
+//   compaction), otherwise writes compact when the reserved sector is reached.
+//
+class EmFlashStorageBackend: public EmStorageBackend, public EmUpdatable {
+public:
+    // The index entry (i.e. the key hash and its latest record address)
+    struct IndexEntry {
+        uint32_t hash;
+        uint32_t address;
+    };
+
+    // NOTE: the device and index objects are not copied
+    EmFlashStorageBackend(EmFlashDevice& device,
+                          IndexEntry* index,
+                          uint16_t indexSize,
+                          uint16_t compactFreeSectors = 2)
+     : m_device(device),
+       m_pIndex(index),
+       m_indexSize(indexSize),
+       m_indexCount(0),
+       m_compactFreeSectors(compactFreeSectors),
+       m_mounted(false),
+       m_open(false),
+       m_head(0),
+       m_oldest(0),
+       m_usedSectors(0),
+       m_headOffset(0),
+       m_nextSeq(0),
+       m_liveBytes(0),
+       m_compactions(0) {
+        m_namespace[0] = 0;
+    }
+
+    virtual ~EmFlashStorageBackend() = default;
+
+    // Opens the 'name' namespace (the device is mounted first time)
+    virtual EmStorageError open(const char* name) override;
+    virtual void close() override;
+
+    virtual bool isOpen() const override {
+        return m_open;
+    }
+
+    virtual EmStorageError setBlob(const char* key, const void* value, size_t len) override;
+    virtual EmStorageError setString(const char* key, const char* value) override;
+    virtual EmStorageError getBlob(const char* key, void* buf, size_t& len) override;
+    virtual EmStorageError getString(const char* key, char* buf, size_t& len) override;
+    virtual EmStorageError getChunks(const char* key,
+                                     bool isString,
+                                     void* buf,
+                                     size_t bufSize,
+                                     EmStorageChunkVisitor visitor,
+                                     void* pUserData = nullptr) override;
+    virtual EmStorageError erase(const char* key) override;
+    virtual EmStorageError eraseAll() override;
+    virtual EmStorageError commit() override;
+    virtual EmStorageError freeEntries(size_t& entries) const override;
+
+    // Visits the namespace keys (i.e. values are not provided)
+    virtual uint32_t forEach(EmStorageVisitor visitor, void* pUserData = nullptr) override;
+
+    // Background compaction
+    virtual void update() override;
+
+    // The number of compacted sectors
+    uint32_t getCompactions() const {
+        return m_compactions;
+    }
+
+    // The bytes of the live records (i.e. all namespaces)
+    uint32_t getLiveBytes() const {
+        return m_liveBytes;
+    }
+
+protected:
+    // Sector header (the magic is written last)
+    struct SectorHeader {
+        uint32_t seq;
+        uint32_t check; // Inverted 'seq' (i.e. interrupted erase detection)
+        uint32_t magic;
+    };
+
+    // Record header (namespace, key and value follow)
+    struct Record {
+        uint32_t crc; // CRC of the record (this field excluded)
+        uint16_t len; // Value bytes
+        uint8_t type;
+        uint8_t nsLen;
+        uint8_t keyLen;
+        uint8_t reserved[3];
+    };
+
+    enum class RecordType: uint8_t {
+        blob = 1,
+        string,
+        tombstone
+    };
+
+    static uint32_t hash_(const char* ns, const char* key);
+
+    static uint32_t recordSize_(const Record& record) {
+        return (sizeof(Record) + record.nsLen + record.keyLen + record.len + 3) & ~3u;
+    }
+
+    uint32_t payload_() const {
+        return m_device.sectorSize() - sizeof(SectorHeader);
+    }
+
+    // NOTE: one sector is reserved for compaction and one for the sectors
+    // unused tails (i.e. records do not span sectors)
+    uint32_t capacity_() const {
+        return (m_device.sectorsCount() - 2) * payload_();
+    }
+
+    uint16_t freeSectors_() const {
+        return m_device.sectorsCount() - m_usedSectors;
+    }
+
+    // The bytes of the superseded records (and of the sectors unused tails)
+    uint32_t garbage_() const {
+        return (m_usedSectors - 1) * payload_() +
+               (m_headOffset - sizeof(SectorHeader)) - m_liveBytes;
+    }
+
+    EmStorageError mount_();
+    bool isBlank_(uint32_t address, uint32_t len);
+    bool openSector_(uint16_t sector);
+    EmStorageError scanSector_(uint16_t sector, uint32_t& end);
+
+    // Moves 'offset' to the next valid record of the sector (false at the end)
+    bool nextRecord_(uint32_t base, uint32_t& offset, Record& record, char* ns, char* key);
+    bool indexRecord_(uint32_t address, const Record& record, const char* ns, const char* key);
+
+    // Reads the record header and names (false if not a valid header)
+    bool readRecord_(uint32_t address, Record& record, char* ns, char* key);
+    bool checkRecord_(uint32_t address, const Record& record);
+    bool copy_(uint32_t from, uint32_t to, uint32_t size);
+
+    IndexEntry* find_(uint32_t hash, const char* ns, const char* key, Record* pRecord = nullptr);
+    IndexEntry* findAddress_(uint32_t hash, uint32_t address);
+    void removeEntry_(IndexEntry* pEntry);
+    uint32_t entrySize_(const IndexEntry* pEntry);
+    bool isSame_(uint32_t address, RecordType type, const void* value, size_t len);
+
+    EmStorageError reserve_(uint32_t size, uint32_t& address, bool compacting);
+    EmStorageError compact_();
+    EmStorageError write_(Record& record, const char* key, const void* value, uint32_t& address);
+    EmStorageError set_(const char* key, RecordType type, const void* value, size_t len);
+    EmStorageError get_(const char* key, RecordType type, void* buf, size_t& len);
+
+    EmFlashDevice& m_device;
+    IndexEntry* m_pIndex;
+    uint16_t m_indexSize;
+    uint16_t m_indexCount;
+    uint16_t m_compactFreeSectors;
+    bool m_mounted;
+    bool m_open;
+    uint16_t m_head;
+    uint16_t m_oldest;
+    uint16_t m_usedSectors;
+    uint32_t m_headOffset;
+    uint32_t m_nextSeq;
+    uint32_t m_liveBytes;
+    uint32_t m_compactions;
+    char m_namespace[EM_STORAGE_MAX_KEY_LEN+1];
+};
+
+#endif // __EM_FLASH_STORAGE__H_
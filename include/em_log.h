@@ -4,6 +4,9 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdarg.h>
+#include <string.h>
+
+#include "em_threading.h"
 
 // The logging enabled levels
 enum class EmLogLevel: int8_t {
@@ -15,13 +18,33 @@ enum class EmLogLevel: int8_t {
     debug
 };
 
+#ifdef EM_MULTITHREAD
+using EmLogLevelInternal = std::atomic<EmLogLevel>;
+#else
+using EmLogLevelInternal = EmLogLevel;
+#endif
+
 // Forward declarations
 class __FlashStringHelper;
 const char* levelToStr(EmLogLevel level);
 
 // The base log target class each logging target should implement. 
+//
+// Each target has its own level: messages are written to the target only 
+// if they pass both the log level and the target level.
 class EmLogTarget {
 public:    
+    EmLogTarget(EmLogLevel level = EmLogLevel::debug)
+     : m_level(level) {}
+
+    EmLogTarget(const EmLogTarget& other)
+     : m_level(other.getLevel()) {}
+
+    EmLogTarget& operator=(const EmLogTarget& other) {
+        setLevel(other.getLevel());
+        return *this;
+    }
+
     virtual void write(EmLogLevel /*level*/, 
                        const char* /*context*/, 
                        const char* /*msg*/) {}
@@ -29,8 +52,49 @@ public:
     virtual void write(EmLogLevel /*level*/, 
                        const char* /*context*/, 
                        const __FlashStringHelper* /*msg*/) {}
+
+    EmLogLevel getLevel() const { 
+        return m_level; 
+    }
+
+    // Sets the target level (it can be changed at runtime).
+    void setLevel(EmLogLevel level);
+
+    bool acceptsLevel(EmLogLevel level) const { 
+        return static_cast<EmLogLevel>(m_level) >= level; 
+    }
+
+protected:
+    EmLogLevelInternal m_level;
 };
 
+#ifdef EM_LOG_METRICS
+
+// NOTE:
+//  Define 'EM_LOG_METRICS' to count log messages per level and per context.
+
+// The log messages counters
+struct EmLogCounters {
+    uint32_t emitted;    // Messages written to targets
+    uint32_t suppressed; // Messages filtered out by log levels
+    uint32_t dropped;    // Messages lost (e.g. log queue full)
+    uint32_t bytes;      // Message bytes written to targets
+};
+
+// The log messages counters of each level
+struct EmLogMetrics {
+    EmLogCounters levels[4]; // 'error', 'warning', 'info' and 'debug' counters
+
+    // NOTE: 'none' and 'global' levels have no counters (i.e. all zero)
+    const EmLogCounters& operator[](EmLogLevel level) const {
+        static const EmLogCounters noCounters = {0, 0, 0, 0};
+        return level > EmLogLevel::none && level <= EmLogLevel::debug ? 
+               levels[static_cast<uint8_t>(level)-1] : noCounters;
+    }
+};
+
+#endif
+
 
 // NOTE:
 //  Define 'EM_NO_LOG' to avoid extra Flash and RAM memory consumption.  
@@ -42,6 +106,26 @@ class EmLog {
 public:    
     static void init(EmLogTarget targets[], uint8_t targetsCount, EmLogLevel level) {}
 
+    static void setTargets(EmLogTarget targets[], uint8_t targetsCount) {}
+
+    static void flush() {}
+
+    static bool setContextLevel(const char* context, EmLogLevel level) { return true; }
+
+    static EmLogLevel getContextLevel(const char* context) { return EmLogLevel::none; }
+
+    static bool configure(const char* config) { return true; }
+
+#ifdef EM_LOG_METRICS
+    static void getMetrics(EmLogMetrics& metrics) { memset(&metrics, 0, sizeof(metrics)); }
+
+    static bool getContextMetrics(const char* context, EmLogCounters& counters) { return false; }
+
+    static void resetMetrics() {}
+
+    static void logMetrics(EmLogLevel level = EmLogLevel::info) {}
+#endif
+
     EmLog(const char* context = NULL, 
           EmLogLevel level = EmLogLevel::global) {}
 
@@ -84,26 +168,118 @@ public:
 
 #else
 
+#ifdef EM_MULTITHREAD
+
+// NOTE:
+//  On multithreading platforms log messages are queued as records and written
+//  to the targets by one thread at a time (i.e. the first producer finding the
+//  targets free drains the queue in sequence order). This way targets do not 
+//  need any locking and lines never interleave.
+
+// The number of log records that can be queued (must be a power of 2).
+// Messages logged while the queue is full are dropped.
+#ifndef EM_LOG_QUEUE_SIZE
+#define EM_LOG_QUEUE_SIZE 16
+#endif
+
+// The max length of a queued log message (longer messages are truncated)
+#ifndef EM_LOG_RECORD_LEN
+#define EM_LOG_RECORD_LEN 127
+#endif
+
+#endif
+
+// The max number of different contexts the levels registry can hold 
+// (see 'EmLog::setContextLevel'). 
+#ifndef EM_LOG_CONTEXTS_COUNT
+#define EM_LOG_CONTEXTS_COUNT 16
+#endif
+
+// The max length of the context names stored by the levels registry (i.e.
+// longer names are compared on their first chars, hash and length) and by
+// the queued log records (i.e. longer names are truncated).
+#ifndef EM_LOG_CONTEXT_NAME_LEN
+#define EM_LOG_CONTEXT_NAME_LEN 15
+#endif
+
+// The levels registry entry shared by all the log instances having the same context.
+// NOTE: contexts are identified by their hash value and their name.
+struct EmLogContext {
+    ts_uint32 hash; // Zero if entry is not used, one if entry was released
+    uint16_t nameLen; // The full name length
+    char name[EM_LOG_CONTEXT_NAME_LEN+1];
+    uint16_t refs; // The log instances using the entry
+    EmLogLevelInternal level; // The context level (i.e. 'global' if not set)
+    EmLogLevelInternal effectiveLevel; // The context level or the global level if not set
+#ifdef EM_LOG_METRICS
+    ts_uint32 counters[4]; // See 'EmLogCounterId'
+#endif
+};
+
+// The log counters (see 'EM_LOG_METRICS')
+enum class EmLogCounterId: uint8_t {
+    emitted = 0,
+    suppressed,
+    dropped,
+    bytes
+};
+
 // The log class can be inherited to allow easy logging
 class EmLog {
     friend const char* levelToStr(EmLogLevel level);
+    friend class EmLogTarget;
 public:    
     static void init(EmLogTarget& target, EmLogLevel level) {
-        EmLog::g_Targets = &target;
-        EmLog::g_TargetsCount = 1;
-        EmLog::g_Level = level;
+        init(&target, 1, level);
     }
 
     static void init(EmLogTarget targets[], uint8_t targetsCount, EmLogLevel level) {
-        EmLog::g_Targets = targets;
-        EmLog::g_TargetsCount = targetsCount;
-        EmLog::g_Level = level;
+        setTargets(targets, targetsCount);
+        setGlobalLevel(level);
     }
 
+    // Replaces the log targets.
+    // It is safe to call this method at runtime while other threads are logging:
+    // pending records are written to the old targets before swapping them.
+    // NOTE: called by a target 'write' (i.e. the thread writing the records)
+    //       the targets are swapped once the pending records are written.
+    static void setTargets(EmLogTarget targets[], uint8_t targetsCount);
+
+    // Writes all the pending log records to the targets. 
+    // NOTE: records are usually written by the logging threads so there is no 
+    //       need to call this method unless you want to be sure nothing is pending 
+    //       (e.g. before a restart).
+    static void flush();
+
+    // NOTE:
+    //  Instance 'level' has the priority, if set to 'global' the context level is used 
+    //  (see 'setContextLevel') and if the context level is not set the global level is used.
     EmLog(const char* context = NULL, 
           EmLogLevel level = EmLogLevel::global)
      : m_Context(context),
-       m_Level(level) { }
+       m_Level(level),
+       m_pContext(context_(context)) { }
+
+    EmLog(const EmLog& other)
+     : m_Context(other.m_Context),
+       m_Level(other.m_Level),
+       m_pContext(context_(other.m_Context)) { }
+
+    // NOTE: the registry entry is released when the last instance 
+    //       of a context is destroyed (i.e. unless its level is set)
+    ~EmLog() {
+        release_(m_pContext);
+    }
+
+    EmLog& operator=(const EmLog& other) {
+        if (this != &other) {
+            release_(m_pContext);
+            m_Context = other.m_Context;
+            m_Level = other.m_Level;
+            m_pContext = context_(other.m_Context);
+        }
+        return *this;
+    }
 
     template<uint8_t max_len>
     void logError(const char* format, ...) const;
@@ -152,7 +328,8 @@ public:
     static void log(EmLogLevel level, const char* context, const __FlashStringHelper* msg);
     
     bool checkLevel(EmLogLevel level) const { 
-        return (m_Level == EmLogLevel::global ? g_Level : m_Level) >= level; 
+        return (m_Level == EmLogLevel::global ? 
+                static_cast<EmLogLevel>(m_pContext->effectiveLevel) : m_Level) >= level; 
     }
 
     void setLevel(EmLogLevel level) { 
@@ -161,80 +338,173 @@ public:
         m_Level = level; 
     }
 
-    static void setGlobalLevel(EmLogLevel level) { 
-        // Since we are running on a 1 Core CPU this operation might be atomic 
-        // (i.e. no thread sync needed since we use 1 byte and we are running on a single CPU)
-        g_Level = level; 
-    }
+    static void setGlobalLevel(EmLogLevel level);
+
+    // Sets the level of all the log instances with the same 'context' 
+    // (i.e. instances with their own level are not affected).
+    // Set 'EmLogLevel::global' to use the global level again.
+    // Returns false if the registry is full (see 'EM_LOG_CONTEXTS_COUNT').
+    static bool setContextLevel(const char* context, EmLogLevel level);
+
+    // Gets the level of the 'context' (i.e. the global level if not set).
+    static EmLogLevel getContextLevel(const char* context);
+
+    // Sets global and context levels from a configuration string.
+    //
+    // The string is a list of 'context=level' separated by ',' or ';' where
+    // level is a level name (e.g. "debug") or number and '*' is the global level.
+    // Example: "*=warning, EmStorage=debug, App=global"
+    // Returns false if any entry is not valid (valid entries are set anyway).
+    static bool configure(const char* config);
+
+#ifdef EM_LOG_METRICS
+    // Gets the counters of each log level
+    static void getMetrics(EmLogMetrics& metrics);
+
+    // Gets the counters of a log context (i.e. all levels). 
+    // Returns false if context is not found.
+    static bool getContextMetrics(const char* context, EmLogCounters& counters);
+
+    static void resetMetrics();
+
+    // Logs the counters summary (one line per level)
+    static void logMetrics(EmLogLevel level = EmLogLevel::info);
+#endif
 
 protected:
     template<uint8_t max_len>
     static void writeToTargets_(EmLogLevel level, 
+                                EmLogContext* pContext,
                                 const char* context, 
                                 const char* format,
                                 va_list args); 
     static void writeToTargets_(EmLogLevel level, 
+                                EmLogContext* pContext,
                                 const char* context, 
                                 const char* msg); 
     static void writeToTargets_(EmLogLevel level, 
+                                EmLogContext* pContext,
                                 const char* context, 
                                 const __FlashStringHelper* msg); 
+#ifdef EM_MULTITHREAD
+    static void writeToTargets_(EmLogLevel level, 
+                                EmLogContext* pContext,
+                                const char* context, 
+                                uint8_t maxLen,
+                                const char* format,
+                                va_list args); 
+#endif
+
+    // Same as 'checkLevel' but it also checks that at least one target wants
+    // the message (i.e. no need to format it otherwise) and counts the 
+    // suppressed messages
+    bool checkLevel_(EmLogLevel level) const {
+        return (checkLevel(level) && checkTargetsLevel_(level)) || 
+               suppressed_(level, m_pContext);
+    }
+    static bool checkLevel_(EmLogLevel level, EmLogContext* pContext) {
+        return (static_cast<EmLogLevel>(pContext->effectiveLevel) >= level && 
+                checkTargetsLevel_(level)) || 
+               suppressed_(level, pContext);
+    }
+    static bool checkTargetsLevel_(EmLogLevel level) {
+        return static_cast<EmLogLevel>(g_TargetsLevel) >= level;
+    }
+
+    // Updates the targets level (i.e. the max level of all targets) when
+    // the 'level' of a target changed
+    static void updateTargetsLevel_(EmLogLevel level);
+
+    // Counts a suppressed message (i.e. always returns false)
+    static bool suppressed_(EmLogLevel level, EmLogContext* pContext) {
+        count_(EmLogCounterId::suppressed, level, pContext);
+        return false;
+    }
+
+#ifdef EM_LOG_METRICS
+    static void count_(EmLogCounterId id, 
+                       EmLogLevel level, 
+                       EmLogContext* pContext, 
+                       uint32_t n = 1) {
+        if (level > EmLogLevel::none && level <= EmLogLevel::debug) {
+            emCount(g_Counters[static_cast<uint8_t>(level)-1][static_cast<uint8_t>(id)], n);
+            emCount(pContext->counters[static_cast<uint8_t>(id)], n);
+        }
+    }
+#else
+    static void count_(EmLogCounterId, EmLogLevel, EmLogContext*, uint32_t = 1) {}
+#endif
+
+    // Returns the registry entry of the 'context' (it is created if not found)
+    // and adds a reference to it (see 'release_').
+    static EmLogContext* context_(const char* context);
+    // Removes a reference to the registry entry, the entry is released when
+    // not referenced and its level is not set.
+    static void release_(EmLogContext* pContext);
+    // Returns the registry entry of the 'context' or the global entry if 
+    // not found (i.e. no registry entry is created).
+    static EmLogContext* findContext_(const char* context);
 
     // Member vars
     const char* m_Context;
     EmLogLevel m_Level;
+    EmLogContext* m_pContext;
     // Global vars
-    static EmLogLevel g_Level;
+    static EmLogLevelInternal g_Level;
     static EmLogTarget* g_Targets;
     static uint8_t g_TargetsCount;
+    static EmLogLevelInternal g_TargetsLevel;
+#ifdef EM_LOG_METRICS
+    static ts_uint32 g_Counters[4][4]; // Level counters (see 'EmLogCounterId')
+#endif
 };
 
 template<uint8_t max_len>
 inline void EmLog::logError(const char* format, ...) const { 
-    if (checkLevel(EmLogLevel::error)) {
+    if (checkLevel_(EmLogLevel::error)) {
         va_list args;
         va_start(args, format);     
-        writeToTargets_<max_len>(EmLogLevel::error, m_Context, format, args);
+        writeToTargets_<max_len>(EmLogLevel::error, m_pContext, m_Context, format, args);
         va_end(args);
     }
 }
 
 template<uint8_t max_len>
 inline void EmLog::logWarning(const char* format, ...) const { 
-    if (checkLevel(EmLogLevel::warning)) {
+    if (checkLevel_(EmLogLevel::warning)) {
         va_list args;
         va_start(args, format);     
-        writeToTargets_<max_len>(EmLogLevel::warning, m_Context, format, args);
+        writeToTargets_<max_len>(EmLogLevel::warning, m_pContext, m_Context, format, args);
         va_end(args);
     }
 }
 
 template<uint8_t max_len>
 inline void EmLog::logInfo(const char* format, ...) const { 
-    if (checkLevel(EmLogLevel::info)) {
+    if (checkLevel_(EmLogLevel::info)) {
         va_list args;
         va_start(args, format);     
-        writeToTargets_<max_len>(EmLogLevel::info, m_Context, format, args);
+        writeToTargets_<max_len>(EmLogLevel::info, m_pContext, m_Context, format, args);
         va_end(args);
     }
 }
 
 template<uint8_t max_len>
 inline void EmLog::logDebug(const char* format, ...) const { 
-    if (checkLevel(EmLogLevel::debug)) {
+    if (checkLevel_(EmLogLevel::debug)) {
         va_list args;
         va_start(args, format);     
-        writeToTargets_<max_len>(EmLogLevel::debug, m_Context, format, args);
+        writeToTargets_<max_len>(EmLogLevel::debug, m_pContext, m_Context, format, args);
         va_end(args);
     }
 }
 
 template<uint8_t max_len>
 inline void EmLog::log(EmLogLevel level, const char* format, ...) const {
-    if (checkLevel(level)) {
+    if (checkLevel_(level)) {
         va_list args;
         va_start(args, format);     
-        writeToTargets_<max_len>(level, m_Context, format, args);
+        writeToTargets_<max_len>(level, m_pContext, m_Context, format, args);
         va_end(args);
     }
 }
@@ -243,22 +513,29 @@ template<uint8_t max_len>
 inline void EmLog::log(EmLogLevel level, 
                        const char* context, 
                        const char* format, ...) {
-    if (g_Level >= level) {
+    EmLogContext* pContext = findContext_(context);
+    if (checkLevel_(level, pContext)) {
         va_list args;
         va_start(args, format);     
-        writeToTargets_<max_len>(level, context, format, args);
+        writeToTargets_<max_len>(level, pContext, context, format, args);
         va_end(args);
     }
 }
 
 template<uint8_t max_len>
 void EmLog::writeToTargets_(EmLogLevel level, 
+                            EmLogContext* pContext,
                             const char* context, 
                             const char* format,
                             va_list args) { 
+#ifdef EM_MULTITHREAD
+    // Format directly within the queued record
+    writeToTargets_(level, pContext, context, max_len, format, args);
+#else
     char msg[max_len+1];
     vsnprintf(msg, max_len+1, format, args);
-    writeToTargets_(level, context, msg);
+    writeToTargets_(level, pContext, context, msg);
+#endif
 }
 #endif 
 #endif // __EM_LOG__H__
\ No newline at end of file
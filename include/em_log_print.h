@@ -7,7 +7,9 @@
 template <class T>
 class EmLogPrintTarget: public EmLogTarget {
 public:   
-    EmLogPrintTarget(T& printer) : m_Printer(printer) {}
+    EmLogPrintTarget(T& printer, EmLogLevel level = EmLogLevel::debug) 
+     : EmLogTarget(level), 
+       m_Printer(printer) {}
 
     virtual void write(EmLogLevel level, 
                        const char* context, 
@@ -0,0 +1,171 @@
+#ifndef __EM_LOG_RING__H_
+#define __EM_LOG_RING__H_
+
+#include "em_defs.h"
+#include "em_log.h"
+
+// Use this attribute to declare the ring memory in a RAM area that is not
+// initialized at startup (i.e. log records survive a reset or a crash).
+// Example:
+//   EM_LOG_RING_NOINIT uint8_t logRingMemory[2048];
+#if defined(ESP32)
+    #include <esp_attr.h>
+    #define EM_LOG_RING_NOINIT RTC_NOINIT_ATTR
+#elif defined(AVR)
+    #define EM_LOG_RING_NOINIT __attribute__((section(".noinit")))
+#else
+    #define EM_LOG_RING_NOINIT
+#endif
+
+// The default size of each ring record (header included)
+#ifndef EM_LOG_RING_RECORD_SIZE
+#define EM_LOG_RING_RECORD_SIZE 64
+#endif
+
+// A log record read from the ring.
+// NOTE: 'context' and 'msg' point to the ring memory (i.e. no copies).
+struct EmLogRingRecord {
+    uint32_t seq;
+    EmLogLevel level;
+    const char* context;
+    const char* msg;
+};
+
+// Ring records visiting callback prototype (return false to stop visiting)
+using EmLogRingVisitor = bool(*)(const EmLogRingRecord& record, void* pUserData);
+
+// The log target keeping the last records within a fixed size memory ring.
+//
+// The ring memory is expected to survive resets (e.g. a 'EM_LOG_RING_NOINIT'
+// buffer or a memory mapped file) so that the last records can be read after
+// an unclean shutdown. Each record has a sequence number and a CRC: records
+// which were being written while the crash happened are just skipped.
+//
+// Records have a fixed size and are written as they are (i.e. no formatting),
+// longer context and messages are truncated.
+// The ring starts at the first 4 bytes aligned address of the memory (i.e.
+// up to 3 bytes are not used).
+class EmLogRingTarget: public EmLogTarget {
+public:
+    EmLogRingTarget(void* memory,
+                    size_t size,
+                    uint16_t recordSize = EM_LOG_RING_RECORD_SIZE,
+                    EmLogLevel level = EmLogLevel::debug)
+     : EmLogTarget(level),
+       m_pMemory(static_cast<uint8_t*>(memory)),
+       m_size(size),
+       m_recordSize(recordSize),
+       m_nextSeq(0) {
+        // NOTE: headers are accessed in place (i.e. aligned memory)
+        size_t skip = (4 - (reinterpret_cast<uintptr_t>(memory) & 3)) & 3;
+        m_pMemory += skip;
+        m_size = size > skip ? size - skip : 0;
+    }
+
+    virtual ~EmLogRingTarget() = default;
+
+    // Checks the ring memory and recovers the last written record.
+    // If ring memory is not valid (e.g. first run or power loss) it is cleared.
+    virtual bool begin();
+
+    bool isInitialized() const {
+        return m_nextSeq != 0;
+    }
+
+    // Removes all the records
+    void clear();
+
+    // Returns the number of records the ring can hold
+    uint32_t capacity() const;
+
+    // Visits the valid records from the oldest to the newest one.
+    // Returns the number of visited records.
+    uint32_t forEach(EmLogRingVisitor visitor, void* pUserData = nullptr) const;
+
+    // Writes the valid records (from the oldest to the newest one) to 'target'.
+    // Returns the number of written records.
+    uint32_t dump(EmLogTarget& target) const;
+
+    virtual void write(EmLogLevel level,
+                       const char* context,
+                       const char* msg) override;
+
+    virtual void write(EmLogLevel level,
+                       const char* context,
+                       const __FlashStringHelper* msg) override;
+
+protected:
+    // Ring memory header
+    struct Header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t recordSize;
+        uint32_t recordsCount;
+    };
+
+    // Stored record header (null terminated context and message follow)
+    struct RecordHeader {
+        uint32_t seq; // Zero if record is empty
+        uint32_t crc; // CRC of all the record bytes following this field
+        int8_t level;
+        uint8_t contextLen;
+        uint16_t msgLen;
+    };
+
+    Header* header_() const {
+        return reinterpret_cast<Header*>(m_pMemory);
+    }
+
+    RecordHeader* record_(uint32_t seq) const {
+        return reinterpret_cast<RecordHeader*>(
+            m_pMemory + sizeof(Header) + (seq % header_()->recordsCount) * m_recordSize);
+    }
+
+    static char* msg_(RecordHeader* pRecord) {
+        return reinterpret_cast<char*>(pRecord + 1) + pRecord->contextLen + 1;
+    }
+
+    static uint32_t crc_(const RecordHeader* pRecord);
+    bool isValid_(const RecordHeader* pRecord, uint32_t seq) const;
+    RecordHeader* beginWrite_(EmLogLevel level, const char* context, size_t msgLen);
+    void endWrite_(RecordHeader* pRecord);
+
+    uint8_t* m_pMemory;
+    size_t m_size;
+    uint16_t m_recordSize;
+    uint32_t m_nextSeq; // Zero if not initialized
+};
+
+#ifdef __linux__
+
+// The log ring target on a memory mapped file
+class EmLogFileRingTarget: public EmLogRingTarget {
+public:
+    EmLogFileRingTarget(const char* path,
+                        size_t size,
+                        uint16_t recordSize = EM_LOG_RING_RECORD_SIZE,
+                        EmLogLevel level = EmLogLevel::debug)
+     : EmLogRingTarget(nullptr, size, recordSize, level),
+       m_path(path) {}
+
+    virtual ~EmLogFileRingTarget() {
+        end();
+    }
+
+    // Maps the file (it is created if it does not exist) and recovers the ring.
+    virtual bool begin() override;
+
+    // Unmaps the file
+    void end();
+
+    // Flushes the mapped memory to the file (i.e. only needed to survive
+    // a power loss, the mapped memory survives a process crash).
+    bool sync();
+
+protected:
+    const char* m_path;
+};
+
+#endif // __linux__
+
+#endif // __EM_LOG_RING__H_
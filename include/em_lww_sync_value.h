@@ -0,0 +1,217 @@
+#ifndef __EM_LWW_SYNC_VALUE__H_
+#define __EM_LWW_SYNC_VALUE__H_
+
+#include <Arduino.h>
+
+#include "em_defs.h"
+#include "em_sync_value.h"
+
+// The number of last changes kept to detect flapping values
+#ifndef EM_SYNC_LWW_HISTORY
+#define EM_SYNC_LWW_HISTORY 8
+#endif
+
+// The flapping detection settings (see 'EmLwwSyncValue'): a value that
+// changed its winning item 'maxSwitches' times within 'windowMs' is
+// damped (i.e. not synchronized) for 'holdMs'.
+struct EmSyncFlapDamping {
+    uint8_t maxSwitches;
+    uint32_t windowMs;
+    uint32_t holdMs;
+};
+
+// The "last writer wins" values synchronization class.
+//
+// All the changed items are read and the newest change (see
+// 'EmSyncItem::getChangeTime') wins, items order only breaks ties.
+// A change older than the current value is not propagated: the item that
+// reported it is stale and it gets written. Only stale items are written
+// (i.e. the items that did not report the winning value).
+//
+// With flap damping, the last winners are kept: a value whose winning item
+// keeps switching is not synchronized for a while (see 'onFlapping'), the
+// newest change is then propagated once the hold time is over.
+template <class EmSyncItemOfT, class T, uint8_t size>
+class EmLwwSyncValue: public EmSimpleSyncValue<EmSyncItemOfT, T, size> {
+public:
+    EmLwwSyncValue(EmSyncItemOfT* items[],
+                   const EmSyncFlapDamping* pDamping = nullptr)
+     : EmSimpleSyncValue<EmSyncItemOfT, T, size>(items),
+       m_pDamping(pDamping),
+       m_valueTime(0),
+       m_hasValue(false),
+       m_damping(false),
+       m_dampUntilMs(0),
+       m_historyPos(0),
+       m_historyCount(0) {
+        for(uint8_t i=0; i < size; i++) {
+            m_stale[i] = false;
+        }
+    }
+
+    bool doSync() override {
+        bool due = this->takeRetryDue_();
+        if (m_damping) {
+            // Still damping?
+            if (!due) {
+                return true;
+            }
+            m_damping = false;
+        }
+        // Nothing changed since last synchronization and no write to retry?
+        if (!this->takeDirty_() && !due && !this->m_polled) {
+            return true;
+        }
+        this->m_waitingRetry = false;
+        this->countSync_();
+        bool res = _lwwSync();
+        this->_scheduleRetries();
+        if (m_damping) {
+            // Wake up at the end of damping only
+            this->m_waitingRetry = true;
+            this->m_retryAtMs = m_dampUntilMs;
+        }
+        return res;
+    }
+
+    // Returns true if the value is flapping (i.e. not synchronized)
+    bool isDamping() const {
+        return m_damping;
+    }
+
+    // The change time of the current value
+    uint32_t getValueTime() const {
+        return m_valueTime;
+    }
+
+protected:
+    // Called when flapping is detected
+    virtual void onFlapping() {}
+
+    bool _lwwSync() {
+        int16_t winner = -1;
+        uint32_t winnerTime = 0;
+        // The change time of the items with no timestamp (see 'getChangeTime')
+        uint32_t passTime = millis();
+        T newValue(this->m_currentValue);
+        for(uint8_t i=0; i < size; i++) {
+            EmSyncItemOfT* pItem = this->m_items[i];
+            switch (pItem->_checkRead()) {
+                case CheckNewValueResult::pendingWrite:
+                    // An "old" pending write
+                    pItem->doPendingWrite(this->m_currentValue);
+                    m_stale[i] = false;
+                    break;
+                case CheckNewValueResult::valueChanged: {
+                    T value(this->m_currentValue);
+                    CheckNewValueResult res = pItem->_read(value, [pItem](T& val) {
+                        return pItem->getValue(val);
+                    });
+                    if (CheckNewValueResult::mustReadFailed == res) {
+                        // A "must read" value failed to read, cannot proceed with synch!
+                        // (lets retry on next synchronization)
+                        this->mustReadFailed_();
+                        return false;
+                    }
+                    if (CheckNewValueResult::valueChanged != res) {
+                        break;
+                    }
+                    uint32_t time = pItem->getChangeTime();
+                    if (time == 0) {
+                        time = passTime;
+                    }
+                    if (m_hasValue && static_cast<int32_t>(time - m_valueTime) < 0) {
+                        // Older than the current value
+                        m_stale[i] = true;
+                    } else if (winner < 0 || static_cast<int32_t>(time - winnerTime) > 0) {
+                        // Newest change so far
+                        if (winner >= 0) {
+                            m_stale[winner] = true;
+                        }
+                        winner = i;
+                        winnerTime = time;
+                        newValue = static_cast<T&&>(value);
+                    } else {
+                        m_stale[i] = true;
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        if (winner >= 0) {
+            this->m_currentValue = static_cast<T&&>(newValue);
+            m_valueTime = winnerTime;
+            m_hasValue = true;
+            this->m_version++;
+            this->onValueChanged();
+            for(uint8_t i=0; i < size; i++) {
+                m_stale[i] = i != winner;
+            }
+            _addHistory(winner);
+        }
+        // Write the stale items only
+        bool res = true;
+        for(uint8_t i=0; i < size; i++) {
+            if (!m_stale[i]) {
+                continue;
+            }
+            m_stale[i] = false;
+            // NOTE: a failed write is a pending write
+            if (!this->m_items[i]->_setCurrentValue(this->m_currentValue)) {
+                res = false;
+            }
+        }
+        return res;
+    }
+
+    void _addHistory(uint8_t winner) {
+        uint32_t now = millis();
+        m_history[m_historyPos].item = winner;
+        m_history[m_historyPos].timeMs = now;
+        m_historyPos = (m_historyPos + 1) % EM_SYNC_LWW_HISTORY;
+        if (m_historyCount < EM_SYNC_LWW_HISTORY) {
+            m_historyCount++;
+        }
+        if (m_pDamping == nullptr) {
+            return;
+        }
+        // Count the winner switches within the window (newest first)
+        uint8_t switches = 0;
+        uint8_t prevItem = winner;
+        for (uint8_t n=1; n < m_historyCount; n++) {
+            const HistoryEntry& entry = m_history[(m_historyPos + EM_SYNC_LWW_HISTORY - 1 - n) % EM_SYNC_LWW_HISTORY];
+            if (now - entry.timeMs > m_pDamping->windowMs) {
+                break;
+            }
+            if (entry.item != prevItem) {
+                switches++;
+            }
+            prevItem = entry.item;
+        }
+        if (switches >= m_pDamping->maxSwitches) {
+            m_damping = true;
+            m_dampUntilMs = now + m_pDamping->holdMs;
+            m_historyCount = 0;
+            onFlapping();
+        }
+    }
+
+    struct HistoryEntry {
+        uint8_t item;
+        uint32_t timeMs;
+    };
+
+    const EmSyncFlapDamping* m_pDamping;
+    bool m_stale[size];
+    uint32_t m_valueTime; // Current value change time
+    bool m_hasValue;
+    bool m_damping;
+    uint32_t m_dampUntilMs;
+    HistoryEntry m_history[EM_SYNC_LWW_HISTORY];
+    uint8_t m_historyPos;
+    uint8_t m_historyCount;
+};
+
+#endif // __EM_LWW_SYNC_VALUE__H_
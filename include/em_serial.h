@@ -0,0 +1,91 @@
+#ifndef __EM_SERIAL__H_
+#define __EM_SERIAL__H_
+
+#include <stddef.h>
+#include <string.h>
+
+#include "em_defs.h"
+
+// The kind of a serialized field, i.e. how a field encoded with another
+// size is decoded.
+enum class EmSerialKind: uint8_t {
+    other = 0,      // Size changes are not decoded (e.g. floats, arrays)
+    unsignedInt,    // Zero extended or truncated
+    signedInt       // Sign extended or truncated
+};
+
+// The kind of a field type (see 'EM_SERIAL_FIELD')
+template <typename T>
+struct EmSerialKindOf { static constexpr EmSerialKind value = EmSerialKind::other; };
+
+#define EM_SERIAL_KIND(type, kind) \
+    template <> \
+    struct EmSerialKindOf<type> { static constexpr EmSerialKind value = EmSerialKind::kind; };
+
+EM_SERIAL_KIND(unsigned char, unsignedInt)
+EM_SERIAL_KIND(unsigned short, unsignedInt)
+EM_SERIAL_KIND(unsigned int, unsignedInt)
+EM_SERIAL_KIND(unsigned long, unsignedInt)
+EM_SERIAL_KIND(unsigned long long, unsignedInt)
+EM_SERIAL_KIND(signed char, signedInt)
+EM_SERIAL_KIND(short, signedInt)
+EM_SERIAL_KIND(int, signedInt)
+EM_SERIAL_KIND(long, signedInt)
+EM_SERIAL_KIND(long long, signedInt)
+
+#undef EM_SERIAL_KIND
+
+// The serialized field of a struct (see 'EM_SERIAL_FIELD').
+// NOTE: tags identify the fields in the encoded value, a tag must not be
+//       reused for a field with another meaning. Fields are up to 255 bytes.
+struct EmSerialField {
+    uint8_t tag;
+    uint8_t size;
+    uint16_t offset;
+    EmSerialKind kind;
+};
+
+// Declares the 'member' field of the 'type' struct with the 'tag' tag
+#define EM_SERIAL_FIELD(type, member, tag) \
+    { tag, \
+      sizeof(static_cast<type*>(nullptr)->member), \
+      offsetof(type, member), \
+      EmSerialKindOf<decltype(static_cast<type*>(nullptr)->member)>::value }
+
+// The serialization schema of a struct.
+//
+// Values are encoded as: format byte, schema version, the fields (tag,
+// size and bytes) and the CRC-32 of all the previous bytes.
+// Fields are decoded by tag: unknown tags are skipped (i.e. a newer schema)
+// and missing fields keep their default value (i.e. an older schema).
+// An integer field with another size is sign or zero extended (i.e.
+// widened) or truncated, as for its kind. Other fields with another size
+// are skipped (i.e. keep their default value): their layout changes (e.g.
+// float to double, array length) need a new tag.
+//
+// 'migrate' (optional) is called when a value encoded with an older schema
+// version is decoded: 'value' has the decoded fields, the others have their
+// default value. Version zero is a raw value (i.e. 'sizeof' bytes written
+// before using a schema).
+struct EmSerialSchema {
+    uint8_t version;
+    const EmSerialField* fields;
+    uint8_t fieldsCount;
+    bool (*migrate)(uint8_t fromVersion, void* value);
+};
+
+// The max encoded size of a 'valueSize' bytes value (i.e. one byte fields)
+constexpr size_t emSerialMaxSize(size_t valueSize) {
+    return 2 + 3 * valueSize + 4;
+}
+
+// Encodes 'value' into 'buf'.
+// Returns the encoded bytes (zero if 'buf' is too small).
+size_t emSerialEncode(const EmSerialSchema& schema, const void* value, void* buf, size_t bufSize);
+
+// Decodes 'buf' into 'value' (i.e. 'value' keeps missing fields).
+// Returns the schema version of the encoded value or -1 if 'buf' is not a
+// valid encoded value (e.g. CRC mismatch).
+int emSerialDecode(const EmSerialSchema& schema, const void* buf, size_t len, void* value);
+
+#endif // __EM_SERIAL__H_
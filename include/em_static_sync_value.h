@@ -0,0 +1,251 @@
+#ifndef __EM_STATIC_SYNC_VALUE__H_
+#define __EM_STATIC_SYNC_VALUE__H_
+
+#include "em_defs.h"
+#include "em_sync_value.h"
+
+// Removes the reference from a type (i.e. no <type_traits> on all platforms)
+template <class T> struct EmRemoveReference { typedef T type; };
+template <class T> struct EmRemoveReference<T&> { typedef T type; };
+
+// Defines 'type' only if 'condition' is true (i.e. no <type_traits> on all platforms)
+template <bool condition, class T = void> struct EmEnableIf {};
+template <class T> struct EmEnableIf<true, T> { typedef T type; };
+
+// Checks if all the types are references
+template <class... Types> struct EmAllReferences { static constexpr bool value = true; };
+template <class T, class... Rest> struct EmAllReferences<T, Rest...> { static constexpr bool value = false; };
+template <class T, class... Rest> struct EmAllReferences<T&, Rest...> { 
+    static constexpr bool value = EmAllReferences<Rest...>::value; 
+};
+
+// The items of a 'EmStaticSyncValue' (i.e. a recursive holder of the items
+// types). Items 'getValue', 'setValue' and 'getVersion' are called with
+// qualified names of their concrete types: no virtual dispatch.
+template <class... Items>
+struct EmSyncItems;
+
+template <>
+struct EmSyncItems<> {
+    void setOwner(EmSyncValueBase* /*pOwner*/) {}
+
+    bool isPolled() const {
+        return false;
+    }
+
+    template <class T>
+    int8_t checkNewValues(T& /*currentValue*/, uint8_t /*index*/) {
+        return -1;
+    }
+
+    template <class T>
+    bool setCurrentValue(const T& /*currentValue*/, int8_t /*changed*/, uint8_t /*index*/) {
+        return true;
+    }
+
+    bool scheduleRetries(bool& /*waiting*/, uint32_t& /*retryAtMs*/, uint8_t& /*pendingWrites*/) const {
+        return true;
+    }
+};
+
+template <class Item, class... Rest>
+struct EmSyncItems<Item, Rest...> {
+    typedef typename EmRemoveReference<Item>::type ItemType;
+
+    EmSyncItems() {}
+
+    EmSyncItems(Item item, Rest... rest)
+     : m_item(item),
+       m_rest(rest...) {}
+
+    void setOwner(EmSyncValueBase* pOwner) {
+        m_item._setOwner(pOwner);
+        m_rest.setOwner(pOwner);
+    }
+
+    bool isPolled() const {
+        return m_item.isPolled() || m_rest.isPolled();
+    }
+
+    // Returns the index of the first changed item, -1 if no item changed
+    // or -2 if a "must read" item failed to read
+    template <class T>
+    int8_t checkNewValues(T& currentValue, uint8_t index) {
+        ItemType& item = m_item;
+        switch (item._checkRead([&item]() {
+                    return item.ItemType::getVersion();
+                })) {
+            case CheckNewValueResult::valueChanged:
+                switch (item._read(currentValue, [&item](T& value) {
+                            return item.ItemType::getValue(value);
+                        })) {
+                    case CheckNewValueResult::valueChanged:
+                        return index;
+                    case CheckNewValueResult::mustReadFailed:
+                        return -2;
+                    default:
+                        break;
+                }
+                break;
+            case CheckNewValueResult::pendingWrite:
+                // An "old" pending write
+                if (item.isRetryDue()) {
+                    item._writeDone(item._write(currentValue, [&item](const T& value) {
+                                        return item.ItemType::setValue(value);
+                                    }), currentValue);
+                }
+                break;
+            default:
+                break;
+        }
+        return m_rest.checkNewValues(currentValue, index + 1);
+    }
+
+    // Writes the new value to all the items but the changed one
+    template <class T>
+    bool setCurrentValue(const T& currentValue, int8_t changed, uint8_t index) {
+        bool res = true;
+        ItemType& item = m_item;
+        if (index != changed && !item.readOnly()) {
+            res = item._canWrite() &&
+                  item._currentValueSet(item._write(currentValue, [&item](const T& value) {
+                                            return item.ItemType::setValue(value);
+                                        }), currentValue);
+        }
+        return m_rest.setCurrentValue(currentValue, changed, index + 1) && res;
+    }
+
+    // Gets the earliest write retry and counts the pending writes, returns 
+    // false if an item has to retry at each synchronization
+    bool scheduleRetries(bool& waiting, uint32_t& retryAtMs, uint8_t& pendingWrites) const {
+        bool res = true;
+        const ItemType& item = m_item;
+        if (item.isPendingWrite()) {
+            pendingWrites++;
+            if (!item.hasRetryPolicy()) {
+                res = false;
+            } else if (!waiting || static_cast<int32_t>(item.retryAtMs() - retryAtMs) < 0) {
+                retryAtMs = item.retryAtMs();
+                waiting = true;
+            }
+        }
+        return m_rest.scheduleRetries(waiting, retryAtMs, pendingWrites) && res;
+    }
+
+    Item m_item;
+    EmSyncItems<Rest...> m_rest;
+};
+
+// Gets the item at 'index' of a 'EmSyncItems' holder
+template <uint8_t index, class... Items>
+struct EmSyncItemAt;
+
+template <class Item, class... Rest>
+struct EmSyncItemAt<0, Item, Rest...> {
+    typedef typename EmRemoveReference<Item>::type type;
+
+    static type& get(EmSyncItems<Item, Rest...>& items) {
+        return items.m_item;
+    }
+};
+
+template <uint8_t index, class Item, class... Rest>
+struct EmSyncItemAt<index, Item, Rest...> {
+    typedef typename EmSyncItemAt<index - 1, Rest...>::type type;
+
+    static type& get(EmSyncItems<Item, Rest...>& items) {
+        return EmSyncItemAt<index - 1, Rest...>::get(items.m_rest);
+    }
+};
+
+// The simple priority based synchronized value with compile time items.
+//
+// Same as 'EmSimpleSyncValue' but items keep their own types: the priority
+// loop is unrolled at compile time and items methods are not virtual calls
+// (i.e. they can be inlined). Items can be owned by the value (default
+// constructed, see 'item') or be references to external items:
+//
+//   EmStaticSyncValue<int, MyDeviceItem, MyStorageItem> value;
+//   EmStaticSyncValue<int, MyDeviceItem&, MyStorageItem&> value(deviceItem, storageItem);
+//
+// NOTE: items 'checkNewValue', 'doPendingWrite' and '_setCurrentValue' overrides
+//       are not called (only 'getValue', 'setValue' and 'getVersion' ones).
+//       Items are still 'EmValue' objects (i.e. they have a vtable) but the
+//       synchronization calls them directly ('onPendingWriteFailed' and the
+//       filters excepted). 
+//       The items constructor is available only if all the items are references
+//       (i.e. owned items are not copied).
+template <class T, class... Items>
+class EmStaticSyncValue: public EmSyncValue<T> {
+public:
+    static_assert(sizeof...(Items) > 0, "at least one item is needed");
+    static_assert(sizeof...(Items) < 128, "too many items");
+
+    EmStaticSyncValue() {
+        init_();
+    }
+
+    template <bool references = EmAllReferences<Items...>::value,
+              class = typename EmEnableIf<references>::type>
+    explicit EmStaticSyncValue(Items... items)
+     : m_items(items...) {
+        init_();
+    }
+
+    bool doSync() override {
+        // Nothing changed since last synchronization and no write to retry?
+        if (!this->takeDirty_() && !this->takeRetryDue_() && !m_polled) {
+            return true;
+        }
+        bool res = true;
+        this->m_waitingRetry = false;
+        this->countSync_();
+        int8_t changed = m_items.checkNewValues(this->m_currentValue, 0);
+        if (changed == -2) {
+            // A "must read" value failed to read, cannot proceed with synch!
+            // (lets retry on next synchronization)
+            this->mustReadFailed_();
+            res = false;
+        } else if (changed >= 0) {
+            // First changed value found: lets write all the others!
+            this->m_version++;
+            this->onValueChanged();
+            res = m_items.setCurrentValue(this->m_currentValue, changed, 0);
+        }
+        scheduleRetries_();
+        return res;
+    }
+
+    bool isPolled() const override {
+        return m_polled;
+    }
+
+    // Gets the item at 'index'
+    template <uint8_t index>
+    typename EmSyncItemAt<index, Items...>::type& item() {
+        return EmSyncItemAt<index, Items...>::get(m_items);
+    }
+
+protected:
+    void init_() {
+        m_items.setOwner(this);
+        m_polled = m_items.isPolled();
+    }
+
+    void scheduleRetries_() {
+        bool waiting = false;
+        uint32_t retryAtMs = 0;
+        uint8_t pendingWrites = 0;
+        if (!m_items.scheduleRetries(waiting, retryAtMs, pendingWrites)) {
+            this->notifyChanged();
+        } else if (waiting) {
+            this->waitRetry_(retryAtMs);
+        }
+        this->countPendingWrites_(pendingWrites);
+    }
+
+    EmSyncItems<Items...> m_items;
+    bool m_polled; // At least one item must be read at each synchronization
+};
+
+#endif // __EM_STATIC_SYNC_VALUE__H_
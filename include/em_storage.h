@@ -3,31 +3,96 @@
 
 #include "em_defs.h"
 
-#ifdef EM_NVS
-
-#include <nvs.h>
-#include <cstring>
+#include <string.h>
+#ifdef ARDUINO
 #include <WString.h>
+#endif
 #include "em_log.h"
+#include "em_serial.h"
+#include "em_string.h"
 #include "em_sync_value.h"
+#include "em_storage_backend.h"
+#include "em_storage_key.h"
+#include "em_storage_stats.h"
 
+// The key of the transactions journal entry (see 'EmStorage::beginTx')
+#define EM_STORAGE_TX_KEY "_emtx"
 
-// NVS persistent storage class
-class EmStorage: public EmLog {
+// The persistent storage class.
+//
+// Entries are read and written through a storage backend (see 
+// 'EmStorageBackend'): NVS by default on ESP32, any other backend (e.g. 
+// 'EmMemStorageBackend' or 'EmFileStorageBackend' on the host) can be provided.
+//
+// Within a batch (see 'beginBatch') the commits are deferred and done
+// once at 'endBatch' (e.g. all the values written by an 'EmSyncGroup' pass).
+//
+// Within a transaction (see 'beginTx') the writes are staged in RAM and
+// 'commitTx' writes all or none of them (e.g. related settings like an IP 
+// address and its mask): staged writes are saved to a journal entry first
+// (see 'EM_STORAGE_TX_KEY'), then written to their keys and the journal is 
+// erased, each step is flushed (see 'EmStorageBackend::flush') before the
+// next one. A transaction interrupted by a reset is completed by next 'begin'.
+//
+// Define 'EM_STORAGE_STATS' to count the backend operations (i.e. puts, gets,
+// removals and commits), their bytes and latency and the free entries (see
+// 'getStats' and 'EmStorageTraceReplay').
+class EmStorage: public EmLog, public EmSyncBatch {
 private:
-    nvs_handle_t m_handle;
+#ifdef EM_NVS
+    EmNvsStorageBackend m_nvsBackend;
+#endif
+    EmStorageBackend& m_backend;
+    mutable uint8_t m_batchDepth;
+    mutable bool m_batchCommit;
+    mutable ts_uint32 m_generation; // NOTE: writes might come from several threads
+    bool m_exclusive;
+    uint8_t* m_pTx;
+    size_t m_txSize;
+    mutable size_t m_txUsed;
+    mutable bool m_inTx;
+    mutable bool m_txFailed;
+    const EmStorageKey* m_pKeys;
+    size_t m_keysCount;
+#ifdef EM_STORAGE_STATS
+    mutable EmStorageStats m_stats;
+    // NOTE: the counters are updated by const reads too (i.e. concurrent
+    //       readers on 'EM_MULTITHREAD')
+    mutable EmMutex m_statsMutex;
+#endif
 
 public:
+#ifdef EM_NVS
     EmStorage()
+     : EmStorage(m_nvsBackend) {}
+#endif
+
+    // NOTE: the backend object is not copied
+    explicit EmStorage(EmStorageBackend& backend)
      : EmLog("EmStorage"),
-       m_handle(-1) {}
+       m_backend(backend),
+       m_batchDepth(0),
+       m_batchCommit(false),
+       m_generation(1),
+       m_exclusive(false),
+       m_pTx(nullptr),
+       m_txSize(0),
+       m_txUsed(0),
+       m_inTx(false),
+       m_txFailed(false),
+       m_pKeys(nullptr),
+       m_keysCount(0) {
+#ifdef EM_STORAGE_STATS
+        resetStats();
+#endif
+    }
 
     ~EmStorage() {
         end();
     }
 
     bool isInitialized() const {
-        return m_handle != -1;
+        return m_backend.isOpen();
     }
     bool isNotInitialized() const {
         return !isInitialized();
@@ -38,64 +103,282 @@ public:
     bool clear() const;
     bool commit() const;
 
+    // Commits the writes and waits for them (i.e. deferred or asynchronous
+    // backend commits, see 'EmAsyncStorageBackend')
+    bool flush() const;
+
+    // Defers the commits up to the matching 'endBatch' call (batches can be nested)
+    virtual void beginBatch() override;
+    virtual void endBatch() override;
+
+    // Sets the transactions buffer (i.e. the max staged bytes of a transaction).
+    // Call it before 'begin' so that an interrupted transaction is completed.
+    // NOTE: the buffer is not copied
+    void setTxBuffer(void* buffer, size_t size) {
+        m_pTx = static_cast<uint8_t*>(buffer);
+        m_txSize = size;
+    }
+
+    // Sets the hashed keys registry (i.e. logs show the keys names)
+    // NOTE: the keys are not copied
+    void setKeys(const EmStorageKey* keys, size_t count) {
+        m_pKeys = keys;
+        m_keysCount = count;
+    }
+
+    template<size_t N>
+    void setKeys(const EmStorageKey (&keys)[N]) {
+        setKeys(keys, N);
+    }
+
+    // Starts staging the writes and removals (reads get the committed values)
+    bool beginTx();
+
+    // Writes the staged values. Returns false if nothing has been written 
+    // (e.g. transaction buffer full) or if the storage failed (the 
+    // transaction is then completed by next 'begin').
+    bool commitTx();
+
+    // Discards the staged values
+    void abortTx();
+
+    bool isInTx() const {
+        return m_inTx;
+    }
+
     template<typename T>
     size_t putValue(const char* key, const T& value, bool commit=true) const {
         return putBytes(key, &value, sizeof(value), commit);
     }   
     size_t putString(const char* key, const char* value, bool commit=true) const;
+#ifdef ARDUINO
     size_t putString(const char* key, const String& value, bool commit=true) const;
+#endif
     size_t putBytes(const char* key, const void* value, size_t len, bool commit=true) const;
 
+    // Removes the 'key' entry (returns true if it does not exist)
+    bool remove(const char* key, bool commit=true) const;
+
     template<typename T>
     size_t getValue(const char* key, T& value) const {
         return getBytes(key, &value, sizeof(value));
     }
     size_t getString(const char* key, char* value, const size_t maxLen) const;
+
+    // Reads the string straight into 'value' (i.e. no temporary copies)
+    template<size_t N>
+    size_t getString(const char* key, EmString<N>& value) const {
+        return getString(key, value.buffer(), N + 1);
+    }
+#ifdef ARDUINO
     String getString(const char* key, const char* defaultValue="") const;
+#endif
     size_t getBytesLength(const char* key) const;
     size_t getBytes(const char* key, void * buf, size_t maxLen) const;
 
+    // Reads the 'key' blob in chunks (e.g. a blob bigger than the available
+    // RAM streamed to a file): 'buf' is the chunk buffer, backends keeping
+    // values in memory visit them in place (see 'EmStorageBackend::getChunks').
+    bool readBytes(const char* key,
+                   void* buf,
+                   size_t bufSize,
+                   EmStorageChunkVisitor visitor,
+                   void* pUserData = nullptr) const;
+
     size_t freeEntries() const;
+
+#ifdef EM_STORAGE_STATS
+    // Gets a copy of the operations counters
+    EmStorageStats getStats() const {
+        EmMutexLock lock(m_statsMutex);
+        return m_stats;
+    }
+
+    void resetStats() {
+        EmMutexLock lock(m_statsMutex);
+        m_stats.reset();
+    }
+#endif
+
+    // Declares that the namespace is written only through this object
+    // (i.e. no other 'EmStorage' on the same namespace and no writes to the
+    // backends below it), so that its generation can be trusted.
+    void setExclusive(bool exclusive) {
+        m_exclusive = exclusive;
+    }
+
+    bool isExclusive() const {
+        return m_exclusive;
+    }
+
+    // The storage content generation: it changes at each write, zero (i.e.
+    // unknown) if this object is not the exclusive writer (see 'setExclusive').
+    // NOTE: writes done bypassing this object are not tracked
+    uint32_t getGeneration() const {
+        return m_exclusive ? static_cast<uint32_t>(m_generation) : 0;
+    }
+
+protected:
+    void changed_() const {
+        // Zero means 'no version' (see 'EmValue::getVersion')
+        if (++m_generation == 0) {
+            m_generation = 1;
+        }
+    }
+
+    // Transaction journal header (staged records follow)
+    struct TxHeader {
+        uint32_t magic;
+        uint32_t crc;  // Records CRC
+        uint32_t size; // Records bytes
+    };
+
+    // Staged record header (key and value bytes follow)
+    struct TxRecord {
+        uint8_t type;  // See 'TxType'
+        uint8_t keyLen;
+        uint16_t len;
+    };
+
+    enum class TxType: uint8_t {
+        blob = 0,
+        string,
+        remove
+    };
+
+    // The operations start time (i.e. zero if 'EM_STORAGE_STATS' is not defined)
+    static uint32_t statsTime_() {
+#ifdef EM_STORAGE_STATS
+        return micros();
+#else
+        return 0;
+#endif
+    }
+
+    // Counts an operation started at 'startUs' (see 'EM_STORAGE_STATS')
+    void countOp_(EmStorageOp op, uint32_t startUs, bool succeeded, size_t bytes) const {
+#ifdef EM_STORAGE_STATS
+        uint32_t elapsedUs = micros() - startUs;
+        EmMutexLock lock(m_statsMutex);
+        EmStorageOpStats& stats = m_stats.op(op);
+        stats.latency.add(elapsedUs);
+        if (succeeded) {
+            stats.bytes += bytes;
+        } else {
+            stats.failures++;
+        }
+#else
+        (void)op;
+        (void)startUs;
+        (void)succeeded;
+        (void)bytes;
+#endif
+    }
+
+    // The key name to be logged (see 'setKeys')
+    const char* keyName_(const char* key) const {
+        return emStorageKeyName(m_pKeys, m_keysCount, key);
+    }
+
+    // Commits or defers the commit if within a batch
+    bool commit_() const;
+
+    bool stage_(const char* key, TxType type, const void* value, size_t len) const;
+    bool apply_(const uint8_t* records, size_t size) const;
+    void recoverTx_();
+    // Erases the journal once its values are written
+    bool eraseTx_();
 };
 
+// The storage value.
+//
+// Values are written as raw 'sizeof(T)' bytes unless a serialization
+// schema is provided (see 'EmSerialSchema'): then a value written with an
+// older schema (or a raw value) is migrated and written again at first read.
 template<typename T>
 class EmStorageValue: public EmValue<T> {
 protected:
     const char* m_key;
     const EmStorage& m_storage;
     void (*m_onSetValue)(const T&);
+    const EmSerialSchema* m_pSchema;
 
 public:
+    // NOTE: the schema object is not copied
     EmStorageValue(const char* key, 
                    const EmStorage& storage,
-                   void (*onSetValue)(const T&) = nullptr)
+                   void (*onSetValue)(const T&) = nullptr,
+                   const EmSerialSchema* pSchema = nullptr)
      : EmValue<T>(), 
        m_key(key),
        m_storage(storage),
-       m_onSetValue(onSetValue) {}
+       m_onSetValue(onSetValue),
+       m_pSchema(pSchema) {}
 
     virtual ~EmStorageValue() = default;
 
     virtual EmGetValueResult getValue(T& value) const override {
         T curVal;
-        if (m_storage.getValue(m_key, curVal) != sizeof(value)) {
+        if (m_pSchema != nullptr) {
+            curVal = T();
+            if (!read_(curVal)) {
+                return EmGetValueResult::failed;
+            }
+        } else if (m_storage.getValue(m_key, curVal) != sizeof(value)) {
             return EmGetValueResult::failed;
         }
         if (value == curVal) {
             return EmGetValueResult::succeedEqualValue;        
         }
-        value = curVal;
+        value = static_cast<T&&>(curVal);
         return EmGetValueResult::succeedNotEqualValue;
     }
 
-    virtual bool setValue(const T value) override {
-        bool res = m_storage.putValue(m_key, value) == sizeof(value);
+    // Storage values change only when storage is written (i.e. no version
+    // unless the storage is the exclusive writer, see 'EmStorage::setExclusive')
+    virtual uint32_t getVersion() const override {
+        return m_storage.getGeneration();
+    }
+
+    virtual bool setValue(const T& value) override {
+        bool res = write_(value);
         if (res && m_onSetValue) {
             m_onSetValue(value);
         }
         return res;
     }
+
+protected:
+    bool read_(T& value) const {
+        uint8_t buf[emSerialMaxSize(sizeof(T))];
+        size_t len = m_storage.getBytes(m_key, buf, sizeof(buf));
+        int version = emSerialDecode(*m_pSchema, buf, len, &value);
+        if (version < 0) {
+            // Raw value (i.e. written before using a schema)
+            if (len != sizeof(T)) {
+                return false;
+            }
+            memcpy(static_cast<void*>(&value), buf, sizeof(T));
+            version = 0;
+        }
+        if (version >= m_pSchema->version) {
+            return true;
+        }
+        if (m_pSchema->migrate != nullptr && !m_pSchema->migrate(version, &value)) {
+            return false;
+        }
+        // Migrated once (i.e. written with current schema)
+        return write_(value);
+    }
+
+    bool write_(const T& value) const {
+        if (m_pSchema == nullptr) {
+            return m_storage.putValue(m_key, value) == sizeof(value);
+        }
+        uint8_t buf[emSerialMaxSize(sizeof(T))];
+        size_t len = emSerialEncode(*m_pSchema, &value, buf, sizeof(buf));
+        return len != 0 && m_storage.putBytes(m_key, buf, len) == len;
+    }
 };
 
-#endif
 #endif // __EM_STORAGE__H_
\ No newline at end of file
@@ -0,0 +1,241 @@
+#ifndef __EM_STORAGE_ASYNC__H_
+#define __EM_STORAGE_ASYNC__H_
+
+#include "em_defs.h"
+#include "em_threading.h"
+#include "em_storage_backend.h"
+
+#ifdef EM_MULTITHREAD
+#include <thread>
+#include <condition_variable>
+#endif
+
+// Commit completion callback prototype (see 'EmAsyncStorageBackend')
+using EmStorageCommitCallback = void(*)(uint32_t ticket, EmStorageError err, void* pUserData);
+
+// The asynchronous commits storage backend.
+//
+// Writes are staged in a RAM queue and return right away, a storage worker
+// writes them to the backend and commits them (i.e. slow commits, like NVS
+// ones erasing flash pages, do not block the writers).
+// Reads get the staged values first.
+//
+// The worker is a thread on multithreading platforms, otherwise it runs
+// by 'update' (e.g. add this object to an 'EmAppUpdaterInterface').
+//
+// Each 'commit' call gets a ticket (see 'getCommitTicket') covering the
+// writes staged so far: 'isCommitted' and 'wait' tell when they have been
+// committed and 'onCommitted' (optional) is called by the worker.
+// 'flush' and 'close' (i.e. 'EmStorage::flush' and 'EmStorage::end') wait
+// for all the staged writes.
+//
+// IMPLEMENTATION NOTES:
+// ---------------------
+//   The queue memory is split in two halves: one stages the writes while
+//   the worker writes the other one. A write not fitting the staging half
+//   waits for the worker (i.e. or runs it), a write bigger than the half
+//   is written through once the queue is drained.
+//
+//   Commits are queued as well: a key written again before the next commit
+//   replaces its staged value (i.e. writes are not moved across commits, see
+//   'EmStorage::commitTx'). The worker writes the queued records in order and
+//   commits the backend at each queued commit following writes (i.e. commits
+//   stay barriers), 'onCommitted' gets the last ticket (i.e. the previous
+//   ones are committed as well).
+//
+//   Records are 4 bytes aligned: the queue memory start is aligned (i.e.
+//   up to 3 bytes are not used).
+//
+//   Reads of keys not staged wait for the worker to release the backend.
+//
+//   'onCommitted' is called by the worker: it must not write to this object.
+//
+class EmAsyncStorageBackend: public EmStorageBackend, public EmUpdatable {
+public:
+    // NOTE: the backend object is not copied
+    EmAsyncStorageBackend(EmStorageBackend& backend,
+                          void* queueMemory,
+                          size_t queueSize,
+                          EmStorageCommitCallback onCommitted = nullptr,
+                          void* pUserData = nullptr)
+     : m_backend(backend),
+       m_onCommitted(onCommitted),
+       m_pUserData(pUserData),
+       m_queueSize(queueSize / 2),
+       m_pPending(&m_queues[0]),
+       m_pInflight(&m_queues[1]),
+       m_requested(0),
+       m_started(0),
+       m_done(0),
+       m_drain(false),
+       m_uncommitted(false),
+       m_lastError(EmStorageError::none),
+       m_commits(0)
+#ifdef EM_MULTITHREAD
+       , m_stop(false)
+#endif
+    {
+        // NOTE: records headers are accessed in place (i.e. aligned memory)
+        size_t skip = (4 - (reinterpret_cast<uintptr_t>(queueMemory) & 3)) & 3;
+        uint8_t* pMemory = static_cast<uint8_t*>(queueMemory) + skip;
+        m_queueSize = (queueSize > skip ? queueSize - skip : 0) / 2;
+        m_queueSize &= ~static_cast<size_t>(3);
+        m_queues[0].data = pMemory;
+        m_queues[0].used = 0;
+        m_queues[0].segment = 0;
+        m_queues[1].data = pMemory + m_queueSize;
+        m_queues[1].used = 0;
+        m_queues[1].segment = 0;
+    }
+
+    virtual ~EmAsyncStorageBackend() {
+        close();
+    }
+
+    // Opens the backend (and starts the worker thread)
+    virtual EmStorageError open(const char* name) override;
+
+    // Drains the queue (and stops the worker thread) and closes the backend
+    virtual void close() override;
+
+    virtual bool isOpen() const override {
+        return m_backend.isOpen();
+    }
+
+    virtual EmStorageError setBlob(const char* key, const void* value, size_t len) override;
+    virtual EmStorageError setString(const char* key, const char* value) override;
+    virtual EmStorageError getBlob(const char* key, void* buf, size_t& len) override;
+    virtual EmStorageError getString(const char* key, char* buf, size_t& len) override;
+
+    // Staged values are visited in place.
+    // NOTE: the visitor must not use this object
+    virtual EmStorageError getChunks(const char* key,
+                                     bool isString,
+                                     void* buf,
+                                     size_t bufSize,
+                                     EmStorageChunkVisitor visitor,
+                                     void* pUserData = nullptr) override;
+
+    // Stages the removal ('notFound' is not reported)
+    virtual EmStorageError erase(const char* key) override;
+    virtual EmStorageError eraseAll() override;
+
+    // Requests the commit of the staged writes (i.e. it does not wait)
+    virtual EmStorageError commit() override;
+
+    // Commits the staged writes and waits for them
+    virtual EmStorageError flush() override;
+
+    virtual EmStorageError freeEntries(size_t& entries) const override;
+
+    // Drains the queue and visits the backend entries
+    virtual uint32_t forEach(EmStorageVisitor visitor, void* pUserData = nullptr) override;
+
+    // Runs the worker (i.e. on platforms without threads)
+    virtual void update() override;
+
+    // The ticket of the last 'commit' call
+    uint32_t getCommitTicket() const;
+
+    // Returns true if the 'ticket' writes have been committed
+    bool isCommitted(uint32_t ticket) const;
+
+    // Waits for the 'ticket' commit and returns the last commit result
+    EmStorageError wait(uint32_t ticket);
+
+    // The last commit result (i.e. writes failed or commit failed)
+    EmStorageError getLastError() const;
+
+    // The commits done to the backend
+    uint32_t getCommits() const {
+        return m_commits;
+    }
+
+protected:
+    // Staged record header (null terminated key and value follow)
+    struct Record {
+        uint8_t type;
+        uint8_t keyLen;
+        uint16_t len;
+    };
+
+    enum class RecordType: uint8_t {
+        blob = 0,
+        string,
+        erase,
+        eraseAll,
+        commit // The value is the commit ticket
+    };
+
+    struct Queue {
+        uint8_t* data;
+        size_t used;
+        size_t segment; // The records after the last commit
+    };
+
+    static size_t recordSize_(size_t keyLen, size_t len) {
+        return (sizeof(Record) + keyLen + 1 + len + 3) & ~static_cast<size_t>(3);
+    }
+
+    static const char* key_(const Record* pRecord) {
+        return reinterpret_cast<const char*>(pRecord + 1);
+    }
+
+    static const uint8_t* value_(const Record* pRecord) {
+        return reinterpret_cast<const uint8_t*>(key_(pRecord)) + pRecord->keyLen + 1;
+    }
+
+    static bool isDone_(uint32_t done, uint32_t ticket) {
+        return static_cast<int32_t>(done - ticket) >= 0;
+    }
+
+    // The latest record of 'key' (or the latest 'eraseAll' record)
+    static const Record* find_(const Queue& queue, const char* key);
+
+    // Removes the 'key' records (all of them if null) staged after the last commit
+    static void remove_(Queue& queue, const char* key);
+
+    static EmStorageError read_(const Record* pRecord, RecordType type, void* buf, size_t& len);
+
+    // The latest staged record of 'key' (null if not staged)
+    const Record* staged_(const char* key) const;
+
+    EmStorageError stage_(RecordType type, const char* key, const void* value, size_t len);
+    void append_(RecordType type, const char* key, size_t keyLen, const void* value, size_t len);
+    EmStorageError write_(RecordType type, const char* key, const void* value, size_t len);
+    EmStorageError get_(const char* key, RecordType type, void* buf, size_t& len);
+
+    // Writes the staged values and commits them (i.e. the worker)
+    void process_();
+
+#ifdef EM_MULTITHREAD
+    void run_();
+#endif
+
+    EmStorageBackend& m_backend;
+    EmStorageCommitCallback m_onCommitted;
+    void* m_pUserData;
+    size_t m_queueSize;
+    Queue m_queues[2];
+    Queue* m_pPending;
+    Queue* m_pInflight;
+    uint32_t m_requested; // Last commit ticket
+    uint32_t m_started;   // Last commit ticket taken by the worker
+    uint32_t m_done;      // Last commit ticket done
+    bool m_drain;
+    bool m_uncommitted; // Writes not committed yet (backend lock)
+    EmStorageError m_lastError;
+    ts_uint32 m_commits;
+    // Queues lock
+    mutable EmMutex m_mutex;
+    // Backend lock
+    mutable EmMutex m_backendMutex;
+#ifdef EM_MULTITHREAD
+    bool m_stop;
+    std::thread m_thread;
+    std::condition_variable m_workCv;
+    std::condition_variable m_doneCv;
+#endif
+};
+
+#endif // __EM_STORAGE_ASYNC__H_
@@ -0,0 +1,299 @@
+#ifndef __EM_STORAGE_BACKEND__H_
+#define __EM_STORAGE_BACKEND__H_
+
+#include <string.h>
+
+#include "em_defs.h"
+
+#ifdef EM_NVS
+#include <nvs.h>
+#include <esp_idf_version.h>
+#endif
+
+// The max length of keys and namespaces (i.e. NVS limit)
+#define EM_STORAGE_MAX_KEY_LEN 15
+
+// The size of a storage entry (i.e. NVS entry size, see 'freeEntries')
+#define EM_STORAGE_ENTRY_SIZE 32
+
+// The storage operations errors (i.e. same as NVS errors)
+enum class EmStorageError: uint8_t {
+    none = 0,
+    notInitialized,
+    notFound,
+    typeMismatch,
+    readOnly,
+    notEnoughSpace,
+    invalidName,
+    invalidHandle,
+    removeFailed,
+    keyTooLong,
+    pageFull,
+    invalidState,
+    invalidLength,
+    failed // Any other error
+};
+
+const char* storageErrorToStr(EmStorageError error);
+
+// A storage entry (see 'EmStorageVisitor')
+struct EmStorageEntry {
+    const char* key;
+    bool isString;
+    const void* value; // Null if the backend visits the keys only
+    size_t len; // Value bytes (null terminator included for strings)
+};
+
+// Storage entries visiting callback prototype (return false to stop visiting)
+using EmStorageVisitor = bool(*)(const EmStorageEntry& entry, void* pUserData);
+
+// A chunk of a value (see 'EmStorageChunkVisitor')
+struct EmStorageChunk {
+    const void* data;
+    size_t len;
+    size_t offset; // Chunk offset within the value
+    size_t size;   // Value bytes (null terminator included for strings)
+};
+
+// Value chunks reading callback prototype (return false to stop reading)
+using EmStorageChunkVisitor = bool(*)(const EmStorageChunk& chunk, void* pUserData);
+
+// The storage backend interface (see 'EmStorage').
+//
+// Entries are blobs or strings identified by a key within a namespace
+// (i.e. NVS semantics): keys and namespaces are up to 15 chars and getting
+// an entry with the other type fails with 'typeMismatch'.
+//
+// IMPLEMENTATION NOTES:
+// ---------------------
+//   'getBlob' and 'getString' with a null buffer set 'len' to the entry size
+//   (null terminator included for strings), otherwise 'len' is the buffer
+//   size and it is set to the read size.
+//
+//   Writes might not be persisted until 'commit' is called.
+//
+class EmStorageBackend {
+public:
+    virtual ~EmStorageBackend() = default;
+
+    // Opens the 'name' namespace
+    virtual EmStorageError open(const char* name) = 0;
+    virtual void close() = 0;
+    virtual bool isOpen() const = 0;
+
+    virtual EmStorageError setBlob(const char* key, const void* value, size_t len) = 0;
+    virtual EmStorageError setString(const char* key, const char* value) = 0;
+    virtual EmStorageError getBlob(const char* key, void* buf, size_t& len) = 0;
+    virtual EmStorageError getString(const char* key, char* buf, size_t& len) = 0;
+
+    // Reads the 'key' value in chunks of up to 'bufSize' bytes (i.e. 'buf' is
+    // the chunk buffer), backends keeping values in memory visit them in place.
+    // By default the whole value is read into 'buf' ('invalidLength' if it 
+    // does not fit).
+    virtual EmStorageError getChunks(const char* key,
+                                     bool isString,
+                                     void* buf,
+                                     size_t bufSize,
+                                     EmStorageChunkVisitor visitor,
+                                     void* pUserData = nullptr);
+
+    // Erases the 'key' entry ('notFound' if missing)
+    virtual EmStorageError erase(const char* key) = 0;
+
+    // Erases all the entries of the namespace
+    virtual EmStorageError eraseAll() = 0;
+    virtual EmStorageError commit() = 0;
+
+    // Commits the writes and waits for them (i.e. backends deferring writes
+    // or commits write them first)
+    virtual EmStorageError flush() {
+        return commit();
+    }
+
+    // Gets the number of free entries (see 'EM_STORAGE_ENTRY_SIZE')
+    virtual EmStorageError freeEntries(size_t& entries) const = 0;
+
+    // Visits the namespace entries (the values might not be provided).
+    // Returns the number of visited entries (zero if not supported).
+    // NOTE: entries must not be written while visiting them
+    virtual uint32_t forEach(EmStorageVisitor /*visitor*/, void* /*pUserData*/ = nullptr) {
+        return 0;
+    }
+};
+
+#ifdef EM_NVS
+
+// The ESP32 NVS storage backend
+class EmNvsStorageBackend: public EmStorageBackend {
+public:
+    EmNvsStorageBackend()
+     : m_handle(0),
+       m_open(false) {
+        m_namespace[0] = 0;
+    }
+
+    virtual ~EmNvsStorageBackend() {
+        close();
+    }
+
+    virtual EmStorageError open(const char* name) override;
+    virtual void close() override;
+
+    virtual bool isOpen() const override {
+        return m_open;
+    }
+
+    virtual EmStorageError setBlob(const char* key, const void* value, size_t len) override;
+    virtual EmStorageError setString(const char* key, const char* value) override;
+    virtual EmStorageError getBlob(const char* key, void* buf, size_t& len) override;
+    virtual EmStorageError getString(const char* key, char* buf, size_t& len) override;
+    virtual EmStorageError erase(const char* key) override;
+    virtual EmStorageError eraseAll() override;
+    virtual EmStorageError commit() override;
+    virtual EmStorageError freeEntries(size_t& entries) const override;
+
+    // Visits the namespace keys (i.e. values are not provided)
+    virtual uint32_t forEach(EmStorageVisitor visitor, void* pUserData = nullptr) override;
+
+protected:
+    static EmStorageError error_(esp_err_t err);
+
+    nvs_handle_t m_handle;
+    bool m_open;
+    char m_namespace[EM_STORAGE_MAX_KEY_LEN+1];
+};
+
+#endif // EM_NVS
+
+// The storage backend on a memory area.
+//
+// Entries are kept one after the other with the same semantics of NVS, a
+// memory area can hold several namespaces and can be shared by several
+// backends (i.e. one per namespace, within the same thread).
+// Memory is formatted at 'open' if it does not hold a valid storage and
+// entries are checked: they are truncated at the first invalid one.
+class EmMemStorageBackend: public EmStorageBackend {
+public:
+    EmMemStorageBackend(void* memory, size_t size)
+     : m_pMemory(static_cast<uint8_t*>(memory)),
+       m_size(size),
+       m_open(false) {
+        m_namespace[0] = 0;
+    }
+
+    virtual ~EmMemStorageBackend() = default;
+
+    virtual EmStorageError open(const char* name) override;
+    virtual void close() override;
+
+    virtual bool isOpen() const override {
+        return m_open;
+    }
+
+    virtual EmStorageError setBlob(const char* key, const void* value, size_t len) override;
+    virtual EmStorageError setString(const char* key, const char* value) override;
+    virtual EmStorageError getBlob(const char* key, void* buf, size_t& len) override;
+    virtual EmStorageError getString(const char* key, char* buf, size_t& len) override;
+
+    // Visits the value in place (i.e. a single chunk, 'buf' is not used)
+    virtual EmStorageError getChunks(const char* key,
+                                     bool isString,
+                                     void* buf,
+                                     size_t bufSize,
+                                     EmStorageChunkVisitor visitor,
+                                     void* pUserData = nullptr) override;
+
+    virtual EmStorageError erase(const char* key) override;
+    virtual EmStorageError eraseAll() override;
+    virtual EmStorageError commit() override;
+    virtual EmStorageError freeEntries(size_t& entries) const override;
+
+    // Visits the namespace entries (i.e. in writing order)
+    virtual uint32_t forEach(EmStorageVisitor visitor, void* pUserData = nullptr) override;
+
+    // The used memory bytes (i.e. all namespaces, entries headers included)
+    size_t usedBytes() const {
+        return m_pMemory != nullptr ? header_()->used : 0;
+    }
+
+protected:
+    // Memory header
+    struct Header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t reserved;
+        uint32_t used; // Used bytes (header excluded)
+    };
+
+    // Stored entry header (value bytes follow)
+    struct Entry {
+        uint32_t size; // Entry size (header included, 4 bytes aligned)
+        uint32_t len;  // Value bytes
+        uint8_t type;
+        uint8_t reserved[3];
+        char ns[EM_STORAGE_MAX_KEY_LEN+1];
+        char key[EM_STORAGE_MAX_KEY_LEN+1];
+    };
+
+    enum class EntryType: uint8_t {
+        blob = 1,
+        string,
+        removed // A removed key (i.e. write-back cache tombstone)
+    };
+
+    Header* header_() const {
+        return reinterpret_cast<Header*>(m_pMemory);
+    }
+
+    uint8_t* entries_() const {
+        return m_pMemory + sizeof(Header);
+    }
+
+    static uint8_t* value_(Entry* pEntry) {
+        return reinterpret_cast<uint8_t*>(pEntry + 1);
+    }
+
+    // Truncates the entries at the first invalid one (i.e. bad size, length
+    // or names). Returns false if entries were truncated.
+    bool validate_();
+    Entry* find_(const char* key) const;
+    void remove_(Entry* pEntry);
+    EmStorageError set_(const char* key, EntryType type, const void* value, size_t len);
+    EmStorageError get_(const char* key, EntryType type, void* buf, size_t& len) const;
+
+    uint8_t* m_pMemory;
+    size_t m_size;
+    bool m_open;
+    char m_namespace[EM_STORAGE_MAX_KEY_LEN+1];
+};
+
+#ifdef __linux__
+
+// The storage backend on a memory mapped file (i.e. a storage surviving
+// the process on the host).
+class EmFileStorageBackend: public EmMemStorageBackend {
+public:
+    EmFileStorageBackend(const char* path, size_t size)
+     : EmMemStorageBackend(nullptr, size),
+       m_path(path) {}
+
+    virtual ~EmFileStorageBackend() {
+        close();
+    }
+
+    // Maps the file (it is created if it does not exist) and opens the namespace
+    virtual EmStorageError open(const char* name) override;
+
+    // Unmaps the file
+    virtual void close() override;
+
+    // Flushes the mapped memory to the file
+    virtual EmStorageError commit() override;
+
+protected:
+    const char* m_path;
+};
+
+#endif // __linux__
+
+#endif // __EM_STORAGE_BACKEND__H_
@@ -0,0 +1,457 @@
+#ifndef __EM_STORAGE_CACHE__H_
+#define __EM_STORAGE_CACHE__H_
+
+#include <string.h>
+
+#include "em_defs.h"
+#include "em_storage_backend.h"
+
+// The write-back cache storage backend.
+//
+// Writes are kept in a RAM cache (i.e. repeated writes of the same key just
+// replace the cached value) and are written all together to the backend,
+// followed by a single backend commit, when:
+//  - 'flushIntervalMs' elapsed since the first cached write (see 'update')
+//  - the cache used bytes reach 'flushBytes' (zero means cache full) at commit
+//  - 'flush' or 'close' are called (i.e. 'EmStorage::end')
+// Reads get the cached values first. Removals are cached as well (i.e. a
+// removed key entry) so that the backend gets all the changes in order.
+//
+// The cache memory holds entries as 'EmMemStorageBackend' does (i.e. 44 bytes
+// header for each entry), writes not fitting the cache go to the backend.
+//
+// NOTE: cached writes are lost on power loss or reset (i.e. call 'flush'
+//       before restarting or going to deep sleep)
+class EmWriteBackStorageBackend: public EmStorageBackend, public EmUpdatable {
+public:
+    EmWriteBackStorageBackend(EmStorageBackend& backend,
+                              void* cacheMemory,
+                              size_t cacheSize,
+                              uint32_t flushIntervalMs = 5000,
+                              size_t flushBytes = 0)
+     : m_backend(backend),
+       m_cache(cacheMemory, cacheSize),
+       m_flushIntervalMs(flushIntervalMs),
+       m_flushBytes(flushBytes),
+       m_dirty(false),
+       m_dirtyMs(0),
+       m_uncommitted(false),
+       m_writes(0),
+       m_backendWrites(0),
+       m_backendCommits(0),
+       m_flushError(EmStorageError::none) {}
+
+    virtual ~EmWriteBackStorageBackend() {
+        close();
+    }
+
+    virtual EmStorageError open(const char* name) override;
+
+    // Flushes the cache and closes the backend.
+    // NOTE: if the flush fails nothing is closed (i.e. cached entries are 
+    //       kept and 'isOpen' is still true, see 'getFlushError')
+    virtual void close() override;
+
+    virtual bool isOpen() const override {
+        return m_backend.isOpen();
+    }
+
+    virtual EmStorageError setBlob(const char* key, const void* value, size_t len) override;
+    virtual EmStorageError setString(const char* key, const char* value) override;
+    virtual EmStorageError getBlob(const char* key, void* buf, size_t& len) override;
+    virtual EmStorageError getString(const char* key, char* buf, size_t& len) override;
+    virtual EmStorageError getChunks(const char* key,
+                                     bool isString,
+                                     void* buf,
+                                     size_t bufSize,
+                                     EmStorageChunkVisitor visitor,
+                                     void* pUserData = nullptr) override;
+    virtual EmStorageError erase(const char* key) override;
+    virtual EmStorageError eraseAll() override;
+
+    // Flushes the cache if 'flushBytes' are reached (i.e. deferred commit)
+    virtual EmStorageError commit() override;
+
+    virtual EmStorageError freeEntries(size_t& entries) const override {
+        return m_backend.freeEntries(entries);
+    }
+
+    // Flushes the cache and visits the backend entries
+    virtual uint32_t forEach(EmStorageVisitor visitor, void* pUserData = nullptr) override {
+        flush();
+        return m_backend.forEach(visitor, pUserData);
+    }
+
+    // Writes the cached entries to the backend and commits them
+    virtual EmStorageError flush() override;
+
+    // Flushes the cache once 'flushIntervalMs' elapsed
+    virtual void update() override;
+
+    // Returns true if there are writes not written to the backend
+    bool isDirty() const {
+        return m_dirty;
+    }
+
+    // The last flush error (i.e. 'none' if it succeeded)
+    EmStorageError getFlushError() const {
+        return m_flushError;
+    }
+
+    // The writes received
+    uint32_t getWrites() const {
+        return m_writes;
+    }
+
+    // The writes done to the backend
+    uint32_t getBackendWrites() const {
+        return m_backendWrites;
+    }
+
+    // The commits done to the backend
+    uint32_t getBackendCommits() const {
+        return m_backendCommits;
+    }
+
+protected:
+    // The cache memory: the cached writes and removals in writing order
+    class Cache: public EmMemStorageBackend {
+    public:
+        Cache(void* memory, size_t size)
+         : EmMemStorageBackend(memory, size) {}
+
+        // Caches the key removal (i.e. the key entry is replaced)
+        virtual EmStorageError erase(const char* key) override;
+
+        // Returns true if the key removal is cached
+        bool isRemoved(const char* key) const;
+
+        // Writes the cached entries to the backend (i.e. in writing order)
+        // and returns the first error
+        EmStorageError writeTo(EmStorageBackend& backend, uint32_t& writes) const;
+    };
+
+    // Entry writer (i.e. 'setBlob', 'setString' or 'erase' on a backend)
+    using Writer = EmStorageError(*)(EmStorageBackend& backend,
+                                     const char* key,
+                                     const void* value,
+                                     size_t len);
+
+    EmStorageError set_(const char* key, const void* value, size_t len, Writer write);
+    EmStorageError commit_();
+
+    EmStorageBackend& m_backend;
+    Cache m_cache;
+    uint32_t m_flushIntervalMs;
+    size_t m_flushBytes;
+    bool m_dirty;
+    uint32_t m_dirtyMs; // First cached write time
+    bool m_uncommitted; // Backend written and not committed
+    uint32_t m_writes;
+    uint32_t m_backendWrites;
+    uint32_t m_backendCommits;
+    EmStorageError m_flushError;
+};
+
+// The read-through cache storage backend.
+//
+// The last read entries up to 'valueSize' bytes are kept in 'size' RAM slots
+// looked up by key hash, entries are read from the backend only when not
+// cached (i.e. missing keys are cached as well). Writes go to the backend
+// and update the cache (i.e. reads always get the last written values).
+// When all slots are used the least recently used one is replaced.
+//
+// With 'preload' all the namespace entries are read at 'open' (i.e. the
+// backend must support 'forEach').
+//
+// NOTE: writes done bypassing this object are not seen
+template <uint8_t size, uint16_t valueSize = 32>
+class EmReadCacheStorageBackend: public EmStorageBackend {
+public:
+    EmReadCacheStorageBackend(EmStorageBackend& backend, bool preload = false)
+     : m_backend(backend),
+       m_preload(preload),
+       m_tick(0),
+       m_hits(0),
+       m_misses(0) {
+        clear_();
+    }
+
+    virtual ~EmReadCacheStorageBackend() = default;
+
+    virtual EmStorageError open(const char* name) override {
+        EmStorageError err = m_backend.open(name);
+        clear_();
+        if (err == EmStorageError::none && m_preload) {
+            m_backend.forEach(preloadEntry_, this);
+        }
+        return err;
+    }
+
+    virtual void close() override {
+        m_backend.close();
+        clear_();
+    }
+
+    virtual bool isOpen() const override {
+        return m_backend.isOpen();
+    }
+
+    virtual EmStorageError setBlob(const char* key, const void* value, size_t len) override {
+        EmStorageError err = m_backend.setBlob(key, value, len);
+        written_(key, err, Type::blob, value, len);
+        return err;
+    }
+
+    virtual EmStorageError setString(const char* key, const char* value) override {
+        EmStorageError err = m_backend.setString(key, value);
+        written_(key, err, Type::string, value, value != nullptr ? strlen(value) + 1 : 0);
+        return err;
+    }
+
+    virtual EmStorageError getBlob(const char* key, void* buf, size_t& len) override {
+        return get_(key, Type::blob, buf, len);
+    }
+
+    virtual EmStorageError getString(const char* key, char* buf, size_t& len) override {
+        return get_(key, Type::string, buf, len);
+    }
+
+    // Cached values are visited in place, the others are read by the backend
+    virtual EmStorageError getChunks(const char* key,
+                                     bool isString,
+                                     void* buf,
+                                     size_t bufSize,
+                                     EmStorageChunkVisitor visitor,
+                                     void* pUserData = nullptr) override {
+        Slot* pSlot = nullptr;
+        if (key != nullptr && strlen(key) <= EM_STORAGE_MAX_KEY_LEN && isOpen()) {
+            pSlot = find_(key, hash_(key));
+        }
+        if (pSlot == nullptr || pSlot->type == Type::tooBig) {
+            m_misses++;
+            return m_backend.getChunks(key, isString, buf, bufSize, visitor, pUserData);
+        }
+        m_hits++;
+        if (pSlot->type == Type::missing) {
+            return EmStorageError::notFound;
+        }
+        if (pSlot->type != (isString ? Type::string : Type::blob)) {
+            return EmStorageError::typeMismatch;
+        }
+        EmStorageChunk chunk;
+        chunk.data = pSlot->value;
+        chunk.len = pSlot->len;
+        chunk.offset = 0;
+        chunk.size = pSlot->len;
+        visitor(chunk, pUserData);
+        return EmStorageError::none;
+    }
+
+    virtual EmStorageError erase(const char* key) override {
+        EmStorageError err = m_backend.erase(key);
+        if (key != nullptr && strlen(key) <= EM_STORAGE_MAX_KEY_LEN) {
+            uint32_t hash = hash_(key);
+            Slot* pSlot = find_(key, hash);
+            if (pSlot == nullptr) {
+                pSlot = alloc_(key, hash);
+            }
+            // Missing if erased, read it again otherwise
+            pSlot->type = err == EmStorageError::none || err == EmStorageError::notFound ?
+                          Type::missing : Type::none;
+        }
+        return err;
+    }
+
+    virtual EmStorageError eraseAll() override {
+        clear_();
+        return m_backend.eraseAll();
+    }
+
+    virtual EmStorageError commit() override {
+        return m_backend.commit();
+    }
+
+    virtual EmStorageError flush() override {
+        return m_backend.flush();
+    }
+
+    virtual EmStorageError freeEntries(size_t& entries) const override {
+        return m_backend.freeEntries(entries);
+    }
+
+    virtual uint32_t forEach(EmStorageVisitor visitor, void* pUserData = nullptr) override {
+        return m_backend.forEach(visitor, pUserData);
+    }
+
+    // The reads served by the cache
+    uint32_t getHits() const {
+        return m_hits;
+    }
+
+    // The reads done by the backend
+    uint32_t getMisses() const {
+        return m_misses;
+    }
+
+protected:
+    enum class Type: uint8_t {
+        none = 0,  // Slot not used
+        missing,   // Key not found
+        tooBig,    // Value bigger than 'valueSize' (i.e. read from backend)
+        blob,
+        string
+    };
+
+    struct Slot {
+        uint32_t hash;
+        uint32_t lastUse;
+        Type type;
+        uint16_t len;
+        char key[EM_STORAGE_MAX_KEY_LEN+1];
+        uint8_t value[valueSize];
+    };
+
+    static uint32_t hash_(const char* key) {
+        return emHash32n(key, EM_STORAGE_MAX_KEY_LEN);
+    }
+
+    void clear_() {
+        for (uint8_t i=0; i < size; i++) {
+            m_slots[i].type = Type::none;
+        }
+    }
+
+    Slot* find_(const char* key, uint32_t hash) {
+        for (uint8_t i=0; i < size; i++) {
+            Slot& slot = m_slots[i];
+            if (slot.hash == hash && slot.type != Type::none && strcmp(slot.key, key) == 0) {
+                slot.lastUse = ++m_tick;
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    // Gets a slot for a new key (i.e. a free slot or the least recently used one)
+    Slot* alloc_(const char* key, uint32_t hash) {
+        Slot* pSlot = &m_slots[0];
+        for (uint8_t i=0; i < size && pSlot->type != Type::none; i++) {
+            Slot& slot = m_slots[i];
+            if (slot.type == Type::none || slot.lastUse - pSlot->lastUse > 0x80000000UL) {
+                pSlot = &slot;
+            }
+        }
+        pSlot->hash = hash;
+        pSlot->lastUse = ++m_tick;
+        strncpy(pSlot->key, key, EM_STORAGE_MAX_KEY_LEN);
+        pSlot->key[EM_STORAGE_MAX_KEY_LEN] = 0;
+        return pSlot;
+    }
+
+    // Keeps the written value (if cachable)
+    void set_(const char* key, Type type, const void* value, size_t len) {
+        uint32_t hash = hash_(key);
+        Slot* pSlot = find_(key, hash);
+        if (pSlot == nullptr) {
+            pSlot = alloc_(key, hash);
+        }
+        if (len > valueSize) {
+            pSlot->type = Type::tooBig;
+            return;
+        }
+        pSlot->type = type;
+        pSlot->len = static_cast<uint16_t>(len);
+        memcpy(pSlot->value, value, len);
+    }
+
+    void written_(const char* key, EmStorageError err, Type type, const void* value, size_t len) {
+        if (key == nullptr || strlen(key) > EM_STORAGE_MAX_KEY_LEN) {
+            return;
+        }
+        if (err == EmStorageError::none) {
+            set_(key, type, value, len);
+            return;
+        }
+        // Failed write: lets read it again
+        Slot* pSlot = find_(key, hash_(key));
+        if (pSlot != nullptr) {
+            pSlot->type = Type::none;
+        }
+    }
+
+    EmStorageError get_(const char* key, Type type, void* buf, size_t& len) {
+        if (key == nullptr || strlen(key) > EM_STORAGE_MAX_KEY_LEN || !isOpen()) {
+            return backendGet_(key, type, buf, len);
+        }
+        uint32_t hash = hash_(key);
+        Slot* pSlot = find_(key, hash);
+        if (pSlot == nullptr) {
+            m_misses++;
+            pSlot = alloc_(key, hash);
+            // Read it into the slot
+            size_t slotLen = valueSize;
+            EmStorageError err = backendGet_(key, type, pSlot->value, slotLen);
+            if (err == EmStorageError::notFound) {
+                pSlot->type = Type::missing;
+                return err;
+            }
+            if (err != EmStorageError::none) {
+                // Not cachable (e.g. bigger than 'valueSize' or a type mismatch)
+                pSlot->type = err == EmStorageError::invalidLength ? Type::tooBig : Type::none;
+                return backendGet_(key, type, buf, len);
+            }
+            pSlot->type = type;
+            pSlot->len = static_cast<uint16_t>(slotLen);
+        } else if (pSlot->type == Type::tooBig) {
+            m_misses++;
+            return backendGet_(key, type, buf, len);
+        } else {
+            m_hits++;
+        }
+        if (pSlot->type == Type::missing) {
+            return EmStorageError::notFound;
+        }
+        if (pSlot->type != type) {
+            return EmStorageError::typeMismatch;
+        }
+        if (buf == nullptr) {
+            len = pSlot->len;
+            return EmStorageError::none;
+        }
+        if (len < pSlot->len) {
+            return EmStorageError::invalidLength;
+        }
+        len = pSlot->len;
+        memcpy(buf, pSlot->value, len);
+        return EmStorageError::none;
+    }
+
+    EmStorageError backendGet_(const char* key, Type type, void* buf, size_t& len) {
+        return type == Type::string ?
+            m_backend.getString(key, static_cast<char*>(buf), len) :
+            m_backend.getBlob(key, buf, len);
+    }
+
+    static bool preloadEntry_(const EmStorageEntry& entry, void* pUserData) {
+        EmReadCacheStorageBackend* pThis = static_cast<EmReadCacheStorageBackend*>(pUserData);
+        Type type = entry.isString ? Type::string : Type::blob;
+        if (entry.value != nullptr) {
+            pThis->set_(entry.key, type, entry.value, entry.len);
+        } else {
+            size_t len = 0;
+            pThis->get_(entry.key, type, nullptr, len);
+        }
+        // Stop once the cache is full (i.e. slots are used in order)
+        return pThis->m_slots[size-1].type == Type::none;
+    }
+
+    EmStorageBackend& m_backend;
+    bool m_preload;
+    uint32_t m_tick; // Slots use counter
+    uint32_t m_hits;
+    uint32_t m_misses;
+    Slot m_slots[size];
+};
+
+#endif // __EM_STORAGE_CACHE__H_
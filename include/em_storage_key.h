@@ -0,0 +1,134 @@
+#ifndef __EM_STORAGE_KEY__H_
+#define __EM_STORAGE_KEY__H_
+
+#include <string.h>
+
+#include "em_defs.h"
+
+// The first char of the hashed storage keys (i.e. reserved for them)
+#define EM_STORAGE_KEY_PREFIX '#'
+
+// The hashed storage keys length (i.e. prefix and 6 chars of the hash)
+#define EM_STORAGE_KEY_LEN 7
+
+// The hashed storage key of a logical name.
+//
+// Logical names have any length (e.g. "wifi.station.password"), the key
+// stored is made of the prefix and the FNV-1a hash of the name in base 64
+// (e.g. "#k3Xz0B"): it fits the 15 chars limit of NVS keys and keys differ
+// by their first chars (i.e. short string compares).
+// Keys are built at compile time and converted to 'const char*', they can
+// be used wherever a key is expected:
+//
+//   constexpr EmStorageKey ssidKey("wifi.station.ssid");
+//   constexpr EmStorageKey passwordKey("wifi.station.password");
+//   constexpr EmStorageKey wifiKeys[] = { ssidKey, passwordKey };
+//   static_assert(emStorageKeysUnique(wifiKeys), "storage keys collision");
+//
+//   storage.putString(ssidKey, ssid);
+//   storage.setKeys(wifiKeys); // Logs the names instead of the keys
+//
+// NOTE: the name is not copied (i.e. a string literal) and keys must
+//       outlive their uses (i.e. no temporaries, see 'operator const char*')
+class EmStorageKey {
+public:
+    constexpr EmStorageKey(const char* name)
+     : EmStorageKey(name, emHash32(name)) {}
+
+    constexpr const char* name() const {
+        return m_name;
+    }
+
+    constexpr uint32_t hash() const {
+        return m_hash;
+    }
+
+    const char* key() const {
+        return m_key;
+    }
+
+    // NOTE: the key chars are within this object, temporaries are not
+    //       converted (i.e. the key would dangle once stored, e.g. by
+    //       'EmStorageValue')
+    operator const char*() const & {
+        return m_key;
+    }
+
+    operator const char*() const && = delete;
+
+    constexpr bool operator==(const EmStorageKey& other) const {
+        return m_hash == other.m_hash;
+    }
+
+    constexpr bool operator!=(const EmStorageKey& other) const {
+        return m_hash != other.m_hash;
+    }
+
+    // Returns true if 'key' is a hashed key (i.e. not a plain key)
+    static bool isHashed(const char* key) {
+        return key != nullptr && key[0] == EM_STORAGE_KEY_PREFIX &&
+               strlen(key) == EM_STORAGE_KEY_LEN;
+    }
+
+protected:
+    constexpr EmStorageKey(const char* name, uint32_t hash)
+     : m_name(name),
+       m_hash(hash),
+       m_key{ EM_STORAGE_KEY_PREFIX,
+              digit_(hash, 0),
+              digit_(hash, 1),
+              digit_(hash, 2),
+              digit_(hash, 3),
+              digit_(hash, 4),
+              digit_(hash, 5),
+              0 } {}
+
+    // The 'index' base 64 digit of the hash (i.e. [0-9A-Za-z-_])
+    static constexpr char digit_(uint32_t hash, uint8_t index) {
+        return base64_(static_cast<uint8_t>((hash >> (6 * index)) & 0x3F));
+    }
+
+    static constexpr char base64_(uint8_t value) {
+        return value < 10 ? static_cast<char>('0' + value) :
+               value < 36 ? static_cast<char>('A' + value - 10) :
+               value < 62 ? static_cast<char>('a' + value - 36) :
+               value == 62 ? '-' : '_';
+    }
+
+    const char* m_name;
+    uint32_t m_hash;
+    char m_key[EM_STORAGE_KEY_LEN+1];
+};
+
+// NOTE: recursion on keys and on the pairs of a key (i.e. C++11 'constexpr'
+//       functions and a recursion depth of twice the keys count)
+constexpr bool emStorageKeyUnique_(const EmStorageKey* keys, size_t count, size_t i, size_t j) {
+    return j >= count ? true :
+           keys[i] != keys[j] && emStorageKeyUnique_(keys, count, i, j + 1);
+}
+
+constexpr bool emStorageKeysUnique_(const EmStorageKey* keys, size_t count, size_t i) {
+    return i >= count ? true :
+           emStorageKeyUnique_(keys, count, i, i + 1) && emStorageKeysUnique_(keys, count, i + 1);
+}
+
+// Returns true if the keys hashes are unique (i.e. a 'static_assert' checks
+// the keys of a namespace at compile time, see 'EmStorageKey')
+template<size_t N>
+constexpr bool emStorageKeysUnique(const EmStorageKey (&keys)[N]) {
+    return emStorageKeysUnique_(keys, N, 0);
+}
+
+// Returns the logical name of a hashed key ('key' itself if not found)
+inline const char* emStorageKeyName(const EmStorageKey* keys, size_t count, const char* key) {
+    if (keys != nullptr && EmStorageKey::isHashed(key)) {
+        for (size_t i=0; i < count; i++) {
+            if (memcmp(keys[i].key(), key, EM_STORAGE_KEY_LEN) == 0) {
+                return keys[i].name();
+            }
+        }
+    }
+    return key;
+}
+
+#endif // __EM_STORAGE_KEY__H_
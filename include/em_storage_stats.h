@@ -0,0 +1,94 @@
+#ifndef __EM_STORAGE_STATS__H_
+#define __EM_STORAGE_STATS__H_
+
+#include <string.h>
+
+#include "em_defs.h"
+
+// The latency histogram buckets: bucket zero counts the operations taking
+// less than 2 micros, bucket 'i' the ones taking [2^i, 2^(i+1)) micros and
+// the last one all the slower ones (i.e. 32 ms and more)
+#define EM_STORAGE_LATENCY_BUCKETS 16
+
+// The operations latency (i.e. a log2 histogram of micros)
+struct EmStorageLatency {
+    uint32_t count;
+    uint64_t micros;    // Total time
+    uint32_t maxMicros;
+    uint32_t histogram[EM_STORAGE_LATENCY_BUCKETS];
+
+    void reset() {
+        memset(this, 0, sizeof(*this));
+    }
+
+    void add(uint32_t elapsedUs) {
+        uint8_t bucket = 0;
+        for (uint32_t us = elapsedUs; us >= 2 && bucket < EM_STORAGE_LATENCY_BUCKETS-1; us >>= 1) {
+            bucket++;
+        }
+        count++;
+        micros += elapsedUs;
+        if (elapsedUs > maxMicros) {
+            maxMicros = elapsedUs;
+        }
+        histogram[bucket]++;
+    }
+
+    uint32_t averageMicros() const {
+        return count != 0 ? static_cast<uint32_t>(micros / count) : 0;
+    }
+
+    // The 'percent' percentile (e.g. 99) upper bound (i.e. the end of its
+    // bucket, 'maxMicros' for the last bucket)
+    uint32_t percentileMicros(uint8_t percent) const {
+        uint32_t target = static_cast<uint32_t>((static_cast<uint64_t>(count) * percent + 99) / 100);
+        uint32_t sum = 0;
+        for (uint8_t i=0; i < EM_STORAGE_LATENCY_BUCKETS-1; i++) {
+            sum += histogram[i];
+            if (sum >= target && sum != 0) {
+                return MIN(static_cast<uint32_t>(2) << i, maxMicros);
+            }
+        }
+        return maxMicros;
+    }
+};
+
+// The counted storage operations (see 'EmStorageStats')
+enum class EmStorageOp: uint8_t {
+    put = 0, // 'put*' calls
+    get,     // 'get*' and 'readBytes' calls
+    remove,  // 'remove' calls
+    commit   // Backend commits (i.e. not the deferred ones)
+};
+
+#define EM_STORAGE_OPS 4
+
+// The counters of an operation
+struct EmStorageOpStats {
+    uint32_t failures;
+    uint32_t bytes; // Values bytes (null terminator included, chunked reads excluded)
+    EmStorageLatency latency;
+};
+
+// The storage counters (see 'EmStorage::getStats')
+struct EmStorageStats {
+    EmStorageOpStats ops[EM_STORAGE_OPS];
+    uint32_t deferredCommits; // Commits deferred by batches (see 'EmStorage::beginBatch')
+    uint32_t freeEntries;     // Last 'freeEntries' result
+    uint32_t minFreeEntries;
+
+    void reset() {
+        memset(this, 0, sizeof(*this));
+        minFreeEntries = 0xFFFFFFFF;
+    }
+
+    const EmStorageOpStats& op(EmStorageOp op) const {
+        return ops[static_cast<uint8_t>(op)];
+    }
+
+    EmStorageOpStats& op(EmStorageOp op) {
+        return ops[static_cast<uint8_t>(op)];
+    }
+};
+
+#endif // __EM_STORAGE_STATS__H_
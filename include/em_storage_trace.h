@@ -0,0 +1,142 @@
+#ifndef __EM_STORAGE_TRACE__H_
+#define __EM_STORAGE_TRACE__H_
+
+#include "em_defs.h"
+#include "em_storage.h"
+#include "em_storage_stats.h"
+#include "em_flash_device.h"
+
+// Trace lines writer prototype (see 'EmStorageTraceRecorder')
+using EmStorageTraceWriter = void(*)(const char* line, void* pUserData);
+
+// The storage backend recording the operations trace (see 'EmStorageTraceReplay').
+//
+// Operations are forwarded to the backend and written as text lines:
+//   "b <key> <len>" setBlob
+//   "s <key> <len>" setString (null terminator included)
+//   "B <key>"       getBlob (and blob chunks reads)
+//   "S <key>"       getString (and string chunks reads)
+//   "e <key>"       erase
+//   "E"             eraseAll
+//   "c"             commit
+//   "f"             flush
+//
+// NOTE: values are not recorded (i.e. no data in the trace), neither the
+//       values length queries (i.e. null buffer reads)
+class EmStorageTraceRecorder: public EmStorageBackend {
+public:
+    // NOTE: the backend object is not copied
+    EmStorageTraceRecorder(EmStorageBackend& backend,
+                           EmStorageTraceWriter writer,
+                           void* pUserData = nullptr)
+     : m_backend(backend),
+       m_writer(writer),
+       m_pUserData(pUserData) {}
+
+    virtual ~EmStorageTraceRecorder() = default;
+
+    virtual EmStorageError open(const char* name) override {
+        return m_backend.open(name);
+    }
+
+    virtual void close() override {
+        m_backend.close();
+    }
+
+    virtual bool isOpen() const override {
+        return m_backend.isOpen();
+    }
+
+    virtual EmStorageError setBlob(const char* key, const void* value, size_t len) override;
+    virtual EmStorageError setString(const char* key, const char* value) override;
+    virtual EmStorageError getBlob(const char* key, void* buf, size_t& len) override;
+    virtual EmStorageError getString(const char* key, char* buf, size_t& len) override;
+    virtual EmStorageError getChunks(const char* key,
+                                     bool isString,
+                                     void* buf,
+                                     size_t bufSize,
+                                     EmStorageChunkVisitor visitor,
+                                     void* pUserData = nullptr) override;
+    virtual EmStorageError erase(const char* key) override;
+    virtual EmStorageError eraseAll() override;
+    virtual EmStorageError commit() override;
+    virtual EmStorageError flush() override;
+
+    virtual EmStorageError freeEntries(size_t& entries) const override {
+        return m_backend.freeEntries(entries);
+    }
+
+    virtual uint32_t forEach(EmStorageVisitor visitor, void* pUserData = nullptr) override {
+        return m_backend.forEach(visitor, pUserData);
+    }
+
+protected:
+    void record_(char op, const char* key = nullptr, size_t len = 0, bool hasLen = false);
+
+    EmStorageBackend& m_backend;
+    EmStorageTraceWriter m_writer;
+    void* m_pUserData;
+};
+
+// The trace replay results (see 'EmStorageTraceReplay')
+struct EmStorageTraceResult {
+    uint32_t ops;         // Replayed operations
+    uint32_t failures;    // Failed operations (e.g. keys not found)
+    uint32_t skipped;     // Lines not replayed (e.g. values bigger than the buffer)
+    uint32_t micros;      // Replay time (i.e. trace parsing included)
+    uint32_t valueBytes;  // Written values bytes
+    uint32_t deviceBytes; // Written device bytes (zero if the device is not known)
+    EmStorageLatency latency[EM_STORAGE_OPS];
+
+    const EmStorageLatency& opLatency(EmStorageOp op) const {
+        return latency[static_cast<uint8_t>(op)];
+    }
+
+    uint32_t opsPerSecond() const {
+        return micros != 0 ? static_cast<uint32_t>(static_cast<uint64_t>(ops) * 1000000 / micros) : 0;
+    }
+
+    // The device bytes written for each value byte (zero if not known)
+    float writeAmplification() const {
+        return valueBytes != 0 ? static_cast<float>(deviceBytes) / valueBytes : 0;
+    }
+};
+
+// The storage benchmark replaying an operations trace (see 'EmStorageTraceRecorder').
+//
+// Each trace line is replayed by the storage (i.e. the same trace measures
+// several backends) and timed: throughput, latency percentiles and write
+// amplification (i.e. with a memory flash device) are reported.
+// Written values are filled with the operation number (i.e. values always
+// change), 'buffer' is the values buffer.
+//
+// NOTE: puts and removals do not commit (i.e. the trace has the commits),
+//       "E" lines are replayed by 'EmStorage::clear'
+class EmStorageTraceReplay {
+public:
+    // NOTE: the storage, buffer and device objects are not copied
+    EmStorageTraceReplay(EmStorage& storage,
+                         void* buffer,
+                         size_t bufferSize,
+                         const EmMemFlashDevice* pDevice = nullptr)
+     : m_storage(storage),
+       m_pBuffer(static_cast<uint8_t*>(buffer)),
+       m_bufferSize(bufferSize),
+       m_pDevice(pDevice) {}
+
+    // Replays the 'trace' lines (i.e. a null terminated text).
+    // Returns false if the storage is not initialized.
+    bool replay(const char* trace, EmStorageTraceResult& result);
+
+protected:
+    // Replays a line, returns false if the line is not valid
+    bool replayLine_(char op, const char* key, size_t len, uint32_t seq, EmStorageTraceResult& result);
+    void fill_(size_t len, uint32_t seq, bool isString);
+
+    EmStorage& m_storage;
+    uint8_t* m_pBuffer;
+    size_t m_bufferSize;
+    const EmMemFlashDevice* m_pDevice;
+};
+
+#endif // __EM_STORAGE_TRACE__H_
@@ -0,0 +1,118 @@
+#ifndef __EM_SYNC_GROUP__H_
+#define __EM_SYNC_GROUP__H_
+
+#include "em_defs.h"
+#include "em_threading.h"
+#include "em_sync_value.h"
+
+// The group of synchronized values that are synchronized only when needed.
+//
+// The group keeps a dirty bit for each value: values set it through their
+// change notifications (see 'EmSyncItem::notifyChanged') and each pass
+// scans the dirty bits word by word synchronizing only the dirty values
+// (and the values that must be polled, see 'EmSyncValueBase::isPolled').
+//
+// Values waiting to retry a failed write are not synchronized until the
+// earliest retry is due (see 'EmSyncRetryPolicy').
+//
+// If a batch object is provided (e.g. the 'EmStorage' the values write to)
+// all the writes of a pass are done within a single batch.
+//
+// NOTE: a value must belong to a single group
+template <uint16_t size>
+class EmSyncGroup: public EmUpdatable {
+public:
+    EmSyncGroup(EmSyncValueBase* values[], EmSyncBatch* pBatch = nullptr)
+     : m_pBatch(pBatch),
+       m_anyWaiting(false),
+       m_wakeAtMs(0) {
+        for (uint16_t w=0; w < c_words; w++) {
+            m_dirty[w] = 0;
+            m_polled[w] = 0;
+            m_waiting[w] = 0;
+        }
+        for (uint16_t i=0; i < size; i++) {
+            m_values[i] = values[i];
+            uint32_t mask = 1UL << (i % 32);
+            m_values[i]->_setGroup(&m_dirty[i / 32], mask);
+            // First pass synchronizes all the values
+            m_dirty[i / 32] |= mask;
+            if (m_values[i]->isPolled()) {
+                m_polled[i / 32] |= mask;
+            }
+        }
+    }
+
+    // Synchronizes the dirty values.
+    // Returns false if at least one value synchronization failed.
+    bool doSync() {
+        bool res = true;
+        bool inBatch = false;
+        // Earliest write retry due? Lets check all the waiting values
+        bool wake = m_anyWaiting && static_cast<int32_t>(millis() - m_wakeAtMs) >= 0;
+        if (wake) {
+            m_anyWaiting = false;
+        }
+        for (uint16_t w=0; w < c_words; w++) {
+            uint32_t bits = emExchange(m_dirty[w], 0) | m_polled[w];
+            if (wake) {
+                bits |= m_waiting[w];
+                m_waiting[w] = 0;
+            }
+            while (bits != 0) {
+                if (!inBatch && m_pBatch != nullptr) {
+                    m_pBatch->beginBatch();
+                    inBatch = true;
+                }
+                uint16_t i = w*32 + __builtin_ctzl(bits);
+                // NOTE: a value not synchronized will notify itself again
+                if (!m_values[i]->doSync()) {
+                    res = false;
+                }
+                if (m_values[i]->isWaitingRetry()) {
+                    wait_(w, bits & (~bits + 1), m_values[i]->retryAtMs());
+                }
+                bits &= bits - 1;
+            }
+        }
+        if (inBatch) {
+            m_pBatch->endBatch();
+        }
+        return res;
+    }
+
+    virtual void update() override {
+        doSync();
+    }
+
+    // Returns true if no value has to be synchronized
+    bool isIdle() const {
+        for (uint16_t w=0; w < c_words; w++) {
+            if ((m_dirty[w] | m_polled[w]) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+protected:
+    static const uint16_t c_words = (size + 31) / 32;
+
+    void wait_(uint16_t word, uint32_t mask, uint32_t retryAtMs) {
+        m_waiting[word] |= mask;
+        if (!m_anyWaiting || static_cast<int32_t>(retryAtMs - m_wakeAtMs) < 0) {
+            m_wakeAtMs = retryAtMs;
+            m_anyWaiting = true;
+        }
+    }
+
+    EmSyncValueBase* m_values[size];
+    EmSyncBatch* m_pBatch;
+    ts_uint32 m_dirty[c_words];
+    uint32_t m_polled[c_words];
+    uint32_t m_waiting[c_words];
+    bool m_anyWaiting;
+    uint32_t m_wakeAtMs;
+};
+
+#endif // __EM_SYNC_GROUP__H_
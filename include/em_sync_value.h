@@ -7,7 +7,10 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <Arduino.h>
+
 #include "em_defs.h"
+#include "em_threading.h"
 
 // The get methods result.
 enum class EmGetValueResult: uint8_t {    
@@ -27,13 +30,21 @@ enum class EmGetValueResult: uint8_t {
 //   If 'getValue' fails (i.e. returns EmGetValueResult::failed) 
 //   it SHOULD NOT change the provided 'value' content
 //
+//   'getVersion' can return a number that changes each time the value 
+//   (might have) changed: synchronization skips reading and comparing 
+//   values whose version did not change. Zero means no version support.
+//
 template <class T>
 class EmValue {
 public:
     virtual ~EmValue() = default;
 
     virtual EmGetValueResult getValue(T& /*value*/) const = 0;
-    virtual bool setValue(const T /*value*/) = 0;
+    virtual bool setValue(const T& /*value*/) = 0;
+
+    virtual uint32_t getVersion() const {
+        return 0;
+    }
 };
 
 template <class T>
@@ -43,6 +54,10 @@ public:
 
     virtual EmGetValueResult getValue(T* /*value*/) const = 0;
     virtual bool setValue(const T* /*value*/) = 0;
+
+    virtual uint32_t getVersion() const {
+        return 0;
+    }
 };
 
 // The flags assigned to each synchronized item
@@ -50,6 +65,7 @@ enum class EmSyncFlags: uint8_t {
     canRead  = 0x01, // The item can be read but read can fail and synching moves forward
     mustRead = 0x02, // The item must be read if not, then item synching stops
     canWrite = 0x04, // Item can be written
+    canNotify = 0x08, // Item notifies its changes (i.e. it is read only when notified, see 'notifyChanged')
     // Combination flags
     canReadCanWrite = 0x05,
     mustReadCanWrite = 0x06,
@@ -61,8 +77,8 @@ enum class EmSyncFlags: uint8_t {
 inline EmSyncFlags operator~ (EmSyncFlags a) { return static_cast<EmSyncFlags>(~static_cast<int>(a)); }
 inline EmSyncFlags operator|(EmSyncFlags a, EmSyncFlags b) { return static_cast<EmSyncFlags>(static_cast<int>(a) | static_cast<int>(b)); }
 inline EmSyncFlags operator&(EmSyncFlags a, EmSyncFlags b) { return static_cast<EmSyncFlags>(static_cast<int>(a) & static_cast<int>(b)); }
-inline EmSyncFlags& operator|=(EmSyncFlags& a, EmSyncFlags b) { return (EmSyncFlags&)((int&)(a) |= static_cast<int>(b)); }
-inline EmSyncFlags& operator&=(EmSyncFlags& a, EmSyncFlags b) { return (EmSyncFlags&)((int&)(a) &= static_cast<int>(b)); }
+inline EmSyncFlags& operator|=(EmSyncFlags& a, EmSyncFlags b) { return a = a | b; }
+inline EmSyncFlags& operator&=(EmSyncFlags& a, EmSyncFlags b) { return a = a & b; }
 
 enum class CheckNewValueResult: int8_t {
     noChange = 0,
@@ -71,28 +87,536 @@ enum class CheckNewValueResult: int8_t {
     pendingWrite
 };
 
+// The retry policy of the failed writes (see 'EmSyncItem::setRetryPolicy').
+//
+// The retry delay starts from 'minDelayMs' and doubles at each failure up to
+// 'maxDelayMs'. A random delay up to 'jitterPercent' of the delay is added so
+// that items failing together (e.g. an offline device) do not retry together.
+struct EmSyncRetryPolicy {
+    uint32_t minDelayMs;
+    uint32_t maxDelayMs;
+    uint8_t maxRetries; // Retries before giving up the write (zero means forever)
+    uint8_t jitterPercent;
+
+    // Returns the delay before next retry after 'failures' consecutive failures
+    uint32_t delayMs(uint8_t failures) const {
+        uint32_t delay = minDelayMs;
+        for (uint8_t i=1; i < failures && delay < maxDelayMs; i++) {
+            delay = delay > maxDelayMs/2 ? maxDelayMs : delay*2;
+        }
+        if (delay > maxDelayMs) {
+            delay = maxDelayMs;
+        }
+        if (jitterPercent != 0) {
+            uint32_t jitter = (delay/100)*jitterPercent + ((delay%100)*jitterPercent)/100;
+            delay += static_cast<uint32_t>(random(static_cast<long>(jitter) + 1));
+        }
+        return delay;
+    }
+};
+
+// The change filter of a synchronized item: a read value that differs from
+// the current one is propagated only if the filter accepts the change
+// (i.e. equality becomes "not significantly changed").
+//
+// NOTE: filters keep their own state, do not share them between items
+template <class T>
+class EmSyncFilter {
+public:
+    virtual ~EmSyncFilter() = default;
+
+    // Returns true if the change from 'currentValue' to 'newValue' has to be propagated
+    virtual bool accept(const T& currentValue, const T& newValue) = 0;
+
+    // Returns true if a rejected change has to be checked again at 'atMs' 
+    // (i.e. a trailing edge to be propagated)
+    virtual bool isPending(uint32_t& /*atMs*/) const {
+        return false;
+    }
+};
+
+// The deadband filter: changes within the greater of 'absolute' and 'relative'
+// (i.e. a fraction of the current value) are ignored.
+template <class T>
+class EmDeadbandFilter: public EmSyncFilter<T> {
+public:
+    EmDeadbandFilter(T absolute, float relative = 0.0f)
+     : m_absolute(absolute),
+       m_relative(relative) {}
+
+    virtual bool accept(const T& currentValue, const T& newValue) override {
+        T diff = newValue > currentValue ? newValue - currentValue : currentValue - newValue;
+        if (m_relative <= 0.0f) {
+            return diff > m_absolute;
+        }
+        float band = m_relative * static_cast<float>(currentValue < 0 ? -currentValue : currentValue);
+        if (band < static_cast<float>(m_absolute)) {
+            band = static_cast<float>(m_absolute);
+        }
+        return static_cast<float>(diff) > band;
+    }
+
+protected:
+    T m_absolute;
+    float m_relative;
+};
+
+// The rate filter: changes are propagated at most once every 'minIntervalMs'.
+// With 'trailingEdge' the last rejected change is propagated once the
+// interval is over (i.e. the final value is never lost).
+// An inner filter (e.g. a deadband) can be checked first.
+template <class T>
+class EmRateFilter: public EmSyncFilter<T> {
+public:
+    EmRateFilter(uint32_t minIntervalMs, 
+                 bool trailingEdge = true, 
+                 EmSyncFilter<T>* pFilter = nullptr)
+     : m_minIntervalMs(minIntervalMs),
+       m_trailingEdge(trailingEdge),
+       m_pFilter(pFilter),
+       m_lastMs(0),
+       m_propagated(false),
+       m_pending(false) {}
+
+    virtual bool accept(const T& currentValue, const T& newValue) override {
+        if (m_pFilter != nullptr && !m_pFilter->accept(currentValue, newValue)) {
+            m_pending = false;
+            return false;
+        }
+        uint32_t now = millis();
+        if (m_propagated && now - m_lastMs < m_minIntervalMs) {
+            m_pending = m_trailingEdge;
+            return false;
+        }
+        m_lastMs = now;
+        m_propagated = true;
+        m_pending = false;
+        return true;
+    }
+
+    virtual bool isPending(uint32_t& atMs) const override {
+        if (!m_pending) {
+            return false;
+        }
+        atMs = m_lastMs + m_minIntervalMs;
+        return true;
+    }
+
+protected:
+    uint32_t m_minIntervalMs;
+    bool m_trailingEdge;
+    EmSyncFilter<T>* m_pFilter;
+    uint32_t m_lastMs; // Last propagation time
+    bool m_propagated;
+    bool m_pending;
+};
+
+// The interface of the objects grouping several writes (e.g. a storage doing
+// a single commit for all the values written within a synchronization pass).
+class EmSyncBatch {
+public:
+    virtual ~EmSyncBatch() = default;
+
+    virtual void beginBatch() = 0;
+    virtual void endBatch() = 0;
+};
+
+#ifdef EM_SYNC_STATS
+
+// NOTE:
+//  Define 'EM_SYNC_STATS' to count the items reads and writes (and their
+//  latency) and the synchronizations of each value.
+
+// The synchronized item counters (see 'EmSyncItem::getStats')
+struct EmSyncItemStats {
+    uint32_t reads;          // Item reads (i.e. 'getValue' calls)
+    uint32_t readFailures;
+    uint32_t writes;         // Item writes (i.e. 'setValue' calls)
+    uint32_t writeFailures;
+    uint32_t givenUp;        // Failed writes given up (see 'EmSyncRetryPolicy::maxRetries')
+    uint64_t readMicros;     // Total reads time
+    uint32_t readMaxMicros;
+    uint64_t writeMicros;    // Total writes time
+    uint32_t writeMaxMicros;
+};
+
+// The synchronized value counters (see 'EmSyncValueBase::getStats')
+struct EmSyncValueStats {
+    uint32_t syncs;          // Synchronizations that checked the items
+    uint32_t changes;        // New values propagated to the items
+    uint32_t mustReadAborts; // Synchronizations stopped by a failed "must read" item
+    uint8_t pendingWrites;   // Items with a pending write after last synchronization
+    uint8_t maxPendingWrites;
+};
+
+#endif
+
+// The base class of all synchronized values (i.e. no matter the value type).
+class EmSyncValueBase: public EmUpdatable {
+public:
+    EmSyncValueBase()
+     : m_version(0),
+       m_dirty(true),
+       m_pGroupBits(nullptr),
+       m_groupMask(0),
+       m_waitingRetry(false),
+       m_retryAtMs(0) {
+#ifdef EM_SYNC_STATS
+        resetStats();
+#endif
+    }
+
+    virtual bool doSync() = 0;
+
+    virtual void update() override {
+        doSync();
+    }
+
+    // The number of times the synchronized value changed
+    uint32_t getVersion() const {
+        return m_version;
+    }
+
+    // Returns true if the value must be synchronized at each pass
+    // (i.e. it cannot rely on change notifications only).
+    virtual bool isPolled() const {
+        return true;
+    }
+
+    // Marks the value to be synchronized on next 'doSync' call
+    // (i.e. items call it when they change).
+    // NOTE: it can be called from any thread
+    void notifyChanged() {
+        m_dirty = true;
+        if (m_pGroupBits != nullptr) {
+            emSetBits(*m_pGroupBits, m_groupMask);
+        }
+    }
+
+    // Returns true if the value waits to retry a failed write (see 'retryAtMs')
+    bool isWaitingRetry() const {
+        return m_waitingRetry;
+    }
+
+    // The time (i.e. millis) the next failed write retry is due
+    uint32_t retryAtMs() const {
+        return m_retryAtMs;
+    }
+
+    // Asks to synchronize the value at 'atMs' (e.g. a filter trailing edge)
+    void _wakeAt(uint32_t atMs) {
+        waitRetry_(atMs);
+    }
+
+    // Sets the group dirty bit of this value (see 'EmSyncGroup')
+    void _setGroup(ts_uint32* pGroupBits, uint32_t groupMask) {
+        m_pGroupBits = pGroupBits;
+        m_groupMask = groupMask;
+    }
+
+#ifdef EM_SYNC_STATS
+    // Gets the value counters
+    EmSyncValueStats getStats() const {
+        EmSyncValueStats stats;
+        stats.syncs = m_syncs;
+        stats.changes = m_version - m_statsVersion;
+        stats.mustReadAborts = m_mustReadAborts;
+        stats.pendingWrites = m_pendingWrites;
+        stats.maxPendingWrites = m_maxPendingWrites;
+        return stats;
+    }
+
+    void resetStats() {
+        m_syncs = 0;
+        m_statsVersion = m_version;
+        m_mustReadAborts = 0;
+        m_pendingWrites = 0;
+        m_maxPendingWrites = 0;
+    }
+#endif
+
+protected:
+    // Counts a synchronization that checks the items (see 'EM_SYNC_STATS')
+    void countSync_() {
+#ifdef EM_SYNC_STATS
+        emCount(m_syncs);
+#endif
+    }
+
+    // Counts the items with a pending write (see 'EM_SYNC_STATS')
+    void countPendingWrites_(uint8_t pendingWrites) {
+#ifdef EM_SYNC_STATS
+        m_pendingWrites = pendingWrites;
+        if (pendingWrites > m_maxPendingWrites) {
+            m_maxPendingWrites = pendingWrites;
+        }
+#else
+        (void)pendingWrites;
+#endif
+    }
+
+    // A "must read" item failed to read, the synchronization cannot proceed
+    // (i.e. lets retry on next synchronization)
+    void mustReadFailed_() {
+#ifdef EM_SYNC_STATS
+        emCount(m_mustReadAborts);
+#endif
+        notifyChanged();
+    }
+
+    // Returns true if value has been notified (and clears the notification)
+    bool takeDirty_() {
+        return emExchange(m_dirty, false);
+    }
+
+    // Asks the group (if any) to synchronize this value on next pass
+    // without marking it as changed (e.g. operations still in progress)
+    void pokeGroup_() {
+        if (m_pGroupBits != nullptr) {
+            emSetBits(*m_pGroupBits, m_groupMask);
+        }
+    }
+
+    // Waits for a write retry (i.e. the earliest one if already waiting)
+    void waitRetry_(uint32_t retryAtMs) {
+        if (!m_waitingRetry || static_cast<int32_t>(retryAtMs - m_retryAtMs) < 0) {
+            m_retryAtMs = retryAtMs;
+            m_waitingRetry = true;
+        }
+    }
+
+    // Returns true if the waited write retry is due (and stops waiting)
+    bool takeRetryDue_() {
+        if (!m_waitingRetry || static_cast<int32_t>(millis() - m_retryAtMs) < 0) {
+            return false;
+        }
+        m_waitingRetry = false;
+        return true;
+    }
+
+    uint32_t m_version;
+    ts_bool m_dirty;
+    ts_uint32* m_pGroupBits;
+    uint32_t m_groupMask;
+    bool m_waitingRetry;
+    uint32_t m_retryAtMs;
+#ifdef EM_SYNC_STATS
+    ts_uint32 m_syncs;
+    ts_uint32 m_mustReadAborts;
+    uint32_t m_statsVersion; // Version at last stats reset
+    uint8_t m_pendingWrites;
+    uint8_t m_maxPendingWrites;
+#endif
+};
+
 // The item which is used in any synched value class
+//
+// Items read at each synchronization unless they have the 'canNotify' flag set:
+// those items are read only after they call 'notifyChanged' (and at first 
+// synchronization).
+//
+// Failed writes are retried at each synchronization unless a retry policy is 
+// set (see 'setRetryPolicy'): in that case retries are delayed and, once the 
+// retries are over, the write is given up calling 'onPendingWriteFailed'.
 template <class EmValueOfT, class T>
 class EmSyncItem: public EmValueOfT {
 public:
-    EmSyncItem(EmSyncFlags flags) 
-     : m_flags(flags|EmSyncFlags::_firstRead) {}
+    EmSyncItem(EmSyncFlags flags,
+               const EmSyncRetryPolicy* pRetryPolicy = nullptr) 
+     : m_flags(flags|EmSyncFlags::_firstRead),
+       m_changed(false),
+       m_pOwner(nullptr),
+       m_pRetryPolicy(pRetryPolicy),
+       m_failures(0),
+       m_retryAtMs(0),
+       m_readVersion(0),
+       m_readOwnerVersion(0),
+       m_pFilter(nullptr) {
+#ifdef EM_SYNC_STATS
+        resetStats();
+#endif
+    }
 
     virtual ~EmSyncItem() = default;
 
     virtual CheckNewValueResult checkNewValue(T& currentValue) {
-        // Item to be read?
-        if (writeOnly()) {
-            return CheckNewValueResult::noChange;
+        CheckNewValueResult res = _checkRead();
+        if (CheckNewValueResult::valueChanged != res) {
+            return res;
         }
+        // Get the value and check the operation result
+        return _read(currentValue, [this](T& value) {
+            return this->getValue(value);
+        });
+    }
+
+    virtual void doPendingWrite(T& currentValue) {
+        // Still waiting to retry?
+        if (!isRetryDue()) {
+            return;
+        }
+        _writeDone(_write(currentValue, [this](const T& value) {
+            return this->setValue(value);
+        }), currentValue);
+    }
+
+    // Checks if the item has to be read, returns:
+    //  - 'pendingWrite' if the item has a pending write
+    //  - 'noChange' if the item has not to be read
+    //  - 'valueChanged' if the item has to be read (see '_readDone')
+    CheckNewValueResult _checkRead() {
+        return _checkRead([this]() {
+            return this->getVersion();
+        });
+    }
+
+    // Same as '_checkRead' getting the item version by calling 'version'
+    // (i.e. 'getVersion' like function, see 'EmStaticSyncValue')
+    template <class Versioner>
+    CheckNewValueResult _checkRead(Versioner version) {
         // Pending write? 
         if (isPendingWrite()) { 
             return CheckNewValueResult::pendingWrite; 
         }
-        // Get the value and check the operation result
-        EmGetValueResult res = this->getValue(currentValue);
+        // Item to be read?
+        if (writeOnly()) {
+            return CheckNewValueResult::noChange;
+        }
+        // Notifying item not changed?
+        if (canNotify() && !isFirstRead() && !emExchange(m_changed, false)) {
+            return CheckNewValueResult::noChange;
+        }
+        // Neither item nor synchronized value changed since last read?
+        uint32_t itemVersion = version();
+        uint32_t ownerVersion = m_pOwner != nullptr ? m_pOwner->getVersion() : 0;
+        if (itemVersion != 0 && m_pOwner != nullptr && !isFirstRead() &&
+            itemVersion == m_readVersion && ownerVersion == m_readOwnerVersion) {
+            return CheckNewValueResult::noChange;
+        }
+        // NOTE: a changed value is read once more to confirm it
+        m_readVersion = itemVersion;
+        m_readOwnerVersion = ownerVersion;
+        return CheckNewValueResult::valueChanged;
+    }
+
+    // The time (i.e. millis) the last read value changed at the source (see 
+    // 'EmLwwSyncValue'). Zero (the default) stands for the synchronization 
+    // pass time: changes read in the same pass tie (i.e. items order wins).
+    // Items with their own timestamps should override it (same time base 
+    // for all the items).
+    virtual uint32_t getChangeTime() const {
+        return 0;
+    }
+
+    // Sets the change filter (nullptr to propagate any change).
+    // NOTE: the filter object is not copied
+    void setFilter(EmSyncFilter<T>* pFilter) {
+        m_pFilter = pFilter;
+    }
+
+    // Reads the item value by calling 'read' (i.e. 'getValue' like function)
+    // and filters the change (if any).
+    // NOTE: 'startUs' is the read start time (see '_statsTime')
+    template <class Reader>
+    CheckNewValueResult _read(T& currentValue, Reader read, uint32_t startUs = _statsTime()) {
+        if (m_pFilter == nullptr) {
+            return _readDone(_countRead(read(currentValue), startUs));
+        }
+        // Read into a copy: current value changes only if filter accepts the change
+        bool firstRead = isFirstRead();
+        T value(currentValue);
+        CheckNewValueResult res = _readDone(_countRead(read(value), startUs));
+        if (CheckNewValueResult::valueChanged != res) {
+            return res;
+        }
+        if (!firstRead && !m_pFilter->accept(currentValue, value)) {
+            // Change to be checked again later?
+            uint32_t atMs;
+            if (m_pFilter->isPending(atMs)) {
+                m_readVersion = 0;
+                m_changed = true;
+                if (m_pOwner != nullptr) {
+                    m_pOwner->_wakeAt(atMs);
+                }
+            }
+            return CheckNewValueResult::noChange;
+        }
+        currentValue = static_cast<T&&>(value);
+        return res;
+    }
+
+    // Writes the item value by calling 'write' (i.e. 'setValue' like function)
+    template <class Writer>
+    bool _write(const T& value, Writer write) {
+        uint32_t startUs = _statsTime();
+        return _countWrite(write(value), startUs);
+    }
+
+    // The operations start time (i.e. zero if 'EM_SYNC_STATS' is not defined)
+    static uint32_t _statsTime() {
+#ifdef EM_SYNC_STATS
+        return micros();
+#else
+        return 0;
+#endif
+    }
+
+    // Counts a read started at 'startUs' and returns its result
+    EmGetValueResult _countRead(EmGetValueResult res, uint32_t startUs) {
+#ifdef EM_SYNC_STATS
+        countOp_(m_reads, m_readFailures, m_readMicros, m_readMaxMicros,
+                 EmGetValueResult::failed != res, startUs);
+#else
+        (void)startUs;
+#endif
+        return res;
+    }
+
+    // Counts a write started at 'startUs' and returns its result
+    bool _countWrite(bool succeeded, uint32_t startUs) {
+#ifdef EM_SYNC_STATS
+        countOp_(m_writes, m_writeFailures, m_writeMicros, m_writeMaxMicros,
+                 succeeded, startUs);
+#else
+        (void)startUs;
+#endif
+        return succeeded;
+    }
+
+#ifdef EM_SYNC_STATS
+    // Gets the item counters
+    EmSyncItemStats getStats() const {
+        EmSyncItemStats stats;
+        stats.reads = m_reads;
+        stats.readFailures = m_readFailures;
+        stats.writes = m_writes;
+        stats.writeFailures = m_writeFailures;
+        stats.givenUp = m_givenUp;
+        stats.readMicros = m_readMicros;
+        stats.readMaxMicros = m_readMaxMicros;
+        stats.writeMicros = m_writeMicros;
+        stats.writeMaxMicros = m_writeMaxMicros;
+        return stats;
+    }
+
+    void resetStats() {
+        m_reads = 0;
+        m_readFailures = 0;
+        m_writes = 0;
+        m_writeFailures = 0;
+        m_givenUp = 0;
+        m_readMicros = 0;
+        m_readMaxMicros = 0;
+        m_writeMicros = 0;
+        m_writeMaxMicros = 0;
+    }
+#endif
+
+    // Processes the item read result
+    CheckNewValueResult _readDone(EmGetValueResult res) {
         if (EmGetValueResult::failed == res) {
-            // Get the value failed
+            // Get the value failed (i.e. read again next time)
+            m_readVersion = 0;
             if (mustRead()) {
                 // Read cannot fail!
                 return CheckNewValueResult::mustReadFailed;
@@ -110,13 +634,43 @@ public:
                CheckNewValueResult::noChange;
     }
 
-    virtual void doPendingWrite(T& currentValue) {
-        if (this->setValue(currentValue)) {
+    // Returns true if the item has to be written now
+    // (i.e. writable and not waiting to retry a failed write)
+    bool _canWrite() const {
+        return !readOnly() && (!isPendingWrite() || isRetryDue());
+    }
+
+    // Processes the item write result
+    void _writeDone(bool succeeded, const T& value) {
+        if (succeeded) {
             setFirstRead(false);
-            setPendingWrite(false);
+            writeSucceeded_();
+        } else {
+            writeFailed_(value);
         }
     }
 
+    // Sets the failed writes retry policy (nullptr to retry at each synchronization).
+    // NOTE: the policy object is not copied
+    void setRetryPolicy(const EmSyncRetryPolicy* pRetryPolicy) {
+        m_pRetryPolicy = pRetryPolicy;
+    }
+
+    bool hasRetryPolicy() const {
+        return m_pRetryPolicy != nullptr;
+    }
+
+    // Returns true if a failed write can be retried now
+    bool isRetryDue() const {
+        return m_pRetryPolicy == nullptr ||
+               static_cast<int32_t>(millis() - m_retryAtMs) >= 0;
+    }
+
+    // The time (i.e. millis) the failed write retry is due
+    uint32_t retryAtMs() const {
+        return m_retryAtMs;
+    }
+
     bool canRead() const {
         return 0 != static_cast<int>(m_flags & EmSyncFlags::canRead);
     }
@@ -133,6 +687,30 @@ public:
         return 0 == static_cast<int>(m_flags & (EmSyncFlags::canRead | EmSyncFlags::mustRead));
     }
 
+    bool canNotify() const {
+        return 0 != static_cast<int>(m_flags & EmSyncFlags::canNotify);
+    }
+
+    // Readable item that must be read at each synchronization?
+    bool isPolled() const {
+        return !writeOnly() && !canNotify();
+    }
+
+    // Notifies the item value has changed (i.e. it will be read by the 
+    // synchronized value on next synchronization).
+    // NOTE: it can be called from any thread
+    void notifyChanged() {
+        m_changed = true;
+        if (m_pOwner != nullptr) {
+            m_pOwner->notifyChanged();
+        }
+    }
+
+    // Sets the synchronized value this item belongs to
+    void _setOwner(EmSyncValueBase* pOwner) {
+        m_pOwner = pOwner;
+    }
+
     bool isPendingWrite() const {
         return 0 != static_cast<int>(m_flags & EmSyncFlags::_pendingWrite);
     }
@@ -160,58 +738,170 @@ public:
     virtual bool _setCurrentValue(const T& currentValue) {
         // Read only item?
         if (!readOnly()) {
-            if (!this->setValue(currentValue)) {
-                setPendingWrite(true);
+            // Waiting to retry a failed write? (the current value will be written then)
+            if (!_canWrite()) {
                 return false;
             }
+            return _currentValueSet(_write(currentValue, [this](const T& value) {
+                return this->setValue(value);
+            }), currentValue);
+        }
+        return true;
+    }
+
+    // Processes the result of writing a new current value (see '_setCurrentValue')
+    bool _currentValueSet(bool succeeded, const T& currentValue) {
+        if (!succeeded) {
+            writeFailed_(currentValue);
+            return false;
         }
+        writeSucceeded_();
         return true;
     }
 
 protected:
+    // Called when a failed write is given up (see 'EmSyncRetryPolicy::maxRetries')
+    virtual void onPendingWriteFailed(const T& /*value*/) {}
+
+    void writeSucceeded_() {
+        setPendingWrite(false);
+        m_failures = 0;
+    }
+
+    void writeFailed_(const T& value) {
+        setPendingWrite(true);
+        if (m_pRetryPolicy == nullptr) {
+            return;
+        }
+        if (m_failures < 0xFF) {
+            m_failures++;
+        }
+        // Retries are over?
+        if (m_pRetryPolicy->maxRetries != 0 && m_failures > m_pRetryPolicy->maxRetries) {
+#ifdef EM_SYNC_STATS
+            emCount(m_givenUp);
+#endif
+            writeSucceeded_();
+            onPendingWriteFailed(value);
+            return;
+        }
+        m_retryAtMs = millis() + m_pRetryPolicy->delayMs(m_failures);
+    }
+
+#ifdef EM_SYNC_STATS
+    static void countOp_(ts_uint32& count,
+                         ts_uint32& failures,
+                         ts_uint64& totalMicros,
+                         ts_uint32& maxMicros,
+                         bool succeeded,
+                         uint32_t startUs) {
+        uint32_t elapsed = micros() - startUs;
+        emCount(count);
+        if (!succeeded) {
+            emCount(failures);
+        }
+        emCount(totalMicros, elapsed);
+        if (elapsed > maxMicros) {
+            maxMicros = elapsed;
+        }
+    }
+#endif
+
     EmSyncFlags m_flags;
+    ts_bool m_changed;
+    EmSyncValueBase* m_pOwner;
+    const EmSyncRetryPolicy* m_pRetryPolicy;
+    uint8_t m_failures;
+    uint32_t m_retryAtMs;
+    uint32_t m_readVersion; // Item version at last read
+    uint32_t m_readOwnerVersion; // Synchronized value version at last read
+    EmSyncFilter<T>* m_pFilter;
+#ifdef EM_SYNC_STATS
+    ts_uint32 m_reads;
+    ts_uint32 m_readFailures;
+    ts_uint32 m_writes;
+    ts_uint32 m_writeFailures;
+    ts_uint32 m_givenUp;
+    ts_uint64 m_readMicros;
+    ts_uint32 m_readMaxMicros;
+    ts_uint64 m_writeMicros;
+    ts_uint32 m_writeMaxMicros;
+#endif
 };
 
 
 // This is tha base abstract class that keeps different 
 // instances of EmSyncItem synchronized.
 template <class T>
-class EmSyncValue: public EmUpdatable {
+class EmSyncValue: public EmSyncValueBase {
 public:
-    virtual bool doSync() = 0;
-
-    virtual void update() override {
-        doSync();
-    }
-
     virtual void getValue(T& value) {
         value = m_currentValue;
     }
 
+    // The current value (i.e. no copy).
+    // NOTE: to be used by the synchronization thread only
+    const T& value() const {
+        return m_currentValue;
+    }
+
 protected:
+    // Called by the synchronization when the current value changed
+    virtual void onValueChanged() {}
+
     T m_currentValue;
 };
 
 // The simple priority based values synchronization class.
 // The values order is set as the priority, the first that
 // changes sets other values.
+//
+// If no item has to be polled (i.e. all readable items have the 'canNotify' flag)
+// items are checked only after a change notification or when a failed write
+// has to be retried.
 template <class EmSyncItemOfT, class T, uint8_t size>
 class EmSimpleSyncValue: public EmSyncValue<T> {
 public:
-    EmSimpleSyncValue(EmSyncItemOfT* items[]) {
+    EmSimpleSyncValue(EmSyncItemOfT* items[])
+     : m_polled(false) {
         for(uint8_t i=0; i < size; i++) {
             m_items[i] = items[i];
+            m_items[i]->_setOwner(this);
+            if (m_items[i]->isPolled()) {
+                m_polled = true;
+            }
         }
     }
 
     bool doSync() override {
+        // Nothing changed since last synchronization and no write to retry?
+        if (!this->takeDirty_() && !this->takeRetryDue_() && !m_polled) {
+            return true;
+        }
+        this->m_waitingRetry = false;
+        this->countSync_();
+        bool res = _doSync();
+        _scheduleRetries();
+        return res;
+    }
+
+    bool isPolled() const override {
+        return m_polled;
+    }
+
+protected:
+    bool _doSync() {
         for(uint8_t i=0; i < size; i++) {
             switch (m_items[i]->checkNewValue(this->m_currentValue)) {
                 case CheckNewValueResult::valueChanged:
                     // First changed value found: lets write all the others! 
+                    this->m_version++;
+                    this->onValueChanged();
                     return _updateToNewValue(i);
                 case CheckNewValueResult::mustReadFailed:
                     // A "must read" value failed to read, cannot proceed with synch!
+                    // (lets retry on next synchronization)
+                    this->mustReadFailed_();
                     return false;
                 case CheckNewValueResult::pendingWrite:
                     // An "old" pending write
@@ -224,7 +914,29 @@ public:
         return true;
     }
 
-protected:
+    // Sets when the pending writes have to be retried
+    void _scheduleRetries() {
+        uint8_t pendingWrites = 0;
+        bool retryNow = false;
+        for(uint8_t i=0; i < size; i++) {
+            if (!m_items[i]->isPendingWrite()) {
+                continue;
+            }
+            pendingWrites++;
+            // Retry at each synchronization?
+            if (!m_items[i]->hasRetryPolicy()) {
+                retryNow = true;
+            } else {
+                this->waitRetry_(m_items[i]->retryAtMs());
+            }
+        }
+        if (retryNow) {
+            this->m_waitingRetry = false;
+            this->notifyChanged();
+        }
+        this->countPendingWrites_(pendingWrites);
+    }
+
     bool _updateToNewValue(uint8_t valIndex) {
         bool res = true;
         for(uint8_t i=0; i < size; i++) {
@@ -239,6 +951,35 @@ protected:
     }
 
     EmSyncItemOfT* m_items[size];
+    bool m_polled; // At least one item must be read at each synchronization
+};
+
+// The simple priority based synchronized value that can be read from any 
+// thread while it is synchronized (i.e. 'getValue' never returns a torn value).
+//
+// The synchronization thread publishes each new value to a sequence lock 
+// (see 'EmSeqLock'): readers never block the synchronization.
+template <class EmSyncItemOfT, class T, uint8_t size>
+class EmConcurrentSyncValue: public EmSimpleSyncValue<EmSyncItemOfT, T, size> {
+public:
+    EmConcurrentSyncValue(EmSyncItemOfT* items[])
+     : EmSimpleSyncValue<EmSyncItemOfT, T, size>(items) {}
+
+    virtual void getValue(T& value) override {
+        m_publishedValue.read(value);
+    }
+
+    // The number of published values
+    uint32_t getPublishedCount() const {
+        return m_publishedValue.getVersion();
+    }
+
+protected:
+    virtual void onValueChanged() override {
+        m_publishedValue.write(this->m_currentValue);
+    }
+
+    EmSeqLock<T> m_publishedValue;
 };
 
 #endif
\ No newline at end of file
@@ -10,6 +10,7 @@
 
 #include <mutex>
 #include <atomic>
+#include <string.h>
 
 using EmMutex = std::mutex;
 using EmMutexLock = std::lock_guard<std::mutex>;
@@ -25,6 +26,93 @@ using ts_uint32 = std::atomic<uint32_t>;
 using ts_int64 = std::atomic<int64_t>;
 using ts_uint64 = std::atomic<uint64_t>;
 
+// Increments a thread safe counter.
+// NOTE: relaxed ordering since counters are not used to synchronize anything
+inline void emCount(ts_uint32& counter, uint32_t n = 1) {
+    counter.fetch_add(n, std::memory_order_relaxed);
+}
+
+inline void emCount(ts_uint64& counter, uint64_t n = 1) {
+    counter.fetch_add(n, std::memory_order_relaxed);
+}
+
+// Sets a thread safe flag and returns its previous value.
+inline bool emExchange(ts_bool& flag, bool value) {
+    return flag.exchange(value);
+}
+
+// Sets a thread safe value and returns its previous value.
+inline uint32_t emExchange(ts_uint32& bits, uint32_t value) {
+    return bits.exchange(value);
+}
+
+// Sets the 'mask' bits of a thread safe value.
+inline void emSetBits(ts_uint32& bits, uint32_t mask) {
+    bits.fetch_or(mask);
+}
+
+// The sequence lock: a single writer updates the value while many readers
+// get consistent snapshots of it without locks.
+// Readers never block the writer: they just retry if the value has been 
+// updated while they were reading it.
+//
+// NOTE: 'T' must be trivially copyable (value is copied as raw words)
+template <class T>
+class EmSeqLock {
+public:
+    EmSeqLock()
+     : m_seq(0) {
+        for (size_t i=0; i < c_words; i++) {
+            m_words[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Sets the value (i.e. a single writer thread at a time)
+    void write(const T& value) {
+        uint32_t words[c_words];
+        words[c_words-1] = 0;
+        memcpy(words, &value, sizeof(T));
+        uint32_t seq = m_seq.load(std::memory_order_relaxed);
+        // Odd sequence while writing
+        m_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i=0; i < c_words; i++) {
+            m_words[i].store(words[i], std::memory_order_relaxed);
+        }
+        m_seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // Gets a consistent copy of the value
+    void read(T& value) const {
+        uint32_t words[c_words];
+        while (!tryRead_(words)) {}
+        memcpy(&value, words, sizeof(T));
+    }
+
+    // Changes count (i.e. each 'write' increments it)
+    uint32_t getVersion() const {
+        return m_seq.load(std::memory_order_acquire) >> 1;
+    }
+
+protected:
+    static const size_t c_words = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    bool tryRead_(uint32_t* words) const {
+        uint32_t seq = m_seq.load(std::memory_order_acquire);
+        if (seq & 1) {
+            return false;
+        }
+        for (size_t i=0; i < c_words; i++) {
+            words[i] = m_words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return seq == m_seq.load(std::memory_order_relaxed);
+    }
+
+    std::atomic<uint32_t> m_seq;
+    std::atomic<uint32_t> m_words[c_words];
+};
+
 #else
 
 class EmMutex {};
@@ -45,5 +133,59 @@ using ts_uint32 = uint32_t;
 using ts_int64 = int64_t;
 using ts_uint64 = uint64_t;
 
+// Increments a thread safe counter.
+inline void emCount(ts_uint32& counter, uint32_t n = 1) {
+    counter += n;
+}
+
+inline void emCount(ts_uint64& counter, uint64_t n = 1) {
+    counter += n;
+}
+
+// Sets a thread safe flag and returns its previous value.
+inline bool emExchange(ts_bool& flag, bool value) {
+    bool prev = flag;
+    flag = value;
+    return prev;
+}
+
+// Sets a thread safe value and returns its previous value.
+inline uint32_t emExchange(ts_uint32& bits, uint32_t value) {
+    uint32_t prev = bits;
+    bits = value;
+    return prev;
+}
+
+// Sets the 'mask' bits of a thread safe value.
+inline void emSetBits(ts_uint32& bits, uint32_t mask) {
+    bits |= mask;
+}
+
+// The sequence lock (i.e. a plain value on single thread platforms)
+template <class T>
+class EmSeqLock {
+public:
+    EmSeqLock()
+     : m_value(),
+       m_version(0) {}
+
+    void write(const T& value) {
+        m_value = value;
+        m_version++;
+    }
+
+    void read(T& value) const {
+        value = m_value;
+    }
+
+    uint32_t getVersion() const {
+        return m_version;
+    }
+
+protected:
+    T m_value;
+    uint32_t m_version;
+};
+
 #endif
 #endif
\ No newline at end of file
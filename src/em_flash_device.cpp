@@ -0,0 +1,148 @@
+#include "em_flash_device.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef EM_EEPROM
+#include <EEPROM.h>
+#endif
+
+size_t EmMemFlashDevice::powerBytes_(size_t len) {
+    if (!m_cutPower) {
+        return len;
+    }
+    if (m_powerBytes < len) {
+        len = m_powerBytes;
+        m_powerOff = true;
+    }
+    m_powerBytes -= len;
+    return len;
+}
+
+bool EmMemFlashDevice::read(uint32_t address, void* buf, size_t len) {
+    if (m_pMemory == nullptr || m_powerOff ||
+        address + len > m_sectorSize * m_sectorsCount) {
+        return false;
+    }
+    memcpy(buf, m_pMemory + address, len);
+    return true;
+}
+
+bool EmMemFlashDevice::write(uint32_t address, const void* buf, size_t len) {
+    if (m_pMemory == nullptr || m_powerOff ||
+        address + len > m_sectorSize * m_sectorsCount) {
+        return false;
+    }
+    size_t n = powerBytes_(len);
+    const uint8_t* p = static_cast<const uint8_t*>(buf);
+    uint8_t* pDest = m_pMemory + address;
+    // Writing can only clear bits
+    for (size_t i=0; i < n; i++) {
+        pDest[i] &= p[i];
+    }
+    m_writtenBytes += n;
+    return n == len;
+}
+
+bool EmMemFlashDevice::eraseSector(uint16_t sector) {
+    if (m_pMemory == nullptr || m_powerOff || sector >= m_sectorsCount) {
+        return false;
+    }
+    size_t n = powerBytes_(m_sectorSize);
+    memset(m_pMemory + sector * m_sectorSize, 0xFF, n);
+    if (m_pEraseCounts != nullptr) {
+        m_pEraseCounts[sector]++;
+    }
+    return n == m_sectorSize;
+}
+
+void EmMemFlashDevice::format() {
+    if (m_pMemory != nullptr) {
+        memset(m_pMemory, 0xFF, m_sectorSize * m_sectorsCount);
+    }
+}
+
+#ifdef __linux__
+
+bool EmFileFlashDevice::begin() {
+    if (m_pMemory != nullptr) {
+        return false;
+    }
+    size_t size = m_sectorSize * m_sectorsCount;
+    int fd = open(m_path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        close(fd);
+        return false;
+    }
+    void* pMemory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // The mapping keeps the file referenced
+    close(fd);
+    if (pMemory == MAP_FAILED) {
+        return false;
+    }
+    m_pMemory = static_cast<uint8_t*>(pMemory);
+    // New bytes are erased flash
+    if (static_cast<size_t>(st.st_size) < size) {
+        memset(m_pMemory + st.st_size, 0xFF, size - st.st_size);
+    }
+    return true;
+}
+
+void EmFileFlashDevice::end() {
+    if (m_pMemory != nullptr) {
+        munmap(m_pMemory, m_sectorSize * m_sectorsCount);
+        m_pMemory = nullptr;
+    }
+}
+
+bool EmFileFlashDevice::sync() {
+    return m_pMemory != nullptr &&
+           msync(m_pMemory, m_sectorSize * m_sectorsCount, MS_SYNC) == 0;
+}
+
+#endif // __linux__
+
+#ifdef EM_EEPROM
+
+bool EmEepromFlashDevice::read(uint32_t address, void* buf, size_t len) {
+    if (address + len > static_cast<uint32_t>(m_sectorSize) * m_sectorsCount) {
+        return false;
+    }
+    uint8_t* p = static_cast<uint8_t*>(buf);
+    for (size_t i=0; i < len; i++) {
+        p[i] = EEPROM.read(m_address + address + i);
+    }
+    return true;
+}
+
+bool EmEepromFlashDevice::write(uint32_t address, const void* buf, size_t len) {
+    if (address + len > static_cast<uint32_t>(m_sectorSize) * m_sectorsCount) {
+        return false;
+    }
+    const uint8_t* p = static_cast<const uint8_t*>(buf);
+    for (size_t i=0; i < len; i++) {
+        EEPROM.update(m_address + address + i, p[i]);
+    }
+    return true;
+}
+
+bool EmEepromFlashDevice::eraseSector(uint16_t sector) {
+    if (sector >= m_sectorsCount) {
+        return false;
+    }
+    uint16_t address = m_address + sector * m_sectorSize;
+    for (uint16_t i=0; i < m_sectorSize; i++) {
+        EEPROM.update(address + i, 0xFF);
+    }
+    return true;
+}
+
+#endif // EM_EEPROM
@@ -0,0 +1,643 @@
+#include "em_flash_storage.h"
+
+#define EM_FLASH_STORAGE_MAGIC 0x4C534D45 // "EMSL"
+
+// Device reads are split in chunks of this size (i.e. stack buffer)
+#define EM_FLASH_STORAGE_CHUNK 32
+
+uint32_t EmFlashStorageBackend::hash_(const char* ns, const char* key) {
+    // NOTE: names are separated by a zero byte (i.e. "ab"+"c" != "a"+"bc")
+    uint32_t hash = emHash32n(ns, EM_STORAGE_MAX_KEY_LEN) * 16777619u;
+    return emHash32n(key, EM_STORAGE_MAX_KEY_LEN, hash);
+}
+
+EmStorageError EmFlashStorageBackend::open(const char* name) {
+    if (m_open) {
+        return EmStorageError::invalidState;
+    }
+    if (name == nullptr || name[0] == 0 || strlen(name) > EM_STORAGE_MAX_KEY_LEN) {
+        return EmStorageError::invalidName;
+    }
+    if (!m_mounted) {
+        EmStorageError err = mount_();
+        if (err != EmStorageError::none) {
+            return err;
+        }
+    }
+    strcpy(m_namespace, name);
+    m_open = true;
+    return EmStorageError::none;
+}
+
+void EmFlashStorageBackend::close() {
+    m_open = false;
+}
+
+EmStorageError EmFlashStorageBackend::mount_() {
+    uint16_t count = m_device.sectorsCount();
+    uint32_t sectorSize = m_device.sectorSize();
+    if (count < 3 || sectorSize < sizeof(SectorHeader) + sizeof(Record) + 2*EM_STORAGE_MAX_KEY_LEN) {
+        return EmStorageError::notInitialized;
+    }
+    m_indexCount = 0;
+    m_liveBytes = 0;
+    m_usedSectors = 0;
+    // Oldest and newest sectors
+    uint32_t oldestSeq = 0;
+    uint32_t headSeq = 0;
+    bool used = false;
+    for (uint16_t sector=0; sector < count; sector++) {
+        SectorHeader header;
+        if (!m_device.read(sector * sectorSize, &header, sizeof(header))) {
+            return EmStorageError::failed;
+        }
+        if (header.magic != EM_FLASH_STORAGE_MAGIC || header.check != ~header.seq) {
+            // Interrupted erase or sector opening: lets erase it again
+            if (!isBlank_(sector * sectorSize, sectorSize) && !m_device.eraseSector(sector)) {
+                return EmStorageError::failed;
+            }
+            continue;
+        }
+        if (!used || header.seq < oldestSeq) {
+            oldestSeq = header.seq;
+            m_oldest = sector;
+        }
+        if (!used || header.seq > headSeq) {
+            headSeq = header.seq;
+            m_head = sector;
+        }
+        used = true;
+    }
+    if (!used) {
+        // Blank device
+        m_nextSeq = 0;
+        if (!openSector_(0)) {
+            return EmStorageError::failed;
+        }
+        m_mounted = true;
+        return EmStorageError::none;
+    }
+    // Records are indexed in writing order (i.e. the latest record wins)
+    m_nextSeq = headSeq + 1;
+    m_usedSectors = (m_head + count - m_oldest) % count + 1;
+    for (uint16_t i=0; i < m_usedSectors; i++) {
+        uint16_t sector = (m_oldest + i) % count;
+        uint32_t end;
+        EmStorageError err = scanSector_(sector, end);
+        if (err != EmStorageError::none) {
+            return err;
+        }
+        if (sector == m_head) {
+            m_headOffset = end;
+        }
+    }
+    m_mounted = true;
+    // Interrupted compaction (i.e. the reserved sector is in use)
+    if (freeSectors_() == 0) {
+        compact_();
+    }
+    return EmStorageError::none;
+}
+
+bool EmFlashStorageBackend::isBlank_(uint32_t address, uint32_t len) {
+    uint8_t chunk[EM_FLASH_STORAGE_CHUNK];
+    while (len != 0) {
+        uint32_t n = len < sizeof(chunk) ? len : sizeof(chunk);
+        if (!m_device.read(address, chunk, n)) {
+            return false;
+        }
+        for (uint32_t i=0; i < n; i++) {
+            if (chunk[i] != 0xFF) {
+                return false;
+            }
+        }
+        address += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool EmFlashStorageBackend::openSector_(uint16_t sector) {
+    SectorHeader header;
+    header.seq = m_nextSeq;
+    header.check = ~m_nextSeq;
+    header.magic = EM_FLASH_STORAGE_MAGIC;
+    if (!m_device.write(sector * m_device.sectorSize(), &header, sizeof(header))) {
+        return false;
+    }
+    if (m_usedSectors == 0) {
+        m_oldest = sector;
+    }
+    m_nextSeq++;
+    m_head = sector;
+    m_headOffset = sizeof(SectorHeader);
+    m_usedSectors++;
+    return true;
+}
+
+EmStorageError EmFlashStorageBackend::scanSector_(uint16_t sector, uint32_t& end) {
+    uint32_t sectorSize = m_device.sectorSize();
+    uint32_t base = sector * sectorSize;
+    SectorHeader header;
+    if (!m_device.read(base, &header, sizeof(header))) {
+        return EmStorageError::failed;
+    }
+    if (header.magic != EM_FLASH_STORAGE_MAGIC || header.check != ~header.seq) {
+        // Erased in the middle of the log: nothing to append here
+        end = sectorSize;
+        return EmStorageError::none;
+    }
+    Record record;
+    char ns[EM_STORAGE_MAX_KEY_LEN+1];
+    char key[EM_STORAGE_MAX_KEY_LEN+1];
+    uint32_t offset = sizeof(SectorHeader);
+    while (nextRecord_(base, offset, record, ns, key)) {
+        if (!indexRecord_(base + offset, record, ns, key)) {
+            return EmStorageError::notEnoughSpace;
+        }
+        offset += recordSize_(record);
+    }
+    end = offset;
+    return EmStorageError::none;
+}
+
+bool EmFlashStorageBackend::nextRecord_(uint32_t base,
+                                        uint32_t& offset,
+                                        Record& record,
+                                        char* ns,
+                                        char* key) {
+    uint32_t sectorSize = m_device.sectorSize();
+    for (; offset + sizeof(Record) <= sectorSize; offset += 4) {
+        if (readRecord_(base + offset, record, ns, key) && checkRecord_(base + offset, record)) {
+            return true;
+        }
+        if (isBlank_(base + offset, sectorSize - offset)) {
+            return false;
+        }
+        // Interrupted write (i.e. its size is not reliable): lets look for
+        // the next valid record
+    }
+    return false;
+}
+
+bool EmFlashStorageBackend::indexRecord_(uint32_t address,
+                                         const Record& record,
+                                         const char* ns,
+                                         const char* key) {
+    uint32_t hash = hash_(ns, key);
+    IndexEntry* pEntry = find_(hash, ns, key);
+    bool tombstone = record.type == static_cast<uint8_t>(RecordType::tombstone);
+    if (pEntry != nullptr) {
+        m_liveBytes -= entrySize_(pEntry);
+        if (tombstone) {
+            removeEntry_(pEntry);
+            return true;
+        }
+    } else {
+        if (tombstone) {
+            return true;
+        }
+        if (m_indexCount == m_indexSize) {
+            return false;
+        }
+        pEntry = &m_pIndex[m_indexCount++];
+        pEntry->hash = hash;
+    }
+    pEntry->address = address;
+    m_liveBytes += recordSize_(record);
+    return true;
+}
+
+bool EmFlashStorageBackend::readRecord_(uint32_t address, Record& record, char* ns, char* key) {
+    if (!m_device.read(address, &record, sizeof(record))) {
+        return false;
+    }
+    if (record.type < static_cast<uint8_t>(RecordType::blob) ||
+        record.type > static_cast<uint8_t>(RecordType::tombstone) ||
+        record.nsLen == 0 || record.nsLen > EM_STORAGE_MAX_KEY_LEN ||
+        record.keyLen == 0 || record.keyLen > EM_STORAGE_MAX_KEY_LEN ||
+        address % m_device.sectorSize() + recordSize_(record) > m_device.sectorSize()) {
+        return false;
+    }
+    address += sizeof(record);
+    if (!m_device.read(address, ns, record.nsLen) ||
+        !m_device.read(address + record.nsLen, key, record.keyLen)) {
+        return false;
+    }
+    ns[record.nsLen] = 0;
+    key[record.keyLen] = 0;
+    return true;
+}
+
+bool EmFlashStorageBackend::checkRecord_(uint32_t address, const Record& record) {
+    uint32_t crc = emCrc32(reinterpret_cast<const uint8_t*>(&record) + sizeof(record.crc),
+                           sizeof(Record) - sizeof(record.crc));
+    uint8_t chunk[EM_FLASH_STORAGE_CHUNK];
+    uint32_t len = record.nsLen + record.keyLen + record.len;
+    address += sizeof(Record);
+    while (len != 0) {
+        uint32_t n = len < sizeof(chunk) ? len : sizeof(chunk);
+        if (!m_device.read(address, chunk, n)) {
+            return false;
+        }
+        crc = emCrc32(chunk, n, crc);
+        address += n;
+        len -= n;
+    }
+    return crc == record.crc;
+}
+
+bool EmFlashStorageBackend::copy_(uint32_t from, uint32_t to, uint32_t size) {
+    uint8_t chunk[EM_FLASH_STORAGE_CHUNK];
+    while (size != 0) {
+        uint32_t n = size < sizeof(chunk) ? size : sizeof(chunk);
+        if (!m_device.read(from, chunk, n) || !m_device.write(to, chunk, n)) {
+            return false;
+        }
+        from += n;
+        to += n;
+        size -= n;
+    }
+    return true;
+}
+
+EmFlashStorageBackend::IndexEntry* EmFlashStorageBackend::find_(uint32_t hash,
+                                                                const char* ns,
+                                                                const char* key,
+                                                                Record* pRecord) {
+    for (uint16_t i=0; i < m_indexCount; i++) {
+        if (m_pIndex[i].hash != hash) {
+            continue;
+        }
+        // Same hash: lets compare the names
+        Record record;
+        char entryNs[EM_STORAGE_MAX_KEY_LEN+1];
+        char entryKey[EM_STORAGE_MAX_KEY_LEN+1];
+        if (readRecord_(m_pIndex[i].address, record, entryNs, entryKey) &&
+            strcmp(entryNs, ns) == 0 && strcmp(entryKey, key) == 0) {
+            if (pRecord != nullptr) {
+                *pRecord = record;
+            }
+            return &m_pIndex[i];
+        }
+    }
+    return nullptr;
+}
+
+EmFlashStorageBackend::IndexEntry* EmFlashStorageBackend::findAddress_(uint32_t hash,
+                                                                       uint32_t address) {
+    for (uint16_t i=0; i < m_indexCount; i++) {
+        if (m_pIndex[i].hash == hash && m_pIndex[i].address == address) {
+            return &m_pIndex[i];
+        }
+    }
+    return nullptr;
+}
+
+void EmFlashStorageBackend::removeEntry_(IndexEntry* pEntry) {
+    *pEntry = m_pIndex[--m_indexCount];
+}
+
+uint32_t EmFlashStorageBackend::entrySize_(const IndexEntry* pEntry) {
+    Record record;
+    return m_device.read(pEntry->address, &record, sizeof(record)) ? recordSize_(record) : 0;
+}
+
+bool EmFlashStorageBackend::isSame_(uint32_t address,
+                                    RecordType type,
+                                    const void* value,
+                                    size_t len) {
+    Record record;
+    if (!m_device.read(address, &record, sizeof(record)) ||
+        record.type != static_cast<uint8_t>(type) || record.len != len) {
+        return false;
+    }
+    uint8_t chunk[EM_FLASH_STORAGE_CHUNK];
+    const uint8_t* p = static_cast<const uint8_t*>(value);
+    address += sizeof(Record) + record.nsLen + record.keyLen;
+    while (len != 0) {
+        size_t n = len < sizeof(chunk) ? len : sizeof(chunk);
+        if (!m_device.read(address, chunk, n) || memcmp(chunk, p, n) != 0) {
+            return false;
+        }
+        address += n;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+EmStorageError EmFlashStorageBackend::reserve_(uint32_t size, uint32_t& address, bool compacting) {
+    uint16_t count = m_device.sectorsCount();
+    uint32_t sectorSize = m_device.sectorSize();
+    uint16_t compactions = 0;
+    while (m_headOffset + size > sectorSize) {
+        // NOTE: the last free sector is reserved for compaction
+        if (freeSectors_() > (compacting ? 0 : 1)) {
+            if (!openSector_((m_head + 1) % count)) {
+                return EmStorageError::failed;
+            }
+            continue;
+        }
+        if (compacting || compactions++ == count) {
+            return EmStorageError::notEnoughSpace;
+        }
+        EmStorageError err = compact_();
+        if (err != EmStorageError::none) {
+            return err;
+        }
+    }
+    address = m_head * sectorSize + m_headOffset;
+    m_headOffset += size;
+    return EmStorageError::none;
+}
+
+EmStorageError EmFlashStorageBackend::compact_() {
+    if (m_usedSectors < 2) {
+        return EmStorageError::notEnoughSpace;
+    }
+    uint32_t sectorSize = m_device.sectorSize();
+    uint32_t base = m_oldest * sectorSize;
+    Record record;
+    char ns[EM_STORAGE_MAX_KEY_LEN+1];
+    char key[EM_STORAGE_MAX_KEY_LEN+1];
+    uint32_t offset = sizeof(SectorHeader);
+    while (nextRecord_(base, offset, record, ns, key)) {
+        uint32_t size = recordSize_(record);
+        // NOTE: superseded records and tombstones are dropped (i.e. there
+        // are no older records left)
+        IndexEntry* pEntry = findAddress_(hash_(ns, key), base + offset);
+        if (pEntry != nullptr) {
+            uint32_t address;
+            EmStorageError err = reserve_(size, address, true);
+            if (err != EmStorageError::none) {
+                return err;
+            }
+            if (!copy_(base + offset, address, size)) {
+                return EmStorageError::failed;
+            }
+            pEntry->address = address;
+        }
+        offset += size;
+    }
+    if (!m_device.eraseSector(m_oldest)) {
+        return EmStorageError::failed;
+    }
+    m_oldest = (m_oldest + 1) % m_device.sectorsCount();
+    m_usedSectors--;
+    m_compactions++;
+    return EmStorageError::none;
+}
+
+EmStorageError EmFlashStorageBackend::write_(Record& record,
+                                             const char* key,
+                                             const void* value,
+                                             uint32_t& address) {
+    EmStorageError err = reserve_(recordSize_(record), address, false);
+    if (err != EmStorageError::none) {
+        return err;
+    }
+    uint8_t head[sizeof(Record) + 2*EM_STORAGE_MAX_KEY_LEN];
+    uint32_t headLen = sizeof(Record) + record.nsLen + record.keyLen;
+    memcpy(head + sizeof(Record), m_namespace, record.nsLen);
+    memcpy(head + sizeof(Record) + record.nsLen, key, record.keyLen);
+    memcpy(head, &record, sizeof(Record));
+    record.crc = emCrc32(head + sizeof(record.crc), headLen - sizeof(record.crc));
+    record.crc = emCrc32(value, record.len, record.crc);
+    memcpy(head, &record, sizeof(Record));
+    // NOTE: the header goes first, an interrupted write fails the CRC check
+    if (!m_device.write(address, head, headLen) ||
+        (record.len != 0 && !m_device.write(address + headLen, value, record.len))) {
+        return EmStorageError::failed;
+    }
+    return EmStorageError::none;
+}
+
+EmStorageError EmFlashStorageBackend::set_(const char* key,
+                                           RecordType type,
+                                           const void* value,
+                                           size_t len) {
+    if (!m_open) {
+        return EmStorageError::invalidHandle;
+    }
+    if (key == nullptr || key[0] == 0 || (value == nullptr && len != 0)) {
+        return EmStorageError::invalidName;
+    }
+    if (strlen(key) > EM_STORAGE_MAX_KEY_LEN) {
+        return EmStorageError::keyTooLong;
+    }
+    if (len > 0xFFFF) {
+        return EmStorageError::invalidLength;
+    }
+    Record record;
+    memset(&record, 0xFF, sizeof(record));
+    record.len = static_cast<uint16_t>(len);
+    record.type = static_cast<uint8_t>(type);
+    record.nsLen = static_cast<uint8_t>(strlen(m_namespace));
+    record.keyLen = static_cast<uint8_t>(strlen(key));
+    uint32_t size = recordSize_(record);
+    if (size > payload_()) {
+        return EmStorageError::invalidLength;
+    }
+    uint32_t hash = hash_(m_namespace, key);
+    IndexEntry* pEntry = find_(hash, m_namespace, key);
+    uint32_t oldSize = 0;
+    if (pEntry != nullptr) {
+        // Same value? No need to wear the flash
+        if (type != RecordType::tombstone && isSame_(pEntry->address, type, value, len)) {
+            return EmStorageError::none;
+        }
+        oldSize = entrySize_(pEntry);
+    } else if (type == RecordType::tombstone) {
+        return EmStorageError::notFound;
+    } else if (m_indexCount == m_indexSize) {
+        return EmStorageError::notEnoughSpace;
+    }
+    if (type != RecordType::tombstone && m_liveBytes - oldSize + size > capacity_()) {
+        return EmStorageError::notEnoughSpace;
+    }
+    // NOTE: compaction might move records, not index entries
+    uint32_t address;
+    EmStorageError err = write_(record, key, value, address);
+    if (err != EmStorageError::none) {
+        return err;
+    }
+    m_liveBytes -= oldSize;
+    if (type == RecordType::tombstone) {
+        removeEntry_(pEntry);
+        return EmStorageError::none;
+    }
+    if (pEntry == nullptr) {
+        pEntry = &m_pIndex[m_indexCount++];
+        pEntry->hash = hash;
+    }
+    pEntry->address = address;
+    m_liveBytes += size;
+    return EmStorageError::none;
+}
+
+EmStorageError EmFlashStorageBackend::get_(const char* key,
+                                           RecordType type,
+                                           void* buf,
+                                           size_t& len) {
+    if (!m_open) {
+        return EmStorageError::invalidHandle;
+    }
+    if (key == nullptr) {
+        return EmStorageError::invalidName;
+    }
+    Record record;
+    IndexEntry* pEntry = find_(hash_(m_namespace, key), m_namespace, key, &record);
+    if (pEntry == nullptr) {
+        return EmStorageError::notFound;
+    }
+    if (record.type != static_cast<uint8_t>(type)) {
+        return EmStorageError::typeMismatch;
+    }
+    if (buf == nullptr) {
+        len = record.len;
+        return EmStorageError::none;
+    }
+    if (len < record.len) {
+        return EmStorageError::invalidLength;
+    }
+    len = record.len;
+    uint32_t address = pEntry->address + sizeof(Record) + record.nsLen + record.keyLen;
+    return m_device.read(address, buf, len) ? EmStorageError::none : EmStorageError::failed;
+}
+
+EmStorageError EmFlashStorageBackend::setBlob(const char* key, const void* value, size_t len) {
+    return set_(key, RecordType::blob, value, len);
+}
+
+EmStorageError EmFlashStorageBackend::setString(const char* key, const char* value) {
+    if (value == nullptr) {
+        return EmStorageError::invalidName;
+    }
+    return set_(key, RecordType::string, value, strlen(value) + 1);
+}
+
+EmStorageError EmFlashStorageBackend::getBlob(const char* key, void* buf, size_t& len) {
+    return get_(key, RecordType::blob, buf, len);
+}
+
+EmStorageError EmFlashStorageBackend::getString(const char* key, char* buf, size_t& len) {
+    return get_(key, RecordType::string, buf, len);
+}
+
+EmStorageError EmFlashStorageBackend::getChunks(const char* key,
+                                                bool isString,
+                                                void* buf,
+                                                size_t bufSize,
+                                                EmStorageChunkVisitor visitor,
+                                                void* pUserData) {
+    if (!m_open) {
+        return EmStorageError::invalidHandle;
+    }
+    if (key == nullptr) {
+        return EmStorageError::invalidName;
+    }
+    if (buf == nullptr || bufSize == 0) {
+        return EmStorageError::invalidLength;
+    }
+    Record record;
+    IndexEntry* pEntry = find_(hash_(m_namespace, key), m_namespace, key, &record);
+    if (pEntry == nullptr) {
+        return EmStorageError::notFound;
+    }
+    RecordType type = isString ? RecordType::string : RecordType::blob;
+    if (record.type != static_cast<uint8_t>(type)) {
+        return EmStorageError::typeMismatch;
+    }
+    uint32_t address = pEntry->address + sizeof(Record) + record.nsLen + record.keyLen;
+    EmStorageChunk chunk;
+    chunk.data = buf;
+    chunk.size = record.len;
+    for (chunk.offset=0; chunk.offset < record.len; chunk.offset += chunk.len) {
+        chunk.len = record.len - chunk.offset < bufSize ? record.len - chunk.offset : bufSize;
+        if (!m_device.read(address + chunk.offset, buf, chunk.len)) {
+            return EmStorageError::failed;
+        }
+        if (!visitor(chunk, pUserData)) {
+            break;
+        }
+    }
+    return EmStorageError::none;
+}
+
+EmStorageError EmFlashStorageBackend::erase(const char* key) {
+    return set_(key, RecordType::tombstone, nullptr, 0);
+}
+
+EmStorageError EmFlashStorageBackend::eraseAll() {
+    if (!m_open) {
+        return EmStorageError::invalidHandle;
+    }
+    for (uint16_t i=0; i < m_indexCount;) {
+        Record record;
+        char ns[EM_STORAGE_MAX_KEY_LEN+1];
+        char key[EM_STORAGE_MAX_KEY_LEN+1];
+        if (readRecord_(m_pIndex[i].address, record, ns, key) && strcmp(ns, m_namespace) == 0) {
+            // NOTE: the last entry is moved to 'i'
+            EmStorageError err = set_(key, RecordType::tombstone, nullptr, 0);
+            if (err != EmStorageError::none) {
+                return err;
+            }
+            continue;
+        }
+        i++;
+    }
+    return EmStorageError::none;
+}
+
+EmStorageError EmFlashStorageBackend::commit() {
+    if (!m_open) {
+        return EmStorageError::invalidHandle;
+    }
+    // NOTE: records are persisted when written
+    return m_device.sync() ? EmStorageError::none : EmStorageError::failed;
+}
+
+EmStorageError EmFlashStorageBackend::freeEntries(size_t& entries) const {
+    if (!m_open) {
+        entries = 0;
+        return EmStorageError::invalidHandle;
+    }
+    uint32_t capacity = capacity_();
+    entries = m_liveBytes < capacity ? (capacity - m_liveBytes) / EM_STORAGE_ENTRY_SIZE : 0;
+    return EmStorageError::none;
+}
+
+uint32_t EmFlashStorageBackend::forEach(EmStorageVisitor visitor, void* pUserData) {
+    if (!m_open) {
+        return 0;
+    }
+    uint32_t count = 0;
+    for (uint16_t i=0; i < m_indexCount; i++) {
+        Record record;
+        char ns[EM_STORAGE_MAX_KEY_LEN+1];
+        char key[EM_STORAGE_MAX_KEY_LEN+1];
+        if (!readRecord_(m_pIndex[i].address, record, ns, key) || strcmp(ns, m_namespace) != 0) {
+            continue;
+        }
+        EmStorageEntry entry;
+        entry.key = key;
+        entry.isString = record.type == static_cast<uint8_t>(RecordType::string);
+        entry.value = nullptr;
+        entry.len = record.len;
+        count++;
+        if (!visitor(entry, pUserData)) {
+            break;
+        }
+    }
+    return count;
+}
+
+void EmFlashStorageBackend::update() {
+    // NOTE: one sector at a time (i.e. bounded time)
+    if (m_mounted &&
+        freeSectors_() < m_compactFreeSectors &&
+        garbage_() >= payload_()) {
+        compact_();
+    }
+}
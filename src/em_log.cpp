@@ -1,10 +1,336 @@
 #include "em_log.h"
 
+void EmLogTarget::setLevel(EmLogLevel level) {
+    m_level = level;
 #ifndef EM_NO_LOG
+    EmLog::updateTargetsLevel_(level);
+#endif
+}
 
-EmLogLevel EmLog::g_Level = EmLogLevel::none;
-EmLogTarget* EmLog::g_Targets = NULL;
-uint8_t EmLog::g_TargetsCount = 0;
+#ifndef EM_NO_LOG
+
+#include <ctype.h>
+#include <string.h>
+
+#ifdef AVR
+#include <avr/pgmspace.h>
+#endif
+
+#ifdef EM_MULTITHREAD
+#include <thread>
+#endif
+
+EmLogLevelInternal EmLog::g_Level(EmLogLevel::none);
+EmLogLevelInternal EmLog::g_TargetsLevel(EmLogLevel::none);
+
+namespace {
+
+// The context levels registry (open addressing hash table).
+// NOTE: entries are added/changed/released and looked up by name while holding
+//       'g_contextsMutex' (i.e. released entries names are rewritten when
+//       reused), log instances keep their entry (i.e. no lookups when logging).
+//       Released entries are marked (i.e. not emptied) so that the other
+//       entries are still found.
+EmLogContext g_contexts[EM_LOG_CONTEXTS_COUNT];
+// Instances with no context (or not fitting the registry) use the global level
+EmLogContext g_globalContext;
+EmMutex g_contextsMutex;
+
+// The hash of the unused and of the released entries
+#define EM_LOG_CONTEXT_UNUSED 0
+#define EM_LOG_CONTEXT_RELEASED 1
+
+uint32_t contextHash(const char* context, size_t len) {
+    uint32_t hash = emHash32n(context, len);
+    // Zero and one are the unused and released entries values
+    return hash > EM_LOG_CONTEXT_RELEASED ? hash : hash + 2;
+}
+
+// Returns true if the entry is the 'context' one
+bool isContext(const EmLogContext& entry, uint32_t hash, const char* context, size_t len) {
+    return entry.hash == hash && 
+           entry.nameLen == len &&
+           strncmp(entry.name, context, MIN(len, static_cast<size_t>(EM_LOG_CONTEXT_NAME_LEN))) == 0;
+}
+
+// Returns the 'context' entry or the free entry where it should be added
+// (i.e. NULL if not found and registry is full).
+// NOTE: caller must hold 'g_contextsMutex'
+EmLogContext* findContext(uint32_t hash, const char* context, size_t len) {
+    EmLogContext* pFree = NULL;
+    for (uint16_t i=0; i < EM_LOG_CONTEXTS_COUNT; i++) {
+        EmLogContext& entry = g_contexts[(hash + i) % EM_LOG_CONTEXTS_COUNT];
+        uint32_t entryHash = entry.hash;
+        if (entryHash == EM_LOG_CONTEXT_UNUSED) {
+            return pFree != NULL ? pFree : &entry;
+        }
+        if (entryHash == EM_LOG_CONTEXT_RELEASED) {
+            if (pFree == NULL) {
+                pFree = &entry;
+            }
+        } else if (isContext(entry, hash, context, len)) {
+            return &entry;
+        }
+    }
+    return pFree;
+}
+
+// Returns the 'context' entry, it is added if not found (i.e. NULL if registry is full).
+// NOTE: caller must hold 'g_contextsMutex'
+EmLogContext* addContext(const char* context, size_t len, EmLogLevel globalLevel) {
+    uint32_t hash = contextHash(context, len);
+    EmLogContext* pEntry = findContext(hash, context, len);
+    if (pEntry != NULL && pEntry->hash <= EM_LOG_CONTEXT_RELEASED) {
+        pEntry->nameLen = static_cast<uint16_t>(len);
+        size_t nameLen = MIN(len, static_cast<size_t>(EM_LOG_CONTEXT_NAME_LEN));
+        memcpy(pEntry->name, context, nameLen);
+        pEntry->name[nameLen] = 0;
+        pEntry->refs = 0;
+        pEntry->level = EmLogLevel::global;
+        pEntry->effectiveLevel = globalLevel;
+#ifdef EM_LOG_METRICS
+        for (uint8_t i=0; i < 4; i++) {
+            pEntry->counters[i] = 0;
+        }
+#endif
+        pEntry->hash = hash;
+    }
+    return pEntry;
+}
+
+// NOTE: caller must hold 'g_contextsMutex'
+void setEntryLevel(EmLogContext& entry, EmLogLevel level, EmLogLevel globalLevel) {
+    entry.level = level;
+    entry.effectiveLevel = level == EmLogLevel::global ? globalLevel : level;
+    if (entry.refs == 0 && level == EmLogLevel::global) {
+        // Not used anymore
+        entry.hash = EM_LOG_CONTEXT_RELEASED;
+    }
+}
+
+// Case insensitive compare of a not null terminated string
+bool strEqual(const char* str, size_t len, const char* value) {
+    for (size_t i=0; i < len; i++) {
+        if (value[i] == 0 || tolower(str[i]) != tolower(value[i])) {
+            return false;
+        }
+    }
+    return value[len] == 0;
+}
+
+bool parseLevel(const char* str, size_t len, EmLogLevel& level) {
+    static const EmLogLevel levels[] = { EmLogLevel::global, EmLogLevel::none, 
+                                         EmLogLevel::error, EmLogLevel::warning, 
+                                         EmLogLevel::info, EmLogLevel::debug };
+    static const char* names[] = { "global", "none", "error", "warning", "info", "debug" };
+    static const char* numbers[] = { "-1", "0", "1", "2", "3", "4" };
+    for (uint8_t i=0; i < SIZE_OF(levels); i++) {
+        if (strEqual(str, len, names[i]) || strEqual(str, len, numbers[i])) {
+            level = levels[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns the max level of the targets
+EmLogLevel targetsLevel(EmLogTarget* targets, uint8_t targetsCount) {
+    EmLogLevel level = EmLogLevel::none;
+    for(uint8_t i=0; i<targetsCount; i++) {
+        level = MAX(level, targets[i].getLevel());
+    }
+    return level;
+}
+
+void trim(const char*& begin, const char*& end) {
+    while (begin < end && isspace(*begin)) {
+        begin++;
+    }
+    while (end > begin && isspace(*(end-1))) {
+        end--;
+    }
+}
+
+} // namespace
+
+void EmLog::setGlobalLevel(EmLogLevel level) {
+    EmMutexLock lock(g_contextsMutex);
+    g_Level = level;
+    g_globalContext.effectiveLevel = level;
+    for (uint16_t i=0; i < EM_LOG_CONTEXTS_COUNT; i++) {
+        EmLogContext& entry = g_contexts[i];
+        if (entry.hash > EM_LOG_CONTEXT_RELEASED && entry.level == EmLogLevel::global) {
+            entry.effectiveLevel = level;
+        }
+    }
+}
+
+bool EmLog::setContextLevel(const char* context, EmLogLevel level) {
+    if (context == NULL) {
+        return false;
+    }
+    EmMutexLock lock(g_contextsMutex);
+    EmLogContext* pEntry = addContext(context, strlen(context), g_Level);
+    if (pEntry == NULL) {
+        return false;
+    }
+    setEntryLevel(*pEntry, level, g_Level);
+    return true;
+}
+
+EmLogLevel EmLog::getContextLevel(const char* context) {
+    return findContext_(context)->effectiveLevel;
+}
+
+bool EmLog::configure(const char* config) {
+    if (config == NULL) {
+        return false;
+    }
+    bool res = true;
+    const char* entry = config;
+    while (*entry != 0) {
+        const char* entryEnd = entry;
+        while (*entryEnd != 0 && *entryEnd != ',' && *entryEnd != ';') {
+            entryEnd++;
+        }
+        const char* name = entry;
+        const char* nameEnd = name;
+        while (nameEnd < entryEnd && *nameEnd != '=') {
+            nameEnd++;
+        }
+        const char* value = nameEnd < entryEnd ? nameEnd+1 : entryEnd;
+        const char* valueEnd = entryEnd;
+        trim(name, nameEnd);
+        trim(value, valueEnd);
+        EmLogLevel level = EmLogLevel::global;
+        if (name == nameEnd && value == valueEnd) {
+            // Empty entry (e.g. trailing separator)
+        } else if (name == nameEnd || 
+                   !parseLevel(value, static_cast<size_t>(valueEnd-value), level)) {
+            res = false;
+        } else if (nameEnd-name == 1 && *name == '*') {
+            setGlobalLevel(level);
+        } else {
+            EmMutexLock lock(g_contextsMutex);
+            EmLogContext* pEntry = addContext(name, static_cast<size_t>(nameEnd-name), g_Level);
+            if (pEntry == NULL) {
+                res = false;
+            } else {
+                setEntryLevel(*pEntry, level, g_Level);
+            }
+        }
+        entry = *entryEnd != 0 ? entryEnd+1 : entryEnd;
+    }
+    return res;
+}
+
+EmLogContext* EmLog::context_(const char* context) {
+    if (context == NULL) {
+        return &g_globalContext;
+    }
+    EmMutexLock lock(g_contextsMutex);
+    EmLogContext* pEntry = addContext(context, strlen(context), g_Level);
+    if (pEntry == NULL) {
+        return &g_globalContext;
+    }
+    pEntry->refs++;
+    return pEntry;
+}
+
+void EmLog::release_(EmLogContext* pContext) {
+    if (pContext == &g_globalContext) {
+        return;
+    }
+    EmMutexLock lock(g_contextsMutex);
+    if (--pContext->refs == 0 && pContext->level == EmLogLevel::global) {
+        pContext->hash = EM_LOG_CONTEXT_RELEASED;
+    }
+}
+
+EmLogContext* EmLog::findContext_(const char* context) {
+    if (context != NULL) {
+        size_t len = strlen(context);
+        uint32_t hash = contextHash(context, len);
+        EmMutexLock lock(g_contextsMutex);
+        EmLogContext* pEntry = findContext(hash, context, len);
+        if (pEntry != NULL && isContext(*pEntry, hash, context, len)) {
+            return pEntry;
+        }
+    }
+    return &g_globalContext;
+}
+
+#ifdef EM_LOG_METRICS
+
+ts_uint32 EmLog::g_Counters[4][4];
+
+namespace {
+
+void loadCounters(const ts_uint32 counters[4], EmLogCounters& res) {
+    res.emitted = counters[static_cast<uint8_t>(EmLogCounterId::emitted)];
+    res.suppressed = counters[static_cast<uint8_t>(EmLogCounterId::suppressed)];
+    res.dropped = counters[static_cast<uint8_t>(EmLogCounterId::dropped)];
+    res.bytes = counters[static_cast<uint8_t>(EmLogCounterId::bytes)];
+}
+
+void resetCounters(ts_uint32 counters[4]) {
+    for (uint8_t i=0; i < 4; i++) {
+        counters[i] = 0;
+    }
+}
+
+#ifndef EM_MULTITHREAD
+size_t flashStrLen(const __FlashStringHelper* msg) {
+#ifdef AVR
+    return strlen_P(reinterpret_cast<const char*>(msg));
+#else
+    return strlen(reinterpret_cast<const char*>(msg));
+#endif
+}
+#endif
+
+} // namespace
+
+void EmLog::getMetrics(EmLogMetrics& metrics) {
+    for (uint8_t i=0; i < 4; i++) {
+        loadCounters(g_Counters[i], metrics.levels[i]);
+    }
+}
+
+bool EmLog::getContextMetrics(const char* context, EmLogCounters& counters) {
+    EmLogContext* pEntry = findContext_(context);
+    if (pEntry == &g_globalContext && context != NULL) {
+        return false;
+    }
+    loadCounters(pEntry->counters, counters);
+    return true;
+}
+
+void EmLog::resetMetrics() {
+    for (uint8_t i=0; i < 4; i++) {
+        resetCounters(g_Counters[i]);
+    }
+    resetCounters(g_globalContext.counters);
+    for (uint16_t i=0; i < EM_LOG_CONTEXTS_COUNT; i++) {
+        resetCounters(g_contexts[i].counters);
+    }
+}
+
+void EmLog::logMetrics(EmLogLevel level) {
+    EmLogMetrics metrics;
+    getMetrics(metrics);
+    for (uint8_t i=0; i < 4; i++) {
+        const EmLogCounters& counters = metrics.levels[i];
+        log<80>(level, "EmLog", "%s: emitted=%lu suppressed=%lu dropped=%lu bytes=%lu",
+                levelToStr(static_cast<EmLogLevel>(i+1)),
+                static_cast<unsigned long>(counters.emitted),
+                static_cast<unsigned long>(counters.suppressed),
+                static_cast<unsigned long>(counters.dropped),
+                static_cast<unsigned long>(counters.bytes));
+    }
+}
+
+#endif // EM_LOG_METRICS
 
 const char* levelToStr(EmLogLevel level) {
     switch (level) {
@@ -29,41 +355,293 @@ const char* levelToStr(EmLogLevel level) {
 }
 
 void EmLog::log(EmLogLevel level, const char* msg) const { 
-    if (checkLevel(level)) {
-        writeToTargets_(level, m_Context, msg);
+    if (checkLevel_(level)) {
+        writeToTargets_(level, m_pContext, m_Context, msg);
     }
 }
 
 void EmLog::log(EmLogLevel level, const __FlashStringHelper* msg) const { 
-    if (checkLevel(level)) {
-        writeToTargets_(level, m_Context, msg);
+    if (checkLevel_(level)) {
+        writeToTargets_(level, m_pContext, m_Context, msg);
     }
 }
 
 void EmLog::log(EmLogLevel level, const char* context, const char* msg) { 
-    if (g_Level >= level) {
-        writeToTargets_(level, context, msg);
+    EmLogContext* pContext = findContext_(context);
+    if (checkLevel_(level, pContext)) {
+        writeToTargets_(level, pContext, context, msg);
     }
 }
 
 void EmLog::log(EmLogLevel level, const char* context, const __FlashStringHelper* msg) { 
-    if (g_Level >= level) {
-        writeToTargets_(level, context, msg);
+    EmLogContext* pContext = findContext_(context);
+    if (checkLevel_(level, pContext)) {
+        writeToTargets_(level, pContext, context, msg);
+    }
+}
+
+#ifdef EM_MULTITHREAD
+
+static_assert((EM_LOG_QUEUE_SIZE & (EM_LOG_QUEUE_SIZE-1)) == 0, 
+              "EM_LOG_QUEUE_SIZE must be a power of 2");
+
+namespace {
+
+// The queued log record.
+//
+// The 'seq' field drives the record state (i.e. bounded MPMC queue by D. Vyukov):
+//   seq == pos       -> free, can be written by the producer at 'pos'
+//   seq == pos + 1   -> published, can be written to targets
+// NOTE: 'seq' is stored as an offset from the record index so that a zero 
+//       initialized queue is a valid empty queue (i.e. logging might start 
+//       before static objects initialization).
+// NOTE: the context is copied (i.e. the record might be written by another
+//       thread once the logging call returned), as the registry names it is
+//       truncated to 'EM_LOG_CONTEXT_NAME_LEN' chars.
+struct EmLogRecord {
+    std::atomic<uint32_t> seq;
+    EmLogLevel level;
+    bool hasContext;
+    char context[EM_LOG_CONTEXT_NAME_LEN+1];
+    char msg[EM_LOG_RECORD_LEN+1];
+};
+
+constexpr uint32_t kQueueMask = EM_LOG_QUEUE_SIZE-1;
+
+EmLogRecord g_records[EM_LOG_QUEUE_SIZE];
+std::atomic<uint32_t> g_enqueuePos(0);
+std::atomic<uint32_t> g_dequeuePos(0); // Written by the thread owning 'g_writing' only
+std::atomic_flag g_writing = ATOMIC_FLAG_INIT;
+// Set when a target level changed (i.e. the targets level is computed by 
+// the thread owning 'g_writing')
+std::atomic<bool> g_targetsLevelChanged(false);
+// Set while this thread writes records to targets (i.e. a target 'write'
+// calling back the log)
+thread_local bool g_inTargetsWrite = false;
+
+uint32_t recordSeq(uint32_t pos) {
+    return g_records[pos & kQueueMask].seq.load() + (pos & kQueueMask);
+}
+
+// Reserves the next free record. Returns NULL if the queue is full.
+EmLogRecord* tryClaimRecord(uint32_t& pos) {
+    pos = g_enqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        int32_t diff = static_cast<int32_t>(recordSeq(pos) - pos);
+        if (diff == 0) {
+            if (g_enqueuePos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) {
+                return &g_records[pos & kQueueMask];
+            }
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            pos = g_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void publishRecord(EmLogRecord* pRecord, uint32_t pos) {
+    pRecord->seq.store(pos + 1 - (pos & kQueueMask));
+}
+
+bool isHeadPublished() {
+    uint32_t pos = g_dequeuePos.load(std::memory_order_relaxed);
+    return static_cast<int32_t>(recordSeq(pos) - (pos+1)) >= 0;
+}
+
+// Writes all the published records in sequence order.
+// NOTE: caller must own the 'g_writing' flag
+void writeRecords(EmLogTarget* targets, uint8_t targetsCount) {
+    g_inTargetsWrite = true;
+    while (isHeadPublished()) {
+        uint32_t pos = g_dequeuePos.load(std::memory_order_relaxed);
+        EmLogRecord& record = g_records[pos & kQueueMask];
+        const char* context = record.hasContext ? record.context : NULL;
+        for(uint8_t i=0; i<targetsCount; i++) {
+            if (targets[i].acceptsLevel(record.level)) {
+                targets[i].write(record.level, context, record.msg);
+            }
+        }
+        record.seq.store(pos + EM_LOG_QUEUE_SIZE - (pos & kQueueMask));
+        g_dequeuePos.store(pos+1, std::memory_order_relaxed);
+    }
+    g_inTargetsWrite = false;
+}
+
+void setRecordContext(EmLogRecord* pRecord, const char* context) {
+    pRecord->hasContext = context != NULL;
+    strncpy(pRecord->context, context != NULL ? context : "", EM_LOG_CONTEXT_NAME_LEN);
+    pRecord->context[EM_LOG_CONTEXT_NAME_LEN] = 0;
+}
+
+// Reserves the next free record. Returns NULL if the queue is full 
+// (i.e. message is dropped).
+EmLogRecord* claimRecord(uint32_t& pos) {
+    EmLogRecord* pRecord = tryClaimRecord(pos);
+    if (pRecord == NULL) {
+        // Make some room (if possible) and retry once
+        EmLog::flush();
+        pRecord = tryClaimRecord(pos);
+    }
+    return pRecord;
+}
+
+} // namespace
+
+EmLogTarget* EmLog::g_Targets = NULL;
+uint8_t EmLog::g_TargetsCount = 0;
+
+void EmLog::setTargets(EmLogTarget targets[], uint8_t targetsCount) {
+    if (g_inTargetsWrite) {
+        // Called by a target 'write': this thread owns 'g_writing' (i.e.
+        // waiting for it would deadlock), the records being written still
+        // go to the old targets
+        g_Targets = targets;
+        g_TargetsCount = targetsCount;
+        g_targetsLevelChanged = true;
+        return;
+    }
+    // Wait for the current writer (if any), this is not an hot path!
+    while (g_writing.test_and_set()) {
+        std::this_thread::yield();
+    }
+    writeRecords(g_Targets, g_TargetsCount);
+    g_Targets = targets;
+    g_TargetsCount = targetsCount;
+    g_TargetsLevel = targetsLevel(targets, targetsCount);
+    g_writing.clear();
+}
+
+void EmLog::updateTargetsLevel_(EmLogLevel level) {
+    // NOTE: no wait for the 'g_writing' flag, targets levels can be changed 
+    //       by a target 'write' (i.e. by the thread owning the flag).
+    //       Higher levels are set at once, lower ones when computed. 
+    g_targetsLevelChanged = true;
+    EmLogLevel current = g_TargetsLevel;
+    while (current < level && !g_TargetsLevel.compare_exchange_weak(current, level)) {
+    }
+    flush();
+}
+
+void EmLog::flush() {
+    // Try to write records without blocking the logging threads:
+    // if someone else is writing it will also write our pending records. 
+    while (!g_writing.test_and_set()) {
+        writeRecords(g_Targets, g_TargetsCount);
+        if (g_targetsLevelChanged.exchange(false)) {
+            g_TargetsLevel = targetsLevel(g_Targets, g_TargetsCount);
+        }
+        g_writing.clear();
+        // Records published (or target levels changed) while we were 
+        // releasing the flag? (their threads might have failed to get the flag)
+        if (!isHeadPublished() && !g_targetsLevelChanged) {
+            break;
+        }
+    }
+}
+
+void EmLog::writeToTargets_(EmLogLevel level, 
+                            EmLogContext* pContext, 
+                            const char* context, 
+                            const char* msg) { 
+    uint32_t pos;
+    EmLogRecord* pRecord = claimRecord(pos);
+    if (pRecord == NULL) {
+        count_(EmLogCounterId::dropped, level, pContext);
+        return;
     }
+    pRecord->level = level;
+    setRecordContext(pRecord, context);
+    strncpy(pRecord->msg, msg != NULL ? msg : "", EM_LOG_RECORD_LEN);
+    pRecord->msg[EM_LOG_RECORD_LEN] = 0;
+#ifdef EM_LOG_METRICS
+    count_(EmLogCounterId::bytes, level, pContext, strlen(pRecord->msg));
+#endif
+    publishRecord(pRecord, pos);
+    count_(EmLogCounterId::emitted, level, pContext);
+    flush();
 }
 
-void EmLog::writeToTargets_(EmLogLevel level, const char* context, const char* msg) { 
+void EmLog::writeToTargets_(EmLogLevel level, 
+                            EmLogContext* pContext, 
+                            const char* context, 
+                            const __FlashStringHelper* msg) { 
+    // Multithreading platforms (i.e. ESP) do not have a separate flash address space
+    writeToTargets_(level, pContext, context, reinterpret_cast<const char*>(msg));
+}
+
+void EmLog::writeToTargets_(EmLogLevel level, 
+                            EmLogContext* pContext, 
+                            const char* context, 
+                            uint8_t maxLen,
+                            const char* format,
+                            va_list args) { 
+    uint32_t pos;
+    EmLogRecord* pRecord = claimRecord(pos);
+    if (pRecord == NULL) {
+        count_(EmLogCounterId::dropped, level, pContext);
+        return;
+    }
+    pRecord->level = level;
+    setRecordContext(pRecord, context);
+    size_t size = MIN(static_cast<size_t>(maxLen), EM_LOG_RECORD_LEN)+1;
+    int len = vsnprintf(pRecord->msg, size, format, args);
+    publishRecord(pRecord, pos);
+    count_(EmLogCounterId::emitted, level, pContext);
+    count_(EmLogCounterId::bytes, level, pContext, 
+           len < 0 ? 0 : MIN(static_cast<size_t>(len), size-1));
+    flush();
+}
+
+#else
+
+EmLogTarget* EmLog::g_Targets = NULL;
+uint8_t EmLog::g_TargetsCount = 0;
+
+void EmLog::setTargets(EmLogTarget targets[], uint8_t targetsCount) {
+    g_Targets = targets;
+    g_TargetsCount = targetsCount;
+    g_TargetsLevel = targetsLevel(targets, targetsCount);
+}
+
+void EmLog::updateTargetsLevel_(EmLogLevel /*level*/) {
+    g_TargetsLevel = targetsLevel(g_Targets, g_TargetsCount);
+}
+
+void EmLog::flush() {
+    // Nothing to do, messages are written immediately to targets
+}
+
+void EmLog::writeToTargets_(EmLogLevel level, 
+                            EmLogContext* pContext, 
+                            const char* context, 
+                            const char* msg) { 
     for(uint8_t i=0; i<g_TargetsCount; i++) {
-        g_Targets[i].write(level, context, msg);
+        if (g_Targets[i].acceptsLevel(level)) {
+            g_Targets[i].write(level, context, msg);
+        }
     }
+    count_(EmLogCounterId::emitted, level, pContext);
+#ifdef EM_LOG_METRICS
+    count_(EmLogCounterId::bytes, level, pContext, msg != NULL ? strlen(msg) : 0);
+#endif
 }
 
 void EmLog::writeToTargets_(EmLogLevel level, 
+                            EmLogContext* pContext, 
                             const char* context, 
                             const __FlashStringHelper* msg) { 
     for(uint8_t i=0; i<g_TargetsCount; i++) {
-        g_Targets[i].write(level, context, msg);
+        if (g_Targets[i].acceptsLevel(level)) {
+            g_Targets[i].write(level, context, msg);
+        }
     }
+    count_(EmLogCounterId::emitted, level, pContext);
+#ifdef EM_LOG_METRICS
+    count_(EmLogCounterId::bytes, level, pContext, msg != NULL ? flashStrLen(msg) : 0);
+#endif
 }
 
+#endif // EM_MULTITHREAD
+
 #endif
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include "em_log_ring.h"
+
+#include <string.h>
+
+#ifdef AVR
+#include <avr/pgmspace.h>
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define EM_LOG_RING_MAGIC 0x474E5245 // "ERNG"
+#define EM_LOG_RING_VERSION 1
+
+bool EmLogRingTarget::begin() {
+    if (m_pMemory == nullptr || 
+        m_recordSize < sizeof(RecordHeader) + 4 || 
+        m_recordSize % 4 != 0 ||
+        m_size < sizeof(Header) + m_recordSize) {
+        return false;
+    }
+    Header* pHeader = header_();
+    if (pHeader->magic != EM_LOG_RING_MAGIC ||
+        pHeader->version != EM_LOG_RING_VERSION ||
+        pHeader->recordSize != m_recordSize ||
+        pHeader->recordsCount != capacity()) {
+        clear();
+        return true;
+    }
+    // Look for the last written record
+    uint32_t lastSeq = 0;
+    for (uint32_t i=0; i < pHeader->recordsCount; i++) {
+        RecordHeader* pRecord = reinterpret_cast<RecordHeader*>(
+            m_pMemory + sizeof(Header) + i * m_recordSize);
+        if (pRecord->seq > lastSeq && isValid_(pRecord, pRecord->seq)) {
+            lastSeq = pRecord->seq;
+        }
+    }
+    m_nextSeq = lastSeq + 1;
+    return true;
+}
+
+void EmLogRingTarget::clear() {
+    if (m_pMemory == nullptr) {
+        return;
+    }
+    Header* pHeader = header_();
+    pHeader->magic = EM_LOG_RING_MAGIC;
+    pHeader->version = EM_LOG_RING_VERSION;
+    pHeader->recordSize = m_recordSize;
+    pHeader->recordsCount = capacity();
+    memset(m_pMemory + sizeof(Header), 0, pHeader->recordsCount * m_recordSize);
+    m_nextSeq = 1;
+}
+
+uint32_t EmLogRingTarget::capacity() const {
+    if (m_size < sizeof(Header) || m_recordSize == 0) {
+        return 0;
+    }
+    return static_cast<uint32_t>((m_size - sizeof(Header)) / m_recordSize);
+}
+
+uint32_t EmLogRingTarget::forEach(EmLogRingVisitor visitor, void* pUserData) const {
+    if (!isInitialized()) {
+        return 0;
+    }
+    uint32_t count = header_()->recordsCount;
+    uint32_t firstSeq = m_nextSeq > count ? m_nextSeq - count : 1;
+    uint32_t visited = 0;
+    for (uint32_t seq = firstSeq; seq < m_nextSeq; seq++) {
+        const RecordHeader* pRecord = record_(seq);
+        if (!isValid_(pRecord, seq)) {
+            continue;
+        }
+        const char* data = reinterpret_cast<const char*>(pRecord + 1);
+        EmLogRingRecord record = { seq, 
+                                   static_cast<EmLogLevel>(pRecord->level),
+                                   pRecord->contextLen > 0 ? data : NULL,
+                                   data + pRecord->contextLen + 1 };
+        visited++;
+        if (!visitor(record, pUserData)) {
+            break;
+        }
+    }
+    return visited;
+}
+
+uint32_t EmLogRingTarget::dump(EmLogTarget& target) const {
+    return forEach([](const EmLogRingRecord& record, void* pTarget) -> bool {
+        static_cast<EmLogTarget*>(pTarget)->write(record.level, record.context, record.msg);
+        return true;
+    }, &target);
+}
+
+void EmLogRingTarget::write(EmLogLevel level,
+                            const char* context,
+                            const char* msg) {
+    if (msg == NULL) {
+        return;
+    }
+    RecordHeader* pRecord = beginWrite_(level, context, strlen(msg));
+    if (pRecord != nullptr) {
+        memcpy(msg_(pRecord), msg, pRecord->msgLen);
+        endWrite_(pRecord);
+    }
+}
+
+void EmLogRingTarget::write(EmLogLevel level,
+                            const char* context,
+                            const __FlashStringHelper* msg) {
+    if (msg == NULL) {
+        return;
+    }
+    const char* pMsg = reinterpret_cast<const char*>(msg);
+#ifdef AVR
+    RecordHeader* pRecord = beginWrite_(level, context, strlen_P(pMsg));
+    if (pRecord != nullptr) {
+        memcpy_P(msg_(pRecord), pMsg, pRecord->msgLen);
+        endWrite_(pRecord);
+    }
+#else
+    write(level, context, pMsg);
+#endif
+}
+
+bool EmLogRingTarget::isValid_(const RecordHeader* pRecord, uint32_t seq) const {
+    if (pRecord->seq != seq || seq == 0 ||
+        sizeof(RecordHeader) + pRecord->contextLen + pRecord->msgLen + 2 > m_recordSize) {
+        return false;
+    }
+    return pRecord->crc == crc_(pRecord);
+}
+
+uint32_t EmLogRingTarget::crc_(const RecordHeader* pRecord) {
+    // Both null terminators are included
+    size_t dataLen = sizeof(RecordHeader) - offsetof(RecordHeader, level) + 
+                     pRecord->contextLen + pRecord->msgLen + 2;
+    uint32_t crc = emCrc32(&pRecord->seq, sizeof(pRecord->seq));
+    return emCrc32(&pRecord->level, dataLen, crc);
+}
+
+EmLogRingTarget::RecordHeader* EmLogRingTarget::beginWrite_(EmLogLevel level, 
+                                                            const char* context, 
+                                                            size_t msgLen) {
+    if (!isInitialized()) {
+        return nullptr;
+    }
+    // Space for context and message chars (null terminators excluded)
+    size_t space = m_recordSize - sizeof(RecordHeader) - 2;
+    size_t contextLen = context != NULL ? MIN(strlen(context), MIN(space / 2, 255u)) : 0;
+    RecordHeader* pRecord = record_(m_nextSeq);
+    pRecord->seq = m_nextSeq++;
+    pRecord->level = static_cast<int8_t>(level);
+    pRecord->contextLen = static_cast<uint8_t>(contextLen);
+    pRecord->msgLen = static_cast<uint16_t>(MIN(msgLen, space - contextLen));
+    char* data = reinterpret_cast<char*>(pRecord + 1);
+    if (contextLen != 0) {
+        memcpy(data, context, contextLen);
+    }
+    data[contextLen] = 0;
+    return pRecord;
+}
+
+void EmLogRingTarget::endWrite_(RecordHeader* pRecord) {
+    msg_(pRecord)[pRecord->msgLen] = 0;
+    pRecord->crc = crc_(pRecord);
+}
+
+#ifdef __linux__
+
+bool EmLogFileRingTarget::begin() {
+    if (m_pMemory != nullptr) {
+        return false;
+    }
+    int fd = open(m_path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(m_size)) != 0) {
+        close(fd);
+        return false;
+    }
+    void* pMemory = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // The mapping keeps the file referenced
+    close(fd);
+    if (pMemory == MAP_FAILED) {
+        return false;
+    }
+    m_pMemory = static_cast<uint8_t*>(pMemory);
+    if (!EmLogRingTarget::begin()) {
+        end();
+        return false;
+    }
+    return true;
+}
+
+void EmLogFileRingTarget::end() {
+    if (m_pMemory != nullptr) {
+        munmap(m_pMemory, m_size);
+        m_pMemory = nullptr;
+        m_nextSeq = 0;
+    }
+}
+
+bool EmLogFileRingTarget::sync() {
+    return m_pMemory != nullptr && msync(m_pMemory, m_size, MS_SYNC) == 0;
+}
+
+#endif // __linux__
@@ -0,0 +1,71 @@
+#include "em_serial.h"
+
+#define EM_SERIAL_FORMAT 0xE5
+
+size_t emSerialEncode(const EmSerialSchema& schema, const void* value, void* buf, size_t bufSize) {
+    const uint8_t* pValue = static_cast<const uint8_t*>(value);
+    uint8_t* p = static_cast<uint8_t*>(buf);
+    size_t len = 2;
+    for (uint8_t i=0; i < schema.fieldsCount; i++) {
+        len += 2 + schema.fields[i].size;
+    }
+    if (len + sizeof(uint32_t) > bufSize) {
+        return 0;
+    }
+    *p++ = EM_SERIAL_FORMAT;
+    *p++ = schema.version;
+    for (uint8_t i=0; i < schema.fieldsCount; i++) {
+        const EmSerialField& field = schema.fields[i];
+        *p++ = field.tag;
+        *p++ = field.size;
+        memcpy(p, pValue + field.offset, field.size);
+        p += field.size;
+    }
+    uint32_t crc = emCrc32(buf, len);
+    memcpy(p, &crc, sizeof(crc));
+    return len + sizeof(crc);
+}
+
+int emSerialDecode(const EmSerialSchema& schema, const void* buf, size_t len, void* value) {
+    const uint8_t* p = static_cast<const uint8_t*>(buf);
+    if (len < 2 + sizeof(uint32_t) || p[0] != EM_SERIAL_FORMAT) {
+        return -1;
+    }
+    len -= sizeof(uint32_t);
+    uint32_t crc;
+    memcpy(&crc, p + len, sizeof(crc));
+    if (crc != emCrc32(buf, len)) {
+        return -1;
+    }
+    // Fields might be in any order (i.e. a schema lookup per field)
+    uint8_t* pValue = static_cast<uint8_t*>(value);
+    const uint8_t* pEnd = p + len;
+    int version = p[1];
+    uint8_t hint = 0;
+    for (p += 2; p + 2 <= pEnd && p + 2 + p[1] <= pEnd; p += 2 + p[1]) {
+        uint8_t tag = p[0];
+        uint8_t size = p[1];
+        for (uint8_t n=0; n < schema.fieldsCount; n++) {
+            // NOTE: same order of the schema (i.e. next field first)
+            uint8_t i = (hint + n) % schema.fieldsCount;
+            const EmSerialField& field = schema.fields[i];
+            if (field.tag != tag) {
+                continue;
+            }
+            hint = i + 1;
+            if (size != field.size && field.kind == EmSerialKind::other) {
+                break;
+            }
+            // NOTE: little endian integers (i.e. low bytes first)
+            memcpy(pValue + field.offset, p + 2, MIN(size, field.size));
+            if (size < field.size) {
+                bool negative = field.kind == EmSerialKind::signedInt &&
+                                size != 0 &&
+                                (p[2 + size - 1] & 0x80) != 0;
+                memset(pValue + field.offset + size, negative ? 0xFF : 0, field.size - size);
+            }
+            break;
+        }
+    }
+    return p == pEnd ? version : -1;
+}
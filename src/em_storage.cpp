@@ -1,41 +1,32 @@
 #include "em_storage.h"
 
-#ifdef EM_NVS
-
-// Error codes for NVS operations
-const char* nvs_errors[] = { "UNDEFINED ERROR", 
-                             "NOT_INITIALIZED", 
-                             "NOT_FOUND", 
-                             "TYPE_MISMATCH", 
-                             "READ_ONLY", 
-                             "NOT_ENOUGH_SPACE", 
-                             "INVALID_NAME", 
-                             "INVALID_HANDLE", 
-                             "REMOVE_FAILED", 
-                             "KEY_TOO_LONG", 
-                             "PAGE_FULL", 
-                             "INVALID_STATE", 
-                             "INVALID_LENGTH"};
-#define nvs_error(e) (((e)>ESP_ERR_NVS_BASE)?nvs_errors[(e)&~(ESP_ERR_NVS_BASE)]:nvs_errors[0])
+#ifdef ARDUINO
+#include <new>
+#endif
 
+#define EM_STORAGE_TX_MAGIC 0x58544D45 // "EMTX"
 
 bool EmStorage::begin(const char * name) {
     if (isInitialized()) {
         return false;
     }
-    esp_err_t err = ESP_OK;
-    err = nvs_open(name, NVS_READWRITE, &m_handle);
-    if (err) {
-        logError<50>("begin failed: %s", nvs_error(err));
+    EmStorageError err = m_backend.open(name);
+    if (err != EmStorageError::none) {
+        logError<50>("begin failed: %s", storageErrorToStr(err));
         return false;
     }
+    changed_();
+    recoverTx_();
     return true;
 }
 
 void EmStorage::end() {
     if (isInitialized()) {
-        nvs_close(m_handle);
-        m_handle = -1;
+        m_backend.close();
+        if (m_backend.isOpen()) {
+            // NOTE: backends failing to flush are not closed (e.g. write-back cache)
+            logError("close fail: not flushed");
+        }
     }
 }
 
@@ -43,11 +34,12 @@ bool EmStorage::clear() const {
     if (isNotInitialized()) {
         return false;
     }
-    esp_err_t err = nvs_erase_all(m_handle);
-    if (err) {
-        logError<50>("nvs_erase_all fail: %s", nvs_error(err));
+    EmStorageError err = m_backend.eraseAll();
+    if (err != EmStorageError::none) {
+        logError<50>("eraseAll fail: %s", storageErrorToStr(err));
         return false;
     }
+    changed_();
     return commit();
 }
 
@@ -55,129 +47,444 @@ bool EmStorage::commit() const {
     if (isNotInitialized()) {
         return false;
     }
-    esp_err_t err = nvs_commit(m_handle);
-    if (err) {
-        logError<50>("nvs_commit fail: %s", nvs_error(err));
+    uint32_t startUs = statsTime_();
+    EmStorageError err = m_backend.commit();
+    countOp_(EmStorageOp::commit, startUs, err == EmStorageError::none, 0);
+    if (err != EmStorageError::none) {
+        logError<50>("commit fail: %s", storageErrorToStr(err));
         return false;
     }
     return true;
 }
 
+bool EmStorage::flush() const {
+    if (isNotInitialized()) {
+        return false;
+    }
+    EmStorageError err = m_backend.flush();
+    if (err != EmStorageError::none) {
+        logError<50>("flush fail: %s", storageErrorToStr(err));
+        return false;
+    }
+    return true;
+}
+
+void EmStorage::beginBatch() {
+    m_batchDepth++;
+}
+
+void EmStorage::endBatch() {
+    if (m_batchDepth == 0 || --m_batchDepth != 0) {
+        return;
+    }
+    if (m_batchCommit) {
+        m_batchCommit = false;
+        commit();
+    }
+}
+
+bool EmStorage::commit_() const {
+    if (m_batchDepth != 0) {
+#ifdef EM_STORAGE_STATS
+        EmMutexLock lock(m_statsMutex);
+        m_stats.deferredCommits++;
+#endif
+        m_batchCommit = true;
+        return true;
+    }
+    return commit();
+}
+
 size_t EmStorage::putString(const char* key, const char* value, bool commit) const {
     if (!isInitialized() || !key || !value) {
         return 0;
     }
-    esp_err_t err = nvs_set_str(m_handle, key, value);
-    if (err) {
-        logError<50>("nvs_set_str fail: %s %s", key, nvs_error(err));
+    if (m_inTx) {
+        return stage_(key, TxType::string, value, strlen(value) + 1) ? strlen(value) : 0;
+    }
+    uint32_t startUs = statsTime_();
+    EmStorageError err = m_backend.setString(key, value);
+    countOp_(EmStorageOp::put, startUs, err == EmStorageError::none, strlen(value) + 1);
+    if (err != EmStorageError::none) {
+        logError<50>("setString fail: %s %s", keyName_(key), storageErrorToStr(err));
         return 0;
     }
-    if (commit && !this->commit()) {
+    changed_();
+    if (commit && !commit_()) {
         return 0;
     }
     return strlen(value);
 }
 
+#ifdef ARDUINO
 size_t EmStorage::putString(const char* key, const String& value, bool commit) const {
     return putString(key, value.c_str(), commit);
 }
+#endif
 
 size_t EmStorage::putBytes(const char* key, const void* value, size_t len, bool commit) const {
     if (!isInitialized() || !key || !value || !len) {
         return 0;
     }
-    esp_err_t err = nvs_set_blob(m_handle, key, value, len);
-    if (err) {
-        logError<50>("nvs_set_blob fail: %s %s", key, nvs_error(err));
+    if (m_inTx) {
+        return stage_(key, TxType::blob, value, len) ? len : 0;
+    }
+    uint32_t startUs = statsTime_();
+    EmStorageError err = m_backend.setBlob(key, value, len);
+    countOp_(EmStorageOp::put, startUs, err == EmStorageError::none, len);
+    if (err != EmStorageError::none) {
+        logError<50>("setBlob fail: %s %s", keyName_(key), storageErrorToStr(err));
         return 0;
     }
-    if (commit && !this->commit()) {
+    changed_();
+    if (commit && !commit_()) {
         return 0;
     }
     return len;
 }
 
+bool EmStorage::remove(const char* key, bool commit) const {
+    if (!isInitialized() || !key) {
+        return false;
+    }
+    if (m_inTx) {
+        return stage_(key, TxType::remove, nullptr, 0);
+    }
+    uint32_t startUs = statsTime_();
+    EmStorageError err = m_backend.erase(key);
+    countOp_(EmStorageOp::remove, startUs,
+             err == EmStorageError::none || err == EmStorageError::notFound, 0);
+    if (err == EmStorageError::notFound) {
+        return true;
+    }
+    if (err != EmStorageError::none) {
+        logError<50>("erase fail: %s %s", keyName_(key), storageErrorToStr(err));
+        return false;
+    }
+    changed_();
+    return !commit || commit_();
+}
+
+bool EmStorage::beginTx() {
+    if (isNotInitialized() || m_inTx || m_pTx == nullptr || m_txSize <= sizeof(TxHeader)) {
+        return false;
+    }
+    m_inTx = true;
+    m_txFailed = false;
+    m_txUsed = sizeof(TxHeader);
+    return true;
+}
+
+void EmStorage::abortTx() {
+    m_inTx = false;
+}
+
+bool EmStorage::commitTx() {
+    if (!m_inTx) {
+        return false;
+    }
+    m_inTx = false;
+    if (m_txFailed) {
+        return false;
+    }
+    size_t size = m_txUsed - sizeof(TxHeader);
+    if (size == 0) {
+        return true;
+    }
+    const uint8_t* records = m_pTx + sizeof(TxHeader);
+    // A single write is atomic: no need of the journal
+    TxRecord record;
+    memcpy(&record, records, sizeof(record));
+    // NOTE: the backend is flushed (i.e. not just committed) at each step
+    //       so that each step is durable before the next one starts
+    if (sizeof(TxRecord) + record.keyLen + record.len == size) {
+        return apply_(records, size) && flush();
+    }
+    // Journal first (i.e. the commit point), then the values
+    TxHeader header;
+    header.magic = EM_STORAGE_TX_MAGIC;
+    header.crc = emCrc32(records, size);
+    header.size = static_cast<uint32_t>(size);
+    memcpy(m_pTx, &header, sizeof(header));
+    EmStorageError err = m_backend.setBlob(EM_STORAGE_TX_KEY, m_pTx, m_txUsed);
+    if (err != EmStorageError::none) {
+        logError<50>("journal write fail: %s", storageErrorToStr(err));
+        return false;
+    }
+    if (!flush()) {
+        return false;
+    }
+    // Values first, then the journal removal
+    // NOTE: the journal is kept if a value is not written (i.e. next 'begin'
+    //       retries the transaction)
+    if (!apply_(records, size) || !flush()) {
+        return false;
+    }
+    return eraseTx_();
+}
+
+bool EmStorage::eraseTx_() {
+    EmStorageError err = m_backend.erase(EM_STORAGE_TX_KEY);
+    if (err != EmStorageError::none && err != EmStorageError::notFound) {
+        logError<50>("journal erase fail: %s", storageErrorToStr(err));
+        return false;
+    }
+    return flush();
+}
+
+bool EmStorage::stage_(const char* key, TxType type, const void* value, size_t len) const {
+    if (m_txFailed) {
+        return false;
+    }
+    size_t keyLen = strlen(key);
+    size_t recordSize = sizeof(TxRecord) + keyLen + len;
+    if (keyLen > EM_STORAGE_MAX_KEY_LEN || len > 0xFFFF || m_txUsed + recordSize > m_txSize) {
+        logError<50>("transaction staging fail: %s", keyName_(key));
+        m_txFailed = true;
+        return false;
+    }
+    TxRecord record;
+    record.type = static_cast<uint8_t>(type);
+    record.keyLen = static_cast<uint8_t>(keyLen);
+    record.len = static_cast<uint16_t>(len);
+    uint8_t* p = m_pTx + m_txUsed;
+    memcpy(p, &record, sizeof(record));
+    memcpy(p + sizeof(record), key, keyLen);
+    if (len != 0) {
+        memcpy(p + sizeof(record) + keyLen, value, len);
+    }
+    m_txUsed += recordSize;
+    return true;
+}
+
+bool EmStorage::apply_(const uint8_t* records, size_t size) const {
+    bool res = true;
+    const uint8_t* p = records;
+    const uint8_t* pEnd = records + size;
+    while (p + sizeof(TxRecord) <= pEnd) {
+        TxRecord record;
+        memcpy(&record, p, sizeof(record));
+        char key[EM_STORAGE_MAX_KEY_LEN+1];
+        memcpy(key, p + sizeof(record), record.keyLen);
+        key[record.keyLen] = 0;
+        const uint8_t* value = p + sizeof(record) + record.keyLen;
+        EmStorageError err;
+        switch (static_cast<TxType>(record.type)) {
+            case TxType::string:
+                err = m_backend.setString(key, reinterpret_cast<const char*>(value));
+                break;
+            case TxType::remove:
+                err = m_backend.erase(key);
+                if (err == EmStorageError::notFound) {
+                    err = EmStorageError::none;
+                }
+                break;
+            default:
+                err = m_backend.setBlob(key, value, record.len);
+                break;
+        }
+        if (err != EmStorageError::none) {
+            logError<50>("transaction write fail: %s %s", keyName_(key), storageErrorToStr(err));
+            res = false;
+        }
+        p = value + record.len;
+    }
+    changed_();
+    return res;
+}
+
+void EmStorage::recoverTx_() {
+    size_t len = m_txSize;
+    EmStorageError err = m_pTx != nullptr ?
+        m_backend.getBlob(EM_STORAGE_TX_KEY, m_pTx, len) :
+        m_backend.getBlob(EM_STORAGE_TX_KEY, nullptr, len);
+    if (err == EmStorageError::notFound) {
+        return;
+    }
+    if (m_pTx == nullptr || err != EmStorageError::none) {
+        logError<50>("interrupted transaction not recovered: %s",
+                     m_pTx == nullptr ? "no buffer" : storageErrorToStr(err));
+        return;
+    }
+    TxHeader header;
+    memcpy(&header, m_pTx, sizeof(header));
+    const uint8_t* records = m_pTx + sizeof(TxHeader);
+    if (header.magic == EM_STORAGE_TX_MAGIC &&
+        header.size + sizeof(TxHeader) == len &&
+        header.crc == emCrc32(records, header.size)) {
+        logWarning("completing interrupted transaction");
+        if (!apply_(records, header.size) || !flush()) {
+            // Kept for next 'begin'
+            logError("interrupted transaction not completed");
+            return;
+        }
+    } else {
+        logError("invalid transaction journal discarded");
+    }
+    eraseTx_();
+}
+
 size_t EmStorage::getString(const char* key, char* value, const size_t maxLen) const {
-    size_t len = 0;
+    size_t len = maxLen;
     if (!isInitialized() || !key || !value || !maxLen) {
         return 0;
     }
-    esp_err_t err = nvs_get_str(m_handle, key, NULL, &len);
-    if (err) {
-        logError<50>("nvs_get_str len fail: %s %s", key, nvs_error(err));
+    // NOTE: a single read, the backend checks the value fits the buffer
+    uint32_t startUs = statsTime_();
+    EmStorageError err = m_backend.getString(key, value, len);
+    countOp_(EmStorageOp::get, startUs, err == EmStorageError::none, len);
+    if (err == EmStorageError::invalidLength) {
+        logError<50>("not enough space in value: %u", maxLen);
         return 0;
     }
-    if (len > maxLen) {
-        logError<50>("not enough space in value: %u < %u", maxLen, len);
-        return 0;
-    }
-    err = nvs_get_str(m_handle, key, value, &len);
-    if (err) {
-        logError<50>("nvs_get_str fail: %s %s", key, nvs_error(err));
+    if (err != EmStorageError::none) {
+        logError<50>("getString fail: %s %s", keyName_(key), storageErrorToStr(err));
         return 0;
     }
     return len;
 }
 
+#ifdef ARDUINO
+// The chunk buffer of 'String' reads (i.e. stack bytes)
+#define EM_STORAGE_STRING_CHUNK 32
+
+// The 'String' chunks appending state
+struct StringChunks {
+    String* pValue;
+    bool failed; // Not enough memory
+};
+
+static bool appendChunk(const EmStorageChunk& chunk, void* pUserData) {
+    StringChunks* pChunks = static_cast<StringChunks*>(pUserData);
+    size_t len = chunk.len;
+    // Null terminator excluded
+    if (len != 0 && chunk.offset + len == chunk.size) {
+        len--;
+    }
+    if (!pChunks->pValue->concat(static_cast<const char*>(chunk.data),
+                                 static_cast<unsigned int>(len))) {
+        pChunks->failed = true;
+        return false;
+    }
+    return true;
+}
+
 String EmStorage::getString(const char* key, const char* defaultValue) const {
-    char * value = NULL;
     size_t len = 0;
     if (!isInitialized() || !key) {
         return String(defaultValue);
     }
-    esp_err_t err = nvs_get_str(m_handle, key, value, &len);
-    if (err) {
-        logError<50>("nvs_get_str len fail: %s %s", key, nvs_error(err));
+    EmStorageError err = m_backend.getString(key, nullptr, len);
+    if (err != EmStorageError::none) {
+        logError<50>("getString len fail: %s %s", keyName_(key), storageErrorToStr(err));
+        return String(defaultValue);
+    }
+    // NOTE: chunks are appended to the string (i.e. no copies of the value
+    //       when the backend reads in chunks)
+    String value;
+    if (len > 1 && !value.reserve(static_cast<unsigned int>(len - 1))) {
+        logError<50>("not enough memory: %u", len);
+        return String(defaultValue);
+    }
+    char chunk[EM_STORAGE_STRING_CHUNK];
+    StringChunks chunks = { &value, false };
+    uint32_t startUs = statsTime_();
+    err = m_backend.getChunks(key, true, chunk, sizeof(chunk), appendChunk, &chunks);
+    if (err == EmStorageError::invalidLength) {
+        // Not read in chunks (e.g. NVS, values longer than the chunk buffer):
+        // read into a temporary heap copy
+        char* buf = new (std::nothrow) char[len];
+        if (buf == nullptr) {
+            logError<50>("not enough memory: %u", len);
+            return String(defaultValue);
+        }
+        err = m_backend.getString(key, buf, len);
+        if (err == EmStorageError::none) {
+            value = buf;
+            chunks.failed = value.length() + 1 != len;
+        }
+        delete[] buf;
+    }
+    countOp_(EmStorageOp::get, startUs, err == EmStorageError::none, len);
+    if (err != EmStorageError::none) {
+        logError<50>("getString fail: %s %s", keyName_(key), storageErrorToStr(err));
         return String(defaultValue);
     }
-    char buf[len];
-    value = buf;
-    err = nvs_get_str(m_handle, key, value, &len);
-    if (err) {
-        logError<50>("nvs_get_str fail: %s %s", key, nvs_error(err));
+    if (chunks.failed) {
+        logError<50>("not enough memory: %u", len);
         return String(defaultValue);
     }
-    return String(buf);
+    return value;
 }
+#endif
 
 size_t EmStorage::getBytesLength(const char* key) const {
     size_t len = 0;
     if (!isInitialized() || !key) {
         return 0;
     }
-    esp_err_t err = nvs_get_blob(m_handle, key, NULL, &len);
-    if (err) {
-        logError<50>("nvs_get_blob len fail: %s %s", key, nvs_error(err));
+    EmStorageError err = m_backend.getBlob(key, NULL, len);
+    if (err != EmStorageError::none) {
+        logError<50>("getBlob len fail: %s %s", keyName_(key), storageErrorToStr(err));
         return 0;
     }
     return len;
 }
 
 size_t EmStorage::getBytes(const char* key, void * buf, size_t maxLen) const {
-    size_t len = getBytesLength(key);
-    if (!len || !buf || !maxLen) {
-        return len;
+    if (!buf || !maxLen) {
+        return getBytesLength(key);
     }
-    if (len > maxLen) {
-        logError<50>("not enough space in buffer: %u < %u", maxLen, len);
+    if (!isInitialized() || !key) {
+        return 0;
+    }
+    // NOTE: a single read, the backend checks the value fits the buffer
+    size_t len = maxLen;
+    uint32_t startUs = statsTime_();
+    EmStorageError err = m_backend.getBlob(key, buf, len);
+    countOp_(EmStorageOp::get, startUs, err == EmStorageError::none, len);
+    if (err == EmStorageError::invalidLength) {
+        logError<50>("not enough space in buffer: %u", maxLen);
         return 0;
     }
-    esp_err_t err = nvs_get_blob(m_handle, key, buf, &len);
-    if (err) {
-        logError<50>("nvs_get_blob fail: %s %s", key, nvs_error(err));
+    if (err != EmStorageError::none) {
+        logError<50>("getBlob fail: %s %s", keyName_(key), storageErrorToStr(err));
         return 0;
     }
     return len;
 }
 
+bool EmStorage::readBytes(const char* key,
+                          void* buf,
+                          size_t bufSize,
+                          EmStorageChunkVisitor visitor,
+                          void* pUserData) const {
+    if (!isInitialized() || !key || !visitor) {
+        return false;
+    }
+    uint32_t startUs = statsTime_();
+    EmStorageError err = m_backend.getChunks(key, false, buf, bufSize, visitor, pUserData);
+    countOp_(EmStorageOp::get, startUs, err == EmStorageError::none, 0);
+    if (err != EmStorageError::none) {
+        logError<50>("getChunks fail: %s %s", keyName_(key), storageErrorToStr(err));
+        return false;
+    }
+    return true;
+}
+
 size_t EmStorage::freeEntries() const {
-    nvs_stats_t nvs_stats;
-    esp_err_t err = nvs_get_stats(NULL, &nvs_stats);
-    if (err) {
-        logError<50>("Failed to get nvs statistics");
+    size_t entries = 0;
+    EmStorageError err = m_backend.freeEntries(entries);
+    if (err != EmStorageError::none) {
+        logError<50>("Failed to get storage statistics");
         return 0;
     }
-    return nvs_stats.free_entries;
+#ifdef EM_STORAGE_STATS
+    EmMutexLock lock(m_statsMutex);
+    m_stats.freeEntries = static_cast<uint32_t>(entries);
+    if (m_stats.freeEntries < m_stats.minFreeEntries) {
+        m_stats.minFreeEntries = m_stats.freeEntries;
+    }
+#endif
+    return entries;
 }
-
-#endif
\ No newline at end of file
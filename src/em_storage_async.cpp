@@ -0,0 +1,436 @@
+#include "em_storage_async.h"
+
+EmStorageError EmAsyncStorageBackend::open(const char* name) {
+    EmStorageError err;
+    {
+        EmMutexLock lock(m_backendMutex);
+        err = m_backend.open(name);
+    }
+    if (err != EmStorageError::none) {
+        return err;
+    }
+    for (uint8_t i=0; i < SIZE_OF(m_queues); i++) {
+        m_queues[i].used = 0;
+        m_queues[i].segment = 0;
+    }
+    m_started = m_requested;
+    m_done = m_requested;
+    m_drain = false;
+    m_uncommitted = false;
+    m_lastError = EmStorageError::none;
+#ifdef EM_MULTITHREAD
+    m_stop = false;
+    m_thread = std::thread(&EmAsyncStorageBackend::run_, this);
+#endif
+    return EmStorageError::none;
+}
+
+void EmAsyncStorageBackend::close() {
+    if (!isOpen()) {
+        return;
+    }
+    flush();
+#ifdef EM_MULTITHREAD
+    {
+        EmMutexLock lock(m_mutex);
+        m_stop = true;
+    }
+    m_workCv.notify_one();
+    m_thread.join();
+#endif
+    EmMutexLock lock(m_backendMutex);
+    m_backend.close();
+}
+
+const EmAsyncStorageBackend::Record* EmAsyncStorageBackend::find_(const Queue& queue, const char* key) {
+    const Record* pFound = nullptr;
+    size_t keyLen = strlen(key);
+    for (size_t offset=0; offset < queue.used; ) {
+        const Record* pRecord = reinterpret_cast<const Record*>(queue.data + offset);
+        RecordType type = static_cast<RecordType>(pRecord->type);
+        if (type == RecordType::eraseAll ||
+            (type != RecordType::commit && pRecord->keyLen == keyLen &&
+             memcmp(key_(pRecord), key, keyLen) == 0)) {
+            pFound = pRecord;
+        }
+        offset += recordSize_(pRecord->keyLen, pRecord->len);
+    }
+    return pFound;
+}
+
+void EmAsyncStorageBackend::remove_(Queue& queue, const char* key) {
+    if (key == nullptr) {
+        queue.used = queue.segment;
+        return;
+    }
+    size_t keyLen = strlen(key);
+    for (size_t offset=queue.segment; offset < queue.used; ) {
+        Record* pRecord = reinterpret_cast<Record*>(queue.data + offset);
+        size_t size = recordSize_(pRecord->keyLen, pRecord->len);
+        if (static_cast<RecordType>(pRecord->type) != RecordType::eraseAll &&
+            pRecord->keyLen == keyLen && memcmp(key_(pRecord), key, keyLen) == 0) {
+            // NOTE: a key has one record per segment
+            memmove(queue.data + offset, queue.data + offset + size, queue.used - offset - size);
+            queue.used -= size;
+            return;
+        }
+        offset += size;
+    }
+}
+
+EmStorageError EmAsyncStorageBackend::read_(const Record* pRecord, RecordType type, void* buf, size_t& len) {
+    RecordType recordType = static_cast<RecordType>(pRecord->type);
+    if (recordType == RecordType::erase || recordType == RecordType::eraseAll) {
+        return EmStorageError::notFound;
+    }
+    if (recordType != type) {
+        return EmStorageError::typeMismatch;
+    }
+    if (buf == nullptr) {
+        len = pRecord->len;
+        return EmStorageError::none;
+    }
+    if (len < pRecord->len) {
+        return EmStorageError::invalidLength;
+    }
+    len = pRecord->len;
+    memcpy(buf, value_(pRecord), len);
+    return EmStorageError::none;
+}
+
+const EmAsyncStorageBackend::Record* EmAsyncStorageBackend::staged_(const char* key) const {
+    if (key == nullptr || strlen(key) > EM_STORAGE_MAX_KEY_LEN) {
+        return nullptr;
+    }
+    // Staging queue first (i.e. the latest writes)
+    const Record* pRecord = find_(*m_pPending, key);
+    return pRecord != nullptr ? pRecord : find_(*m_pInflight, key);
+}
+
+void EmAsyncStorageBackend::append_(RecordType type,
+                                    const char* key,
+                                    size_t keyLen,
+                                    const void* value,
+                                    size_t len) {
+    Queue& queue = *m_pPending;
+    Record* pRecord = reinterpret_cast<Record*>(queue.data + queue.used);
+    pRecord->type = static_cast<uint8_t>(type);
+    pRecord->keyLen = static_cast<uint8_t>(keyLen);
+    pRecord->len = static_cast<uint16_t>(len);
+    char* pKey = reinterpret_cast<char*>(pRecord + 1);
+    if (keyLen != 0) {
+        memcpy(pKey, key, keyLen);
+    }
+    pKey[keyLen] = 0;
+    if (len != 0) {
+        memcpy(pKey + keyLen + 1, value, len);
+    }
+    queue.used += recordSize_(keyLen, len);
+    if (type == RecordType::commit) {
+        queue.segment = queue.used;
+    }
+}
+
+EmStorageError EmAsyncStorageBackend::stage_(RecordType type,
+                                             const char* key,
+                                             const void* value,
+                                             size_t len) {
+    if (!isOpen()) {
+        return EmStorageError::invalidHandle;
+    }
+    size_t keyLen = 0;
+    if (type != RecordType::eraseAll && type != RecordType::commit) {
+        if (key == nullptr || key[0] == 0) {
+            return EmStorageError::invalidName;
+        }
+        keyLen = strlen(key);
+        if (keyLen > EM_STORAGE_MAX_KEY_LEN) {
+            return EmStorageError::keyTooLong;
+        }
+    }
+    size_t size = recordSize_(keyLen, len);
+    if (len > 0xFFFF || size > m_queueSize) {
+        // Bigger than the queue: written through once the queue is drained
+        flush();
+        EmMutexLock lock(m_backendMutex);
+        m_uncommitted = true;
+        return write_(type, key, value, len);
+    }
+#ifdef EM_MULTITHREAD
+    std::unique_lock<std::mutex> lock(m_mutex);
+#else
+    EmMutexLock lock(m_mutex);
+#endif
+    // A commit with nothing written since the last one gets its ticket
+    bool merge = type == RecordType::commit &&
+                 m_pPending->used != 0 && m_pPending->segment == m_pPending->used;
+    if (!merge) {
+        if (type != RecordType::commit) {
+            remove_(*m_pPending, type == RecordType::eraseAll ? nullptr : key);
+        }
+        while (m_pPending->used + size > m_queueSize) {
+#ifdef EM_MULTITHREAD
+            m_drain = true;
+            m_workCv.notify_one();
+            m_doneCv.wait(lock);
+#else
+            process_();
+#endif
+        }
+    }
+    if (type == RecordType::commit) {
+        uint32_t ticket = ++m_requested;
+        if (merge) {
+            Record* pCommit = reinterpret_cast<Record*>(m_pPending->data + m_pPending->used -
+                                                        recordSize_(0, sizeof(ticket)));
+            memcpy(const_cast<uint8_t*>(value_(pCommit)), &ticket, sizeof(ticket));
+        } else {
+            append_(type, nullptr, 0, &ticket, sizeof(ticket));
+        }
+#ifdef EM_MULTITHREAD
+        m_workCv.notify_one();
+#endif
+        return EmStorageError::none;
+    }
+    append_(type, key, keyLen, value, len);
+    return EmStorageError::none;
+}
+
+EmStorageError EmAsyncStorageBackend::write_(RecordType type,
+                                             const char* key,
+                                             const void* value,
+                                             size_t len) {
+    switch (type) {
+    case RecordType::blob:
+        return m_backend.setBlob(key, value, len);
+    case RecordType::string:
+        return m_backend.setString(key, static_cast<const char*>(value));
+    case RecordType::erase: {
+        EmStorageError err = m_backend.erase(key);
+        return err == EmStorageError::notFound ? EmStorageError::none : err;
+    }
+    case RecordType::eraseAll:
+        return m_backend.eraseAll();
+    default:
+        return m_backend.commit();
+    }
+}
+
+EmStorageError EmAsyncStorageBackend::get_(const char* key, RecordType type, void* buf, size_t& len) {
+    if (!isOpen()) {
+        return EmStorageError::invalidHandle;
+    }
+    {
+        EmMutexLock lock(m_mutex);
+        const Record* pRecord = staged_(key);
+        if (pRecord != nullptr) {
+            return read_(pRecord, type, buf, len);
+        }
+    }
+    EmMutexLock lock(m_backendMutex);
+    return type == RecordType::string ? m_backend.getString(key, static_cast<char*>(buf), len) :
+                                        m_backend.getBlob(key, buf, len);
+}
+
+EmStorageError EmAsyncStorageBackend::setBlob(const char* key, const void* value, size_t len) {
+    if (value == nullptr && len != 0) {
+        return EmStorageError::invalidLength;
+    }
+    return stage_(RecordType::blob, key, value, len);
+}
+
+EmStorageError EmAsyncStorageBackend::setString(const char* key, const char* value) {
+    if (value == nullptr) {
+        return EmStorageError::invalidLength;
+    }
+    return stage_(RecordType::string, key, value, strlen(value) + 1);
+}
+
+EmStorageError EmAsyncStorageBackend::getBlob(const char* key, void* buf, size_t& len) {
+    return get_(key, RecordType::blob, buf, len);
+}
+
+EmStorageError EmAsyncStorageBackend::getString(const char* key, char* buf, size_t& len) {
+    return get_(key, RecordType::string, buf, len);
+}
+
+EmStorageError EmAsyncStorageBackend::getChunks(const char* key,
+                                                bool isString,
+                                                void* buf,
+                                                size_t bufSize,
+                                                EmStorageChunkVisitor visitor,
+                                                void* pUserData) {
+    if (!isOpen()) {
+        return EmStorageError::invalidHandle;
+    }
+    {
+        EmMutexLock lock(m_mutex);
+        const Record* pRecord = staged_(key);
+        if (pRecord != nullptr) {
+            size_t len = 0;
+            EmStorageError err = read_(pRecord,
+                                       isString ? RecordType::string : RecordType::blob,
+                                       nullptr,
+                                       len);
+            if (err != EmStorageError::none) {
+                return err;
+            }
+            EmStorageChunk chunk;
+            chunk.data = value_(pRecord);
+            chunk.len = len;
+            chunk.offset = 0;
+            chunk.size = len;
+            visitor(chunk, pUserData);
+            return EmStorageError::none;
+        }
+    }
+    EmMutexLock lock(m_backendMutex);
+    return m_backend.getChunks(key, isString, buf, bufSize, visitor, pUserData);
+}
+
+EmStorageError EmAsyncStorageBackend::erase(const char* key) {
+    return stage_(RecordType::erase, key, nullptr, 0);
+}
+
+EmStorageError EmAsyncStorageBackend::eraseAll() {
+    return stage_(RecordType::eraseAll, nullptr, nullptr, 0);
+}
+
+EmStorageError EmAsyncStorageBackend::commit() {
+    return stage_(RecordType::commit, nullptr, nullptr, sizeof(uint32_t));
+}
+
+EmStorageError EmAsyncStorageBackend::flush() {
+    EmStorageError err = commit();
+    return err != EmStorageError::none ? err : wait(getCommitTicket());
+}
+
+EmStorageError EmAsyncStorageBackend::freeEntries(size_t& entries) const {
+    EmMutexLock lock(m_backendMutex);
+    return m_backend.freeEntries(entries);
+}
+
+uint32_t EmAsyncStorageBackend::forEach(EmStorageVisitor visitor, void* pUserData) {
+    flush();
+    EmMutexLock lock(m_backendMutex);
+    return m_backend.forEach(visitor, pUserData);
+}
+
+void EmAsyncStorageBackend::update() {
+#ifndef EM_MULTITHREAD
+    if (m_drain || m_requested != m_started) {
+        process_();
+    }
+#endif
+}
+
+uint32_t EmAsyncStorageBackend::getCommitTicket() const {
+    EmMutexLock lock(m_mutex);
+    return m_requested;
+}
+
+bool EmAsyncStorageBackend::isCommitted(uint32_t ticket) const {
+    EmMutexLock lock(m_mutex);
+    return isDone_(m_done, ticket);
+}
+
+EmStorageError EmAsyncStorageBackend::wait(uint32_t ticket) {
+#ifdef EM_MULTITHREAD
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCv.wait(lock, [this, ticket] { return isDone_(m_done, ticket); });
+#else
+    if (!isDone_(m_done, ticket)) {
+        process_();
+    }
+#endif
+    return m_lastError;
+}
+
+EmStorageError EmAsyncStorageBackend::getLastError() const {
+    EmMutexLock lock(m_mutex);
+    return m_lastError;
+}
+
+void EmAsyncStorageBackend::process_() {
+    {
+        EmMutexLock lock(m_mutex);
+        Queue* pQueue = m_pPending;
+        m_pPending = m_pInflight;
+        m_pInflight = pQueue;
+        m_started = m_requested;
+        m_drain = false;
+    }
+#ifdef EM_MULTITHREAD
+    // Room for the waiting writers
+    m_doneCv.notify_all();
+#endif
+    // NOTE: the inflight queue is changed by the worker only
+    const Queue& queue = *m_pInflight;
+    EmStorageError err = EmStorageError::none;
+    bool committing = false;
+    uint32_t ticket = 0;
+    for (size_t offset=0; offset < queue.used; ) {
+        const Record* pRecord = reinterpret_cast<const Record*>(queue.data + offset);
+        offset += recordSize_(pRecord->keyLen, pRecord->len);
+        RecordType type = static_cast<RecordType>(pRecord->type);
+        EmMutexLock lock(m_backendMutex);
+        if (type == RecordType::commit) {
+            // Each commit is a barrier (i.e. the next writes are not
+            // committed with the previous ones), commits with nothing
+            // written between them are grouped
+            committing = true;
+            memcpy(&ticket, value_(pRecord), sizeof(ticket));
+            if (m_uncommitted) {
+                EmStorageError res = m_backend.commit();
+                if (err == EmStorageError::none) {
+                    err = res;
+                }
+                m_uncommitted = false;
+                m_commits++;
+            }
+            continue;
+        }
+        EmStorageError res = write_(type, key_(pRecord), value_(pRecord), pRecord->len);
+        if (err == EmStorageError::none) {
+            err = res;
+        }
+        m_uncommitted = true;
+    }
+    // NOTE: called before waking the waiters
+    if (committing && m_onCommitted != nullptr) {
+        m_onCommitted(ticket, err, m_pUserData);
+    }
+    {
+        EmMutexLock lock(m_mutex);
+        if (committing) {
+            m_done = ticket;
+        }
+        // Failed writes not committed are reported as well
+        if (committing || err != EmStorageError::none) {
+            m_lastError = err;
+        }
+        m_pInflight->used = 0;
+        m_pInflight->segment = 0;
+    }
+#ifdef EM_MULTITHREAD
+    m_doneCv.notify_all();
+#endif
+}
+
+#ifdef EM_MULTITHREAD
+
+void EmAsyncStorageBackend::run_() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_workCv.wait(lock, [this] { return m_stop || m_drain || m_requested != m_started; });
+        if (!m_drain && m_requested == m_started) {
+            // Stopped (i.e. 'close' drained the queue)
+            break;
+        }
+        lock.unlock();
+        process_();
+        lock.lock();
+    }
+}
+
+#endif // EM_MULTITHREAD
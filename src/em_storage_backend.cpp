@@ -0,0 +1,473 @@
+#include "em_storage_backend.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define EM_STORAGE_MEM_MAGIC 0x54534D45 // "EMST"
+#define EM_STORAGE_MEM_VERSION 1
+
+// Storage errors strings (see 'EmStorageError')
+static const char* storage_errors[] = { "NO_ERROR",
+                                        "NOT_INITIALIZED",
+                                        "NOT_FOUND",
+                                        "TYPE_MISMATCH",
+                                        "READ_ONLY",
+                                        "NOT_ENOUGH_SPACE",
+                                        "INVALID_NAME",
+                                        "INVALID_HANDLE",
+                                        "REMOVE_FAILED",
+                                        "KEY_TOO_LONG",
+                                        "PAGE_FULL",
+                                        "INVALID_STATE",
+                                        "INVALID_LENGTH",
+                                        "UNDEFINED ERROR" };
+
+const char* storageErrorToStr(EmStorageError error) {
+    uint8_t index = static_cast<uint8_t>(error);
+    return index < SIZE_OF(storage_errors) ? storage_errors[index] :
+                                             storage_errors[SIZE_OF(storage_errors)-1];
+}
+
+EmStorageError EmStorageBackend::getChunks(const char* key,
+                                           bool isString,
+                                           void* buf,
+                                           size_t bufSize,
+                                           EmStorageChunkVisitor visitor,
+                                           void* pUserData) {
+    if (buf == nullptr || bufSize == 0) {
+        return EmStorageError::invalidLength;
+    }
+    size_t len = bufSize;
+    EmStorageError err = isString ? getString(key, static_cast<char*>(buf), len) :
+                                    getBlob(key, buf, len);
+    if (err != EmStorageError::none) {
+        return err;
+    }
+    EmStorageChunk chunk;
+    chunk.data = buf;
+    chunk.len = len;
+    chunk.offset = 0;
+    chunk.size = len;
+    visitor(chunk, pUserData);
+    return EmStorageError::none;
+}
+
+#ifdef EM_NVS
+
+EmStorageError EmNvsStorageBackend::error_(esp_err_t err) {
+    if (err == ESP_OK) {
+        return EmStorageError::none;
+    }
+    // NOTE: the storage errors have the same order as the NVS ones
+    if (err > ESP_ERR_NVS_BASE &&
+        err - ESP_ERR_NVS_BASE < static_cast<esp_err_t>(EmStorageError::failed)) {
+        return static_cast<EmStorageError>(err - ESP_ERR_NVS_BASE);
+    }
+    return EmStorageError::failed;
+}
+
+EmStorageError EmNvsStorageBackend::open(const char* name) {
+    if (m_open) {
+        return EmStorageError::invalidState;
+    }
+    if (name == nullptr || strlen(name) > EM_STORAGE_MAX_KEY_LEN) {
+        return EmStorageError::invalidName;
+    }
+    esp_err_t err = nvs_open(name, NVS_READWRITE, &m_handle);
+    m_open = err == ESP_OK;
+    if (m_open) {
+        strcpy(m_namespace, name);
+    }
+    return error_(err);
+}
+
+void EmNvsStorageBackend::close() {
+    if (m_open) {
+        nvs_close(m_handle);
+        m_open = false;
+    }
+}
+
+EmStorageError EmNvsStorageBackend::setBlob(const char* key, const void* value, size_t len) {
+    return error_(nvs_set_blob(m_handle, key, value, len));
+}
+
+EmStorageError EmNvsStorageBackend::setString(const char* key, const char* value) {
+    return error_(nvs_set_str(m_handle, key, value));
+}
+
+EmStorageError EmNvsStorageBackend::getBlob(const char* key, void* buf, size_t& len) {
+    return error_(nvs_get_blob(m_handle, key, buf, &len));
+}
+
+EmStorageError EmNvsStorageBackend::getString(const char* key, char* buf, size_t& len) {
+    return error_(nvs_get_str(m_handle, key, buf, &len));
+}
+
+EmStorageError EmNvsStorageBackend::erase(const char* key) {
+    return error_(nvs_erase_key(m_handle, key));
+}
+
+EmStorageError EmNvsStorageBackend::eraseAll() {
+    return error_(nvs_erase_all(m_handle));
+}
+
+EmStorageError EmNvsStorageBackend::commit() {
+    return error_(nvs_commit(m_handle));
+}
+
+EmStorageError EmNvsStorageBackend::freeEntries(size_t& entries) const {
+    nvs_stats_t nvs_stats;
+    esp_err_t err = nvs_get_stats(NULL, &nvs_stats);
+    entries = err == ESP_OK ? nvs_stats.free_entries : 0;
+    return error_(err);
+}
+
+uint32_t EmNvsStorageBackend::forEach(EmStorageVisitor visitor, void* pUserData) {
+    if (!m_open) {
+        return 0;
+    }
+    uint32_t count = 0;
+    // NOTE: IDF 5 iterator functions return an error and update the iterator,
+    //       IDF 4 ones return the iterator (i.e. NULL when no more entries)
+#if ESP_IDF_VERSION_MAJOR >= 5
+    nvs_iterator_t it = NULL;
+    esp_err_t err = nvs_entry_find(NVS_DEFAULT_PART_NAME, m_namespace, NVS_TYPE_ANY, &it);
+    while (err == ESP_OK) {
+#else
+    nvs_iterator_t it = nvs_entry_find(NVS_DEFAULT_PART_NAME, m_namespace, NVS_TYPE_ANY);
+    while (it != NULL) {
+#endif
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+        if (info.type == NVS_TYPE_STR || info.type == NVS_TYPE_BLOB) {
+            EmStorageEntry entry;
+            entry.key = info.key;
+            entry.isString = info.type == NVS_TYPE_STR;
+            entry.value = nullptr;
+            entry.len = 0;
+            count++;
+            if (!visitor(entry, pUserData)) {
+                break;
+            }
+        }
+#if ESP_IDF_VERSION_MAJOR >= 5
+        err = nvs_entry_next(&it);
+#else
+        it = nvs_entry_next(it);
+#endif
+    }
+    nvs_release_iterator(it);
+    return count;
+}
+
+#endif // EM_NVS
+
+EmStorageError EmMemStorageBackend::open(const char* name) {
+    if (m_open) {
+        return EmStorageError::invalidState;
+    }
+    if (m_pMemory == nullptr || m_size < sizeof(Header)) {
+        return EmStorageError::notInitialized;
+    }
+    if (name == nullptr || name[0] == 0 || strlen(name) > EM_STORAGE_MAX_KEY_LEN) {
+        return EmStorageError::invalidName;
+    }
+    Header* pHeader = header_();
+    if (pHeader->magic != EM_STORAGE_MEM_MAGIC ||
+        pHeader->version != EM_STORAGE_MEM_VERSION ||
+        pHeader->used > m_size - sizeof(Header)) {
+        // Not a valid storage: lets format it
+        pHeader->magic = EM_STORAGE_MEM_MAGIC;
+        pHeader->version = EM_STORAGE_MEM_VERSION;
+        pHeader->reserved = 0;
+        pHeader->used = 0;
+    }
+    validate_();
+    strcpy(m_namespace, name);
+    m_open = true;
+    return EmStorageError::none;
+}
+
+bool EmMemStorageBackend::validate_() {
+    Header* pHeader = header_();
+    uint8_t* pBegin = entries_();
+    uint8_t* p = pBegin;
+    uint8_t* pEnd = pBegin + pHeader->used;
+    while (p < pEnd) {
+        Entry* pEntry = reinterpret_cast<Entry*>(p);
+        if (static_cast<size_t>(pEnd - p) < sizeof(Entry) ||
+            pEntry->size < sizeof(Entry) ||
+            (pEntry->size & 3) != 0 ||
+            pEntry->size > static_cast<size_t>(pEnd - p) ||
+            pEntry->len > pEntry->size - sizeof(Entry) ||
+            memchr(pEntry->ns, 0, sizeof(pEntry->ns)) == nullptr ||
+            memchr(pEntry->key, 0, sizeof(pEntry->key)) == nullptr) {
+            // Drop this entry and the following ones
+            pHeader->used = static_cast<uint32_t>(p - pBegin);
+            return false;
+        }
+        p += pEntry->size;
+    }
+    return true;
+}
+
+void EmMemStorageBackend::close() {
+    m_open = false;
+}
+
+EmMemStorageBackend::Entry* EmMemStorageBackend::find_(const char* key) const {
+    uint8_t* p = entries_();
+    uint8_t* pEnd = p + header_()->used;
+    while (p < pEnd) {
+        Entry* pEntry = reinterpret_cast<Entry*>(p);
+        if (strcmp(pEntry->key, key) == 0 && strcmp(pEntry->ns, m_namespace) == 0) {
+            return pEntry;
+        }
+        p += pEntry->size;
+    }
+    return nullptr;
+}
+
+void EmMemStorageBackend::remove_(Entry* pEntry) {
+    Header* pHeader = header_();
+    uint8_t* p = reinterpret_cast<uint8_t*>(pEntry);
+    uint8_t* pEnd = entries_() + pHeader->used;
+    uint32_t size = pEntry->size;
+    memmove(p, p + size, pEnd - p - size);
+    pHeader->used -= size;
+}
+
+EmStorageError EmMemStorageBackend::set_(const char* key,
+                                         EntryType type,
+                                         const void* value,
+                                         size_t len) {
+    if (!m_open) {
+        return EmStorageError::invalidHandle;
+    }
+    if (key == nullptr || value == nullptr) {
+        return EmStorageError::invalidName;
+    }
+    if (strlen(key) > EM_STORAGE_MAX_KEY_LEN) {
+        return EmStorageError::keyTooLong;
+    }
+    uint32_t size = (sizeof(Entry) + len + 3) & ~3UL;
+    Header* pHeader = header_();
+    Entry* pEntry = find_(key);
+    // Same size? Lets overwrite it
+    if (pEntry == nullptr || pEntry->size != size) {
+        size_t available = m_size - sizeof(Header) - pHeader->used;
+        if (pEntry != nullptr) {
+            available += pEntry->size;
+        }
+        if (size > available) {
+            return EmStorageError::notEnoughSpace;
+        }
+        if (pEntry != nullptr) {
+            remove_(pEntry);
+        }
+        pEntry = reinterpret_cast<Entry*>(entries_() + pHeader->used);
+        memset(pEntry, 0, sizeof(Entry));
+        pEntry->size = size;
+        strcpy(pEntry->ns, m_namespace);
+        strcpy(pEntry->key, key);
+        pHeader->used += size;
+    }
+    pEntry->type = static_cast<uint8_t>(type);
+    pEntry->len = static_cast<uint32_t>(len);
+    memcpy(value_(pEntry), value, len);
+    return EmStorageError::none;
+}
+
+EmStorageError EmMemStorageBackend::get_(const char* key,
+                                         EntryType type,
+                                         void* buf,
+                                         size_t& len) const {
+    if (!m_open) {
+        return EmStorageError::invalidHandle;
+    }
+    if (key == nullptr) {
+        return EmStorageError::invalidName;
+    }
+    Entry* pEntry = find_(key);
+    if (pEntry == nullptr) {
+        return EmStorageError::notFound;
+    }
+    if (pEntry->type != static_cast<uint8_t>(type)) {
+        return EmStorageError::typeMismatch;
+    }
+    if (buf == nullptr) {
+        len = pEntry->len;
+        return EmStorageError::none;
+    }
+    if (len < pEntry->len) {
+        return EmStorageError::invalidLength;
+    }
+    len = pEntry->len;
+    memcpy(buf, value_(pEntry), len);
+    return EmStorageError::none;
+}
+
+EmStorageError EmMemStorageBackend::setBlob(const char* key, const void* value, size_t len) {
+    return set_(key, EntryType::blob, value, len);
+}
+
+EmStorageError EmMemStorageBackend::setString(const char* key, const char* value) {
+    return set_(key, EntryType::string, value, value != nullptr ? strlen(value) + 1 : 0);
+}
+
+EmStorageError EmMemStorageBackend::getBlob(const char* key, void* buf, size_t& len) {
+    return get_(key, EntryType::blob, buf, len);
+}
+
+EmStorageError EmMemStorageBackend::getString(const char* key, char* buf, size_t& len) {
+    return get_(key, EntryType::string, buf, len);
+}
+
+EmStorageError EmMemStorageBackend::getChunks(const char* key,
+                                              bool isString,
+                                              void* /*buf*/,
+                                              size_t /*bufSize*/,
+                                              EmStorageChunkVisitor visitor,
+                                              void* pUserData) {
+    if (!m_open) {
+        return EmStorageError::invalidHandle;
+    }
+    if (key == nullptr) {
+        return EmStorageError::invalidName;
+    }
+    Entry* pEntry = find_(key);
+    if (pEntry == nullptr) {
+        return EmStorageError::notFound;
+    }
+    EntryType type = isString ? EntryType::string : EntryType::blob;
+    if (pEntry->type != static_cast<uint8_t>(type)) {
+        return EmStorageError::typeMismatch;
+    }
+    EmStorageChunk chunk;
+    chunk.data = value_(pEntry);
+    chunk.len = pEntry->len;
+    chunk.offset = 0;
+    chunk.size = pEntry->len;
+    visitor(chunk, pUserData);
+    return EmStorageError::none;
+}
+
+EmStorageError EmMemStorageBackend::erase(const char* key) {
+    if (!m_open) {
+        return EmStorageError::invalidHandle;
+    }
+    if (key == nullptr) {
+        return EmStorageError::invalidName;
+    }
+    Entry* pEntry = find_(key);
+    if (pEntry == nullptr) {
+        return EmStorageError::notFound;
+    }
+    remove_(pEntry);
+    return EmStorageError::none;
+}
+
+EmStorageError EmMemStorageBackend::eraseAll() {
+    if (!m_open) {
+        return EmStorageError::invalidHandle;
+    }
+    uint8_t* p = entries_();
+    while (p < entries_() + header_()->used) {
+        Entry* pEntry = reinterpret_cast<Entry*>(p);
+        if (strcmp(pEntry->ns, m_namespace) == 0) {
+            remove_(pEntry);
+        } else {
+            p += pEntry->size;
+        }
+    }
+    return EmStorageError::none;
+}
+
+uint32_t EmMemStorageBackend::forEach(EmStorageVisitor visitor, void* pUserData) {
+    if (!m_open) {
+        return 0;
+    }
+    uint32_t count = 0;
+    uint8_t* p = entries_();
+    uint8_t* pEnd = p + header_()->used;
+    for (; p < pEnd; p += reinterpret_cast<Entry*>(p)->size) {
+        Entry* pEntry = reinterpret_cast<Entry*>(p);
+        if (strcmp(pEntry->ns, m_namespace) != 0) {
+            continue;
+        }
+        EmStorageEntry entry;
+        entry.key = pEntry->key;
+        entry.isString = pEntry->type == static_cast<uint8_t>(EntryType::string);
+        entry.value = value_(pEntry);
+        entry.len = pEntry->len;
+        count++;
+        if (!visitor(entry, pUserData)) {
+            break;
+        }
+    }
+    return count;
+}
+
+EmStorageError EmMemStorageBackend::commit() {
+    // Memory is written as it is
+    return m_open ? EmStorageError::none : EmStorageError::invalidHandle;
+}
+
+EmStorageError EmMemStorageBackend::freeEntries(size_t& entries) const {
+    if (!m_open) {
+        entries = 0;
+        return EmStorageError::invalidHandle;
+    }
+    entries = (m_size - sizeof(Header) - header_()->used) / EM_STORAGE_ENTRY_SIZE;
+    return EmStorageError::none;
+}
+
+#ifdef __linux__
+
+EmStorageError EmFileStorageBackend::open(const char* name) {
+    if (m_pMemory != nullptr) {
+        return EmStorageError::invalidState;
+    }
+    int fd = ::open(m_path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return EmStorageError::failed;
+    }
+    if (ftruncate(fd, static_cast<off_t>(m_size)) != 0) {
+        ::close(fd);
+        return EmStorageError::failed;
+    }
+    void* pMemory = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // The mapping keeps the file referenced
+    ::close(fd);
+    if (pMemory == MAP_FAILED) {
+        return EmStorageError::failed;
+    }
+    m_pMemory = static_cast<uint8_t*>(pMemory);
+    EmStorageError err = EmMemStorageBackend::open(name);
+    if (err != EmStorageError::none) {
+        close();
+    }
+    return err;
+}
+
+void EmFileStorageBackend::close() {
+    EmMemStorageBackend::close();
+    if (m_pMemory != nullptr) {
+        munmap(m_pMemory, m_size);
+        m_pMemory = nullptr;
+    }
+}
+
+EmStorageError EmFileStorageBackend::commit() {
+    if (!m_open) {
+        return EmStorageError::invalidHandle;
+    }
+    return msync(m_pMemory, m_size, MS_SYNC) == 0 ? EmStorageError::none :
+                                                    EmStorageError::failed;
+}
+
+#endif // __linux__
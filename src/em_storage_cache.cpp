@@ -0,0 +1,242 @@
+#include "em_storage_cache.h"
+
+#include <Arduino.h>
+
+static EmStorageError writeBlob(EmStorageBackend& backend,
+                                const char* key,
+                                const void* value,
+                                size_t len) {
+    return backend.setBlob(key, value, len);
+}
+
+static EmStorageError writeString(EmStorageBackend& backend,
+                                  const char* key,
+                                  const void* value,
+                                  size_t /*len*/) {
+    return backend.setString(key, static_cast<const char*>(value));
+}
+
+static EmStorageError eraseKey(EmStorageBackend& backend,
+                               const char* key,
+                               const void* /*value*/,
+                               size_t /*len*/) {
+    return backend.erase(key);
+}
+
+EmStorageError EmWriteBackStorageBackend::Cache::erase(const char* key) {
+    return set_(key, EntryType::removed, "", 0);
+}
+
+bool EmWriteBackStorageBackend::Cache::isRemoved(const char* key) const {
+    Entry* pEntry = key != nullptr && isOpen() ? find_(key) : nullptr;
+    return pEntry != nullptr && pEntry->type == static_cast<uint8_t>(EntryType::removed);
+}
+
+EmStorageError EmWriteBackStorageBackend::Cache::writeTo(EmStorageBackend& backend,
+                                                         uint32_t& writes) const {
+    uint8_t* p = entries_();
+    uint8_t* pEnd = p + header_()->used;
+    for (; p < pEnd; p += reinterpret_cast<Entry*>(p)->size) {
+        Entry* pEntry = reinterpret_cast<Entry*>(p);
+        if (strcmp(pEntry->ns, m_namespace) != 0) {
+            continue;
+        }
+        writes++;
+        EmStorageError err;
+        switch (static_cast<EntryType>(pEntry->type)) {
+            case EntryType::removed:
+                err = backend.erase(pEntry->key);
+                if (err == EmStorageError::notFound) {
+                    err = EmStorageError::none;
+                }
+                break;
+            case EntryType::string:
+                err = backend.setString(pEntry->key, reinterpret_cast<const char*>(value_(pEntry)));
+                break;
+            default:
+                err = backend.setBlob(pEntry->key, value_(pEntry), pEntry->len);
+                break;
+        }
+        if (err != EmStorageError::none) {
+            return err;
+        }
+    }
+    return EmStorageError::none;
+}
+
+EmStorageError EmWriteBackStorageBackend::open(const char* name) {
+    EmStorageError err = m_backend.open(name);
+    if (err != EmStorageError::none) {
+        return err;
+    }
+    err = m_cache.open(name);
+    if (err != EmStorageError::none) {
+        m_backend.close();
+        return err;
+    }
+    // NOTE: cache memory might keep old entries (e.g. a not initialized RAM)
+    m_cache.eraseAll();
+    m_dirty = false;
+    m_uncommitted = false;
+    return EmStorageError::none;
+}
+
+void EmWriteBackStorageBackend::close() {
+    if (!isOpen()) {
+        return;
+    }
+    if (flush() != EmStorageError::none) {
+        // Dirty entries are kept (i.e. not closed, see 'getFlushError')
+        return;
+    }
+    m_cache.close();
+    m_backend.close();
+}
+
+EmStorageError EmWriteBackStorageBackend::set_(const char* key,
+                                               const void* value,
+                                               size_t len,
+                                               Writer write) {
+    if (!isOpen()) {
+        return EmStorageError::invalidHandle;
+    }
+    m_writes++;
+    EmStorageError err = write(m_cache, key, value, len);
+    if (err == EmStorageError::notEnoughSpace) {
+        // Cache full: lets flush it and try again
+        // NOTE: cached writes go first (i.e. writes order is kept)
+        err = flush();
+        if (err != EmStorageError::none) {
+            return err;
+        }
+        err = write(m_cache, key, value, len);
+        if (err == EmStorageError::notEnoughSpace) {
+            // Bigger than the cache: write it through
+            m_backendWrites++;
+            err = write(m_backend, key, value, len);
+            if (err == EmStorageError::none) {
+                m_uncommitted = true;
+            }
+            return err;
+        }
+    }
+    if (err == EmStorageError::none && !m_dirty) {
+        m_dirty = true;
+        m_dirtyMs = millis();
+    }
+    return err;
+}
+
+EmStorageError EmWriteBackStorageBackend::setBlob(const char* key, const void* value, size_t len) {
+    return set_(key, value, len, writeBlob);
+}
+
+EmStorageError EmWriteBackStorageBackend::setString(const char* key, const char* value) {
+    return set_(key, value, 0, writeString);
+}
+
+EmStorageError EmWriteBackStorageBackend::getBlob(const char* key, void* buf, size_t& len) {
+    EmStorageError err = m_cache.getBlob(key, buf, len);
+    if (err == EmStorageError::typeMismatch && m_cache.isRemoved(key)) {
+        return EmStorageError::notFound;
+    }
+    return err == EmStorageError::notFound ? m_backend.getBlob(key, buf, len) : err;
+}
+
+EmStorageError EmWriteBackStorageBackend::getString(const char* key, char* buf, size_t& len) {
+    EmStorageError err = m_cache.getString(key, buf, len);
+    if (err == EmStorageError::typeMismatch && m_cache.isRemoved(key)) {
+        return EmStorageError::notFound;
+    }
+    return err == EmStorageError::notFound ? m_backend.getString(key, buf, len) : err;
+}
+
+EmStorageError EmWriteBackStorageBackend::getChunks(const char* key,
+                                                    bool isString,
+                                                    void* buf,
+                                                    size_t bufSize,
+                                                    EmStorageChunkVisitor visitor,
+                                                    void* pUserData) {
+    EmStorageError err = m_cache.getChunks(key, isString, buf, bufSize, visitor, pUserData);
+    if (err == EmStorageError::typeMismatch && m_cache.isRemoved(key)) {
+        return EmStorageError::notFound;
+    }
+    return err == EmStorageError::notFound ?
+        m_backend.getChunks(key, isString, buf, bufSize, visitor, pUserData) : err;
+}
+
+EmStorageError EmWriteBackStorageBackend::erase(const char* key) {
+    if (!isOpen()) {
+        return EmStorageError::invalidHandle;
+    }
+    if (key == nullptr) {
+        return EmStorageError::invalidName;
+    }
+    // Neither cached nor in the backend?
+    size_t len = 0;
+    if (m_cache.isRemoved(key) ||
+        (m_cache.getBlob(key, nullptr, len) == EmStorageError::notFound &&
+         m_backend.getBlob(key, nullptr, len) == EmStorageError::notFound)) {
+        return EmStorageError::notFound;
+    }
+    // NOTE: the removal is cached (i.e. written in order with the cached writes)
+    return set_(key, nullptr, 0, eraseKey);
+}
+
+EmStorageError EmWriteBackStorageBackend::eraseAll() {
+    if (!isOpen()) {
+        return EmStorageError::invalidHandle;
+    }
+    m_cache.eraseAll();
+    m_dirty = false;
+    m_uncommitted = true;
+    return m_backend.eraseAll();
+}
+
+EmStorageError EmWriteBackStorageBackend::commit() {
+    if (!isOpen()) {
+        return EmStorageError::invalidHandle;
+    }
+    // NOTE: a full cache is flushed by the write not fitting it
+    if (m_dirty && m_flushBytes != 0 && m_cache.usedBytes() >= m_flushBytes) {
+        return flush();
+    }
+    // Writes bypassing the cache are committed right away
+    return m_uncommitted ? commit_() : EmStorageError::none;
+}
+
+EmStorageError EmWriteBackStorageBackend::flush() {
+    if (!isOpen()) {
+        return EmStorageError::invalidHandle;
+    }
+    m_flushError = EmStorageError::none;
+    if (m_dirty) {
+        m_uncommitted = true;
+        m_flushError = m_cache.writeTo(m_backend, m_backendWrites);
+        if (m_flushError != EmStorageError::none) {
+            // Cached entries are kept (i.e. written again on next flush)
+            return m_flushError;
+        }
+        m_cache.eraseAll();
+        m_dirty = false;
+    }
+    if (m_uncommitted) {
+        m_flushError = commit_();
+    }
+    return m_flushError;
+}
+
+EmStorageError EmWriteBackStorageBackend::commit_() {
+    m_backendCommits++;
+    EmStorageError err = m_backend.commit();
+    if (err == EmStorageError::none) {
+        m_uncommitted = false;
+    }
+    return err;
+}
+
+void EmWriteBackStorageBackend::update() {
+    if (m_dirty && m_flushIntervalMs != 0 && millis() - m_dirtyMs >= m_flushIntervalMs) {
+        flush();
+    }
+}
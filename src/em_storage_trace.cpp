@@ -0,0 +1,202 @@
+#include "em_storage_trace.h"
+
+#include <stdlib.h>
+
+void EmStorageTraceRecorder::record_(char op, const char* key, size_t len, bool hasLen) {
+    if (m_writer == nullptr) {
+        return;
+    }
+    char line[EM_STORAGE_MAX_KEY_LEN + 16];
+    if (hasLen) {
+        snprintf(line, sizeof(line), "%c %.*s %u", op, EM_STORAGE_MAX_KEY_LEN, key,
+                 static_cast<unsigned int>(len));
+    } else if (key != nullptr) {
+        snprintf(line, sizeof(line), "%c %.*s", op, EM_STORAGE_MAX_KEY_LEN, key);
+    } else {
+        snprintf(line, sizeof(line), "%c", op);
+    }
+    m_writer(line, m_pUserData);
+}
+
+EmStorageError EmStorageTraceRecorder::setBlob(const char* key, const void* value, size_t len) {
+    if (key != nullptr) {
+        record_('b', key, len, true);
+    }
+    return m_backend.setBlob(key, value, len);
+}
+
+EmStorageError EmStorageTraceRecorder::setString(const char* key, const char* value) {
+    if (key != nullptr && value != nullptr) {
+        record_('s', key, strlen(value) + 1, true);
+    }
+    return m_backend.setString(key, value);
+}
+
+EmStorageError EmStorageTraceRecorder::getBlob(const char* key, void* buf, size_t& len) {
+    if (key != nullptr && buf != nullptr) {
+        record_('B', key);
+    }
+    return m_backend.getBlob(key, buf, len);
+}
+
+EmStorageError EmStorageTraceRecorder::getString(const char* key, char* buf, size_t& len) {
+    if (key != nullptr && buf != nullptr) {
+        record_('S', key);
+    }
+    return m_backend.getString(key, buf, len);
+}
+
+EmStorageError EmStorageTraceRecorder::getChunks(const char* key,
+                                                 bool isString,
+                                                 void* buf,
+                                                 size_t bufSize,
+                                                 EmStorageChunkVisitor visitor,
+                                                 void* pUserData) {
+    if (key != nullptr) {
+        record_(isString ? 'S' : 'B', key);
+    }
+    return m_backend.getChunks(key, isString, buf, bufSize, visitor, pUserData);
+}
+
+EmStorageError EmStorageTraceRecorder::erase(const char* key) {
+    if (key != nullptr) {
+        record_('e', key);
+    }
+    return m_backend.erase(key);
+}
+
+EmStorageError EmStorageTraceRecorder::eraseAll() {
+    record_('E');
+    return m_backend.eraseAll();
+}
+
+EmStorageError EmStorageTraceRecorder::commit() {
+    record_('c');
+    return m_backend.commit();
+}
+
+EmStorageError EmStorageTraceRecorder::flush() {
+    record_('f');
+    return m_backend.flush();
+}
+
+bool EmStorageTraceReplay::replay(const char* trace, EmStorageTraceResult& result) {
+    memset(&result, 0, sizeof(result));
+    if (m_storage.isNotInitialized() || trace == nullptr) {
+        return false;
+    }
+    uint32_t deviceBytes = m_pDevice != nullptr ? m_pDevice->getWrittenBytes() : 0;
+    uint32_t seq = 0;
+    uint32_t startUs = micros();
+    const char* p = trace;
+    while (*p != 0) {
+        // Line: op, key and length (see 'EmStorageTraceRecorder')
+        const char* pEnd = strchr(p, '\n');
+        if (pEnd == nullptr) {
+            pEnd = p + strlen(p);
+        }
+        char op = *p;
+        char key[EM_STORAGE_MAX_KEY_LEN+1];
+        size_t keyLen = 0;
+        size_t len = 0;
+        const char* q = p + 1;
+        while (q < pEnd && *q == ' ') {
+            q++;
+        }
+        while (q < pEnd && *q != ' ' && *q != '\r' && keyLen < EM_STORAGE_MAX_KEY_LEN) {
+            key[keyLen++] = *q++;
+        }
+        key[keyLen] = 0;
+        if (q < pEnd && *q == ' ') {
+            len = static_cast<size_t>(strtoul(q, nullptr, 10));
+        }
+        if (pEnd > p && !replayLine_(op, key, len, seq++, result)) {
+            result.skipped++;
+        }
+        p = *pEnd != 0 ? pEnd + 1 : pEnd;
+    }
+    // NOTE: lines parsing included (i.e. operations faster than micros)
+    result.micros = micros() - startUs;
+    if (m_pDevice != nullptr) {
+        result.deviceBytes = m_pDevice->getWrittenBytes() - deviceBytes;
+    }
+    return true;
+}
+
+void EmStorageTraceReplay::fill_(size_t len, uint32_t seq, bool isString) {
+    if (isString) {
+        for (size_t i=0; i < len; i++) {
+            m_pBuffer[i] = static_cast<uint8_t>('a' + (seq + i) % 26);
+        }
+        m_pBuffer[len-1] = 0;
+        return;
+    }
+    memset(m_pBuffer, 0, len);
+    memcpy(m_pBuffer, &seq, MIN(len, sizeof(seq)));
+}
+
+bool EmStorageTraceReplay::replayLine_(char op,
+                                       const char* key,
+                                       size_t len,
+                                       uint32_t seq,
+                                       EmStorageTraceResult& result) {
+    bool hasKey = key[0] != 0;
+    EmStorageOp storageOp;
+    bool succeeded;
+    uint32_t startUs;
+    switch (op) {
+    case 'b':
+    case 's':
+        if (!hasKey || len == 0 || len > m_bufferSize) {
+            return false;
+        }
+        fill_(len, seq, op == 's');
+        storageOp = EmStorageOp::put;
+        startUs = micros();
+        succeeded = op == 'b' ?
+            m_storage.putBytes(key, m_pBuffer, len, false) == len :
+            m_storage.putString(key, reinterpret_cast<const char*>(m_pBuffer), false) == len - 1;
+        if (succeeded) {
+            result.valueBytes += len;
+        }
+        break;
+    case 'B':
+    case 'S':
+        if (!hasKey) {
+            return false;
+        }
+        storageOp = EmStorageOp::get;
+        startUs = micros();
+        succeeded = op == 'B' ?
+            m_storage.getBytes(key, m_pBuffer, m_bufferSize) != 0 :
+            m_storage.getString(key, reinterpret_cast<char*>(m_pBuffer), m_bufferSize) != 0;
+        break;
+    case 'e':
+        if (!hasKey) {
+            return false;
+        }
+        storageOp = EmStorageOp::remove;
+        startUs = micros();
+        succeeded = m_storage.remove(key, false);
+        break;
+    case 'E':
+        storageOp = EmStorageOp::remove;
+        startUs = micros();
+        succeeded = m_storage.clear();
+        break;
+    case 'c':
+    case 'f':
+        storageOp = EmStorageOp::commit;
+        startUs = micros();
+        succeeded = op == 'c' ? m_storage.commit() : m_storage.flush();
+        break;
+    default:
+        return false;
+    }
+    result.latency[static_cast<uint8_t>(storageOp)].add(micros() - startUs);
+    result.ops++;
+    if (!succeeded) {
+        result.failures++;
+    }
+    return true;
+}